@@ -0,0 +1,644 @@
+#include "RocketPlugin.h"
+
+#include "ExternalModules.h"
+#include "Networking/RPCompression.h"
+#include "Networking/MatchFileServer.h"
+#include "Networking/MappedFile.h"
+#include "Networking/Sha256.h"
+#include "Networking/Socket.h"
+#include "Networking/LanDiscovery.h"
+
+
+/*
+ *  Benchmark stuff
+ */
+
+/// <summary>Measures the average time of the given function.</summary>
+/// <param name="iterations">Number of times to call the function</param>
+/// <param name="func">Function to measure</param>
+/// <returns>Average nanoseconds per call</returns>
+template<typename Func>
+double bench_ns(const size_t iterations, Func&& func)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        func();
+    }
+    const auto duration = std::chrono::steady_clock::now() - start;
+
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) / static_cast<double>(iterations);
+}
+
+
+/// <summary>Gets the amount of iterations from the notifier arguments.</summary>
+/// <param name="arguments">Notifier arguments</param>
+/// <param name="defaultIterations">Default amount of iterations</param>
+/// <returns>Amount of iterations</returns>
+size_t get_iterations(const std::vector<std::string>& arguments, const size_t defaultIterations)
+{
+    if (arguments.size() > 1 && IsInt(arguments[1])) {
+        return std::max<size_t>(1, std::strtoull(arguments[1].c_str(), nullptr, 10));
+    }
+
+    return defaultIterations;
+}
+
+
+namespace LegacyRPMessage
+{
+    const std::string base64array = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    constexpr size_t HEADER_SIZE = 10;
+
+    /// <summary>Serializes the message in the version 1, hex in base64, format.</summary>
+    std::string Serialize(const RPMessage& message)
+    {
+        BitBinaryWriter<unsigned char> bbw(HEADER_SIZE);
+        bbw.WriteBits(static_cast<uint6_t>(1));
+        bbw.WriteBits(message.ModuleId);
+        bbw.WriteBits(message.SenderId);
+        bbw.WriteBits(message.ReceiverId);
+
+        const std::string serializedHeader = bbw.ToHex();
+        return base64array[(serializedHeader.length() + 1) & 0x3F] + serializedHeader + message.Message;
+    }
+
+    /// <summary>Deserializes the message from the version 1, hex in base64, format.</summary>
+    RPMessage Deserialize(const std::string& serializedMessage)
+    {
+        RPMessage message;
+        const size_t headerSize = base64array.find(serializedMessage.front());
+        BitBinaryReader<unsigned char> bbr(serializedMessage.substr(1));
+        message.Version = bbr.ReadBits<uint6_t>();
+        message.ModuleId = bbr.ReadBits<NetId>();
+        message.SenderId = bbr.ReadBits<int>();
+        message.ReceiverId = bbr.ReadBits<int>();
+        message.Message = serializedMessage.substr(headerSize);
+
+        return message;
+    }
+}
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_bench_rpmessage", [](const std::vector<std::string>& arguments) {
+    const size_t iterations = get_iterations(arguments, 100000);
+    const RPMessageHeader header(1, 1234, 5678);
+
+    BM_INFO_LOG("RPMessage v1 (text) vs v{:d} (binary), {:d} iterations", RP_MESSAGE_VERSION, iterations);
+    for (const size_t payloadSize : std::initializer_list<size_t>{ 0, 16, 64, 256, 1024 }) {
+        const RPMessage message(header, std::string(payloadSize, 'x'));
+
+        const std::string legacyMessage = LegacyRPMessage::Serialize(message);
+        const double legacyEncodeNs = bench_ns(iterations, [&]() {
+            volatile size_t size = LegacyRPMessage::Serialize(message).size();
+            (void)size;
+        });
+        const double legacyDecodeNs = bench_ns(iterations, [&]() {
+            volatile size_t size = LegacyRPMessage::Deserialize(legacyMessage).Message.size();
+            (void)size;
+        });
+
+        std::vector<char> buffer(message.SerializedSize());
+        const std::string binaryMessage = message.Serialize();
+        const double binaryEncodeNs = bench_ns(iterations, [&]() {
+            volatile size_t size = message.Serialize(buffer.data(), buffer.size());
+            (void)size;
+        });
+        RPMessage decodedMessage;
+        const double binaryDecodeNs = bench_ns(iterations, [&]() {
+            decodedMessage.Deserialize(binaryMessage);
+        });
+        RPMessageView decodedMessageView;
+        const double viewDecodeNs = bench_ns(iterations, [&]() {
+            decodedMessageView.Deserialize(binaryMessage);
+        });
+
+        BM_INFO_LOG("\tpayload {:4d}B: v1 {:4d}B {:7.1f}ns enc {:7.1f}ns dec | v{:d} {:4d}B {:7.1f}ns enc {:7.1f}ns dec {:7.1f}ns view dec",
+            payloadSize, legacyMessage.size(), legacyEncodeNs, legacyDecodeNs,
+            RP_MESSAGE_VERSION, binaryMessage.size(), binaryEncodeNs, binaryDecodeNs, viewDecodeNs);
+    }
+}, "Compares the RPMessage wire formats, usage: rp_bench_rpmessage [iterations]", PERMISSION_ALL); }
+
+
+namespace CompressionPayloads
+{
+    /// <summary>Appends the value as little endian bytes.</summary>
+    template<typename T>
+    void append(std::string& payload, const T value)
+    {
+        char buffer[sizeof(T)];
+        std::memcpy(buffer, &value, sizeof(T));
+        payload.append(buffer, sizeof(T));
+    }
+
+    /// <summary>Preset contents, read from the presets folder when it exists.</summary>
+    std::string Presets()
+    {
+        std::string payload;
+        std::error_code ec;
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(PRESETS_PATH, ec)) {
+            std::ifstream file(entry.path());
+            payload.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        if (payload.empty()) {
+            payload = "// Mutators from the official Snow Day preset\n"
+                "rp mutator \"BallType\" \"Ball_Puck\"\n"
+                "rp mutator \"BallBounciness\" \"LowBounciness\"\n"
+                "rp mutator \"BallWeight\" \"LightBall\"\n"
+                "rp mutator \"BallScale\" \"BigBall\"\n"
+                "rp mutator \"BallMaxSpeed\" \"FastBall\"\n";
+        }
+
+        return payload;
+    }
+
+    /// <summary>Car physics of every player, laid out like CarPhysicsMods::CarPhysics.</summary>
+    std::string CarPhysics(const size_t players)
+    {
+        std::string payload;
+        for (size_t i = 0; i < players; i++) {
+            append(payload, i % 4 == 0 ? 1.5f : 1.f);
+            append(payload, true);
+            append(payload, false);
+            append(payload, 1.f);
+            append(payload, 2300.f);
+            append(payload, 0.5f);
+            append(payload, 1.5f);
+        }
+
+        return payload;
+    }
+
+    /// <summary>Full table of the CrazyRumble items, as send by its replicated state.</summary>
+    std::string RumbleItems()
+    {
+        std::string payload;
+        for (size_t i = 0; i < 12; i++) {
+            append(payload, true);
+            append(payload, i < 6 ? 0.f : 4.f);
+            append(payload, i % 2 == 0);
+            append(payload, true);
+            append(payload, true);
+            append(payload, false);
+            append(payload, 2000.f + 250.f * static_cast<float>(i % 3));
+            append(payload, 1.f);
+            append(payload, 0.f);
+            append(payload, 0.f);
+            append(payload, 0.f);
+            append(payload, 0.5f);
+        }
+
+        return payload;
+    }
+
+    /// <summary>Random bytes, worst case for the compression.</summary>
+    std::string Random(const size_t size)
+    {
+        std::mt19937 random(0);
+        std::string payload(size, '\0');
+        for (char& c : payload) {
+            c = static_cast<char>(random());
+        }
+
+        return payload;
+    }
+}
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_bench_compression", [](const std::vector<std::string>& arguments) {
+    const size_t iterations = get_iterations(arguments, 10000);
+    const std::vector<std::pair<std::string, std::string>> payloads = {
+        { "ghost cars", "Activate true false false" },
+        { "presets", CompressionPayloads::Presets() },
+        { "car physics x8", CompressionPayloads::CarPhysics(8) },
+        { "car physics x64", CompressionPayloads::CarPhysics(64) },
+        { "rumble items", CompressionPayloads::RumbleItems() },
+        { "random", CompressionPayloads::Random(1024) }
+    };
+
+    BM_INFO_LOG("RPMessage payload compression, threshold {:d}B, {:d} iterations", RP_COMPRESSION_THRESHOLD, iterations);
+    std::string compressed;
+    std::string decompressed;
+    for (const auto& [name, payload] : payloads) {
+        const size_t compressedSize = lz_compress(payload, compressed);
+        lz_decompress(compressed, decompressed);
+        if (decompressed != payload) {
+            BM_ERROR_LOG("\t{:s}: round trip failed", name);
+            continue;
+        }
+
+        const double encodeNs = bench_ns(iterations, [&]() {
+            volatile size_t size = lz_compress(payload, compressed);
+            (void)size;
+        });
+        const double decodeNs = bench_ns(iterations, [&]() {
+            lz_decompress(compressed, decompressed);
+        });
+        const double megabytes = static_cast<double>(payload.size()) / 1e6;
+        const bool used = payload.size() >= RP_COMPRESSION_THRESHOLD && compressedSize < payload.size();
+        BM_INFO_LOG("\t{:16s} {:6d}B -> {:6d}B ratio {:5.2f} | enc {:8.1f}MB/s dec {:8.1f}MB/s | {:s}",
+            name, payload.size(), compressedSize, static_cast<double>(payload.size()) / static_cast<double>(compressedSize),
+            megabytes / (encodeNs / 1e9), megabytes / (decodeNs / 1e9), used ? "compressed" : "send as is");
+    }
+}, "Measures the RPMessage payload compression, usage: rp_bench_compression [iterations]", PERMISSION_ALL); }
+
+
+// The benchmark server waits a round trip every window, like a single TCP stream limited by its window.
+constexpr size_t BENCH_MAP_WINDOW_SIZE = 64 * 1024;
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_bench_map_download", [](const std::vector<std::string>& arguments) {
+    const size_t fileSize = (arguments.size() > 1 && IsInt(arguments[1]) ? std::stoull(arguments[1]) : 32) * 1024 * 1024;
+    const auto latency = std::chrono::milliseconds(arguments.size() > 2 && IsInt(arguments[2]) ? std::stoll(arguments[2]) : 20);
+
+    const std::filesystem::path benchPath = std::filesystem::temp_directory_path() / "rp_bench_map";
+    const std::filesystem::path sourcePath = benchPath / "source.upk";
+    const std::filesystem::path targetPath = benchPath / "target.upk";
+    std::filesystem::create_directories(benchPath);
+    {
+        std::ofstream source(sourcePath, std::ios::binary | std::ios::trunc);
+        std::mt19937 random(0);
+        std::vector<uint32_t> block(BENCH_MAP_WINDOW_SIZE / sizeof(uint32_t));
+        for (size_t written = 0; written < fileSize; written += BENCH_MAP_WINDOW_SIZE) {
+            std::ranges::generate(block, std::ref(random));
+            source.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(std::min(BENCH_MAP_WINDOW_SIZE, fileSize - written)));
+        }
+    }
+
+    {
+        const std::shared_ptr<MappedFile> mappedFile = std::make_shared<MappedFile>(sourcePath);
+        httplib::Server svr;
+        svr.Get("/map", [mappedFile, latency](const httplib::Request&, httplib::Response& res) {
+            res.set_header("Accept-Ranges", "bytes");
+            res.set_content_provider(mappedFile->GetSize(), "application/octet-stream",
+                [mappedFile, latency](const size_t offset, const size_t length, httplib::DataSink& sink) {
+                    std::this_thread::sleep_for(latency);
+                    const std::string_view chunk = mappedFile->GetData(offset, std::min(length, BENCH_MAP_WINDOW_SIZE));
+                    sink.write(chunk.data(), chunk.size());
+                    return !chunk.empty();
+                });
+        });
+        const int port = svr.bind_to_any_port("127.0.0.1");
+        std::thread serverThread = save_thread("BenchMapServer", [&svr]() { svr.listen_after_bind(); });
+
+        MatchFileServer::ServerStatus::MapStatus map;
+        map.MapName = "rp_bench_map";
+        map.FileSize = fileSize;
+        BM_INFO_LOG("map download, {:d}MB with {:d}ms per {:d}KB window", fileSize / 1024 / 1024, latency.count(), BENCH_MAP_WINDOW_SIZE / 1024);
+        for (const size_t connections : std::initializer_list<size_t>{ 1, 2, 4, 8 }) {
+            std::error_code ec;
+            std::filesystem::remove(targetPath, ec);
+            float downloadStatus = 0;
+            const auto start = std::chrono::steady_clock::now();
+            const bool downloaded = MatchFileServer::DownloadMapFile("127.0.0.1", port, targetPath, map, connections, &downloadStatus);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            const MappedFile target(targetPath);
+            const bool matches = downloaded && target.IsOpen() && target.GetData() == mappedFile->GetData();
+            BM_INFO_LOG("\tup to {:d} connections: {:s} in {:.2f}s, {:.2f}MB/s, progress {:.0f}%", connections,
+                matches ? "downloaded" : "FAILED", seconds, static_cast<double>(fileSize) / 1024 / 1024 / seconds, downloadStatus * 100);
+        }
+
+        svr.stop();
+        serverThread.join();
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(benchPath, ec);
+}, "Measures map downloads over multiple connections from a local server with injected latency, usage: rp_bench_map_download [size MB] [latency ms]", PERMISSION_ALL); }
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_bench_map_peers", [](const std::vector<std::string>& arguments) {
+    const size_t peerCount = arguments.size() > 1 && IsInt(arguments[1]) ? std::stoull(arguments[1]) : 3;
+    const size_t fileSize = (arguments.size() > 2 && IsInt(arguments[2]) ? std::stoull(arguments[2]) : 32) * 1024 * 1024;
+    const int port = arguments.size() > 3 && IsInt(arguments[3]) ? std::stoi(arguments[3]) : DEFAULT_PORT + 100;
+
+    const std::filesystem::path benchPath = std::filesystem::temp_directory_path() / "rp_bench_map_peers";
+    const std::filesystem::path sourcePath = benchPath / "source.upk";
+    const std::filesystem::path targetPath = benchPath / "target.upk";
+    std::filesystem::create_directories(benchPath);
+    {
+        std::ofstream source(sourcePath, std::ios::binary | std::ios::trunc);
+        std::mt19937 random(0);
+        std::vector<uint32_t> block(BENCH_MAP_WINDOW_SIZE / sizeof(uint32_t));
+        for (size_t written = 0; written < fileSize; written += BENCH_MAP_WINDOW_SIZE) {
+            std::ranges::generate(block, std::ref(random));
+            source.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(std::min(BENCH_MAP_WINDOW_SIZE, fileSize - written)));
+        }
+    }
+
+    {
+        MatchFileServer::ServerStatus::MapStatus sourceMap;
+        sourceMap.MapName = "rp_bench_map";
+        sourceMap.Hash = Sha256::HashFile(sourcePath);
+
+        // The host and every peer serve the same file, each peer registers at the host.
+        const MatchFileServer host("127.0.0.1", port, sourceMap, sourcePath);
+        std::vector<std::unique_ptr<MatchFileServer>> peers;
+        for (size_t i = 1; i <= peerCount; i++) {
+            peers.push_back(std::make_unique<MatchFileServer>("127.0.0.1", port + static_cast<int>(i), sourceMap, sourcePath,
+                "127.0.0.1", port));
+        }
+
+        MatchFileServer::ServerStatus serverStatus;
+        for (size_t attempt = 0; attempt < 50 && serverStatus.CurrentMap.Peers.size() < peerCount; attempt++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            serverStatus = MatchFileServer::GetServerStatus("127.0.0.1", port).get();
+        }
+        BM_INFO_LOG("map download, {:d}MB from a host with {:d}/{:d} registered peers", fileSize / 1024 / 1024,
+            serverStatus.CurrentMap.Peers.size(), peerCount);
+
+        std::error_code ec;
+        std::filesystem::remove(targetPath, ec);
+        float downloadStatus = 0;
+        const auto start = std::chrono::steady_clock::now();
+        const bool downloaded = serverStatus.Online && MatchFileServer::DownloadMapFile("127.0.0.1", port, targetPath,
+            serverStatus.CurrentMap, MAP_DOWNLOAD_CONNECTIONS, &downloadStatus);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const bool matches = downloaded && Sha256::HashFile(targetPath) == sourceMap.Hash;
+        BM_INFO_LOG("\t{:d} chunks: {:s} in {:.2f}s, {:.2f}MB/s, progress {:.0f}%", serverStatus.CurrentMap.ChunkHashes.size(),
+            matches ? "downloaded" : "FAILED", seconds, static_cast<double>(fileSize) / 1024 / 1024 / seconds, downloadStatus * 100);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(benchPath, ec);
+}, "Measures map downloads from a local server and its registered peers, usage: rp_bench_map_peers [peers] [size MB] [port]", PERMISSION_ALL); }
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_bench_ping_host", [](const std::vector<std::string>& arguments) {
+    const size_t iterations = get_iterations(arguments, 1000);
+
+    // Local host that answers every datagram, like a game server would.
+    SocketAddress hostAddress;
+    if (NetworkContext::Get().Resolve("127.0.0.1", 0, SOCK_DGRAM, IPPROTO_UDP, hostAddress)) {
+        BM_ERROR_LOG("Could not resolve the local host");
+        return;
+    }
+    Socket hostSocket;
+    if (hostSocket.Open(hostAddress.Family, SOCK_DGRAM, IPPROTO_UDP) || hostSocket.Bind(hostAddress) ||
+        hostSocket.GetLocalAddress(hostAddress)) {
+        BM_ERROR_LOG("Could not start the local host");
+        return;
+    }
+    std::atomic<bool> stopHost = false;
+    std::thread hostThread = save_thread("BenchPingHost", [&hostSocket, &stopHost]() {
+        char buffer[512];
+        while (!stopHost) {
+            size_t received = 0;
+            SocketAddress from;
+            if (!hostSocket.WaitReadable(std::chrono::milliseconds(50)) && !hostSocket.Receive(buffer, sizeof buffer, &received, &from)) {
+                hostSocket.SendTo(std::string_view(buffer, received), from);
+            }
+        }
+    });
+    const unsigned short port = hostAddress.GetPort();
+
+    size_t online = 0;
+    const double pooledNs = bench_ns(iterations, [&]() {
+        online += Networking::PingHost("localhost", port).get();
+    });
+    // What every probe used to pay, a lookup and a new socket.
+    const double setupNs = bench_ns(iterations, [&]() {
+        NetworkContext::Get().ClearDnsCache();
+        SocketAddress address;
+        Socket socket;
+        if (!NetworkContext::Get().Resolve("localhost", port, SOCK_DGRAM, IPPROTO_UDP, address) &&
+            !socket.Open(address.Family, SOCK_DGRAM, IPPROTO_UDP) && !socket.SendTo("ping", address)) {
+            socket.WaitReadable(std::chrono::seconds(3));
+        }
+    });
+
+    stopHost = true;
+    hostThread.join();
+
+    BM_INFO_LOG("ping host, {:d} probes to {:s}", iterations, hostAddress.ToString());
+    BM_INFO_LOG("\tcached lookup and pooled socket: {:8.1f}us per probe, {:d} online", pooledNs / 1e3, online);
+    BM_INFO_LOG("\tlookup and socket per probe:     {:8.1f}us per probe", setupNs / 1e3);
+}, "Measures pinging a local host with and without reusing lookups and sockets, usage: rp_bench_ping_host [iterations]", PERMISSION_ALL); }
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_bench_probe_hosts", [](const std::vector<std::string>& arguments) {
+    const size_t hostCount = get_iterations(arguments, 32);
+
+    // Local hosts that answer every datagram, every other one stays silent like an offline server.
+    std::vector<Socket> hostSockets(hostCount);
+    std::vector<std::pair<std::string, unsigned short>> hosts;
+    for (size_t i = 0; i < hostCount; i++) {
+        SocketAddress hostAddress;
+        if (NetworkContext::Get().Resolve("127.0.0.1", 0, SOCK_DGRAM, IPPROTO_UDP, hostAddress) ||
+            hostSockets[i].Open(hostAddress.Family, SOCK_DGRAM, IPPROTO_UDP) || hostSockets[i].Bind(hostAddress) ||
+            hostSockets[i].GetLocalAddress(hostAddress)) {
+            BM_ERROR_LOG("Could not start local host {:d}", i);
+            return;
+        }
+        hosts.emplace_back("127.0.0.1", hostAddress.GetPort());
+    }
+    std::atomic<bool> stopHosts = false;
+    std::thread hostThread = save_thread("BenchProbeHosts", [&hostSockets, &stopHosts]() {
+        std::vector<Socket*> socketPtrs;
+        for (Socket& socket : hostSockets) {
+            socketPtrs.push_back(&socket);
+        }
+        char buffer[512];
+        while (!stopHosts) {
+            size_t readable = 0;
+            size_t received = 0;
+            SocketAddress from;
+            if (!Socket::WaitAnyReadable(socketPtrs, std::chrono::milliseconds(50), readable) &&
+                !hostSockets[readable].Receive(buffer, sizeof buffer, &received, &from) && readable % 2 == 0) {
+                hostSockets[readable].SendTo(std::string_view(buffer, received), from);
+            }
+        }
+    });
+
+    const auto probeStart = std::chrono::steady_clock::now();
+    const std::vector<Networking::HostProbeResult> results = Networking::ProbeHosts(hosts).get();
+    const auto probeTime = std::chrono::steady_clock::now() - probeStart;
+
+    const auto pingStart = std::chrono::steady_clock::now();
+    std::vector<std::future<bool>> pings;
+    for (const auto& [host, port] : hosts) {
+        pings.push_back(Networking::PingHost(host, port, nullptr, true));
+    }
+    size_t pingOnline = 0;
+    for (std::future<bool>& ping : pings) {
+        pingOnline += ping.get();
+    }
+    const auto pingTime = std::chrono::steady_clock::now() - pingStart;
+
+    stopHosts = true;
+    hostThread.join();
+
+    const size_t probeOnline = static_cast<size_t>(std::ranges::count_if(results, [](const Networking::HostProbeResult& result) {
+        return result.Status == Networking::HostStatus::HOST_ONLINE;
+    }));
+    BM_INFO_LOG("probe hosts, {:d} hosts of which half answer", hostCount);
+    BM_INFO_LOG("\tsingle threaded prober: {:8.1f}ms, {:d} online, fastest {:d}us, slowest {:d}us", std::chrono::duration<double, std::milli>(probeTime).count(),
+        probeOnline, results.empty() ? 0 : results.front().RTT.count(), probeOnline == 0 ? 0 : results[probeOnline - 1].RTT.count());
+    BM_INFO_LOG("\tthread per host ping:   {:8.1f}ms, {:d} online", std::chrono::duration<double, std::milli>(pingTime).count(), pingOnline);
+}, "Measures probing many local hosts at once against a ping per host, usage: rp_bench_probe_hosts [hosts]", PERMISSION_ALL); }
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_bench_lan_discovery", [](const std::vector<std::string>& arguments) {
+    const size_t responderCount = get_iterations(arguments, 8);
+    unsigned short discoveryPort = LAN_DISCOVERY_PORT + 100;
+    if (arguments.size() > 2 && IsInt(arguments[2])) {
+        discoveryPort = static_cast<unsigned short>(std::strtol(arguments[2].c_str(), nullptr, 10));
+    }
+
+    BM_INFO_LOG("lan discovery, {:d} responders on loopback port {:d}", responderCount, discoveryPort);
+    size_t failed = 0;
+    const auto check = [&failed](const bool passed, const std::string& description) {
+        BM_INFO_LOG("\t{:s} {:s}", passed ? "PASS" : "FAIL", description);
+        failed += passed ? 0 : 1;
+        return passed;
+    };
+    const auto report = [&failed]() {
+        if (failed > 0) {
+            BM_ERROR_LOG("lan discovery: {:d} checks failed", failed);
+        }
+        else {
+            BM_INFO_LOG("lan discovery: all checks passed");
+        }
+    };
+
+    // Only the local network gets answers, anything else could be a spoofed source.
+    for (const auto& [address, local] : std::initializer_list<std::pair<const char*, bool>>{
+             { "127.0.0.1", true }, { "192.168.1.20", true }, { "10.0.0.5", true }, { "172.31.255.1", true },
+             { "169.254.3.4", true }, { "::1", true }, { "fe80::1", true }, { "fd12::1", true },
+             { "8.8.8.8", false }, { "100.64.0.1", false }, { "172.32.0.1", false }, { "2001:db8::1", false } }) {
+        SocketAddress socketAddress;
+        const std::error_code error = NetworkContext::Get().Resolve(address, discoveryPort, SOCK_DGRAM, IPPROTO_UDP, socketAddress);
+        check(!error && LanBeaconResponder::IsLocalAddress(socketAddress) == local,
+            fmt::format("{:s} is {:s}", address, local ? "answered" : "ignored"));
+    }
+
+    // Responders on loopback that share the discovery port, like several hosts on one machine.
+    std::vector<std::unique_ptr<LanBeaconResponder>> responders;
+    for (size_t i = 0; i < responderCount; i++) {
+        responders.push_back(std::make_unique<LanBeaconResponder>(discoveryPort));
+        if (!check(responders.back()->IsListening(), fmt::format("responder {:d} listens", i))) {
+            report();
+            return;
+        }
+        responders.back()->SetBeacon(LanBeacon{ PLUGIN_VERSION, fmt::format("Map{:d}", i), static_cast<uint8_t>(i % 8), 8,
+            i % 2 == 1, static_cast<unsigned short>(DEFAULT_PORT + i) });
+    }
+
+    const auto updateUntil = [](LanDiscovery& discovery, const std::function<bool()>& done) {
+        const auto deadline = std::chrono::steady_clock::now() + LAN_HOST_TIMEOUT * 2;
+        while (!done() && std::chrono::steady_clock::now() < deadline) {
+            discovery.Update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return done();
+    };
+
+    LanDiscovery discovery("127.255.255.255", discoveryPort);
+    const auto start = std::chrono::steady_clock::now();
+    const bool foundAll = updateUntil(discovery, [&]() { return discovery.GetHosts().size() >= responderCount; });
+    const auto found = std::chrono::steady_clock::now() - start;
+    if (!check(foundAll, fmt::format("found {:d}/{:d} hosts in {:.1f}ms", discovery.GetHosts().size(), responderCount,
+        std::chrono::duration<double, std::milli>(found).count()))) {
+        report();
+        return;
+    }
+
+    // Answers to repeated queries update the listed hosts instead of adding them again.
+    discovery.Refresh();
+    responders.front()->SetBeacon(LanBeacon{ PLUGIN_VERSION, "Map0", 7, 8, false, DEFAULT_PORT });
+    const bool updated = updateUntil(discovery, [&]() {
+        return std::ranges::any_of(discovery.GetHosts(), [](const LanDiscovery::LanHost& host) {
+            return host.Beacon.Port == DEFAULT_PORT && host.Beacon.Players == 7;
+        });
+    });
+    check(updated, "updated beacon seen");
+    check(discovery.GetHosts().size() == responderCount, "hosts listed once");
+
+    // Hosts that stop answering drop from the list.
+    responders.back()->SetBeacon(std::nullopt);
+    const auto expiryStart = std::chrono::steady_clock::now();
+    const bool expired = updateUntil(discovery, [&]() { return discovery.GetHosts().size() == responderCount - 1; });
+    check(expired, fmt::format("silent host removed after {:.1f}s",
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - expiryStart).count()));
+    report();
+}, "Checks local network discovery against responders on loopback, usage: rp_bench_lan_discovery [responders] [port]", PERMISSION_ALL); }
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_bench_host_quality", [](const std::vector<std::string>& arguments) {
+    const auto duration = std::chrono::seconds(arguments.size() > 1 && IsInt(arguments[1]) ? std::stoll(arguments[1]) : 5);
+    unsigned short responderPort = LAN_DISCOVERY_PORT + 101;
+    if (arguments.size() > 2 && IsInt(arguments[2])) {
+        responderPort = static_cast<unsigned short>(std::strtol(arguments[2].c_str(), nullptr, 10));
+    }
+
+    // An answering host on loopback and a port nobody answers on, which should show full loss.
+    const LanBeaconResponder responder(responderPort);
+    if (!responder.IsListening()) {
+        BM_ERROR_LOG("Could not start the responder");
+        return;
+    }
+    const unsigned short silentPort = responderPort + 1;
+    HostQualitySampler sampler;
+    sampler.SetHosts({ { "127.0.0.1", responderPort }, { "127.0.0.1", silentPort } });
+
+    size_t updates = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration) {
+        sampler.Update();
+        updates++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    BM_INFO_LOG("host quality, sampled for {:d}s in {:d} updates", duration.count(), updates);
+    for (const unsigned short port : { responderPort, silentPort }) {
+        const std::optional<HostQuality> quality = sampler.GetQuality("127.0.0.1", port);
+        if (!quality) {
+            BM_INFO_LOG("\tport {:d}: no samples", port);
+            continue;
+        }
+        BM_INFO_LOG("\tport {:d}: {:d}us rtt, {:d}us jitter, {:.0f}% loss over {:d} samples", port, quality->RTT.count(),
+            quality->Jitter.count(), quality->Loss * 100, quality->Samples);
+    }
+}, "Samples the connection quality to a local responder, usage: rp_bench_host_quality [seconds] [port]", PERMISSION_ALL); }
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_bench_address_validation", [](const std::vector<std::string>& arguments) {
+    const size_t iterations = get_iterations(arguments, 100000);
+
+    // The regexes address validation used before the parser, to compare against.
+    static const std::regex ipv4Regex(
+        "^(([0-9]|[1-9][0-9]|1[0-9]{2}|2[0-4][0-9]|25[0-5])\\.){3}([0-9]|[1-9][0-9]|1[0-9]{2}|2[0-4][0-9]|25[0-5])$");
+    static const std::regex domainNameRegex(
+        "^(?:[a-z0-9](?:[a-z0-9-]{0,61}[a-z0-9])?\\.)+[a-z0-9][a-z0-9-]{0,61}[a-z0-9]$");
+    const std::vector<std::string> addresses = {
+        "192.168.1.20", "172.31.255.255", "25.12.3.4", "81.2.69.160", "100.64.1.1", "127.0.0.1", "256.1.1.1",
+        "01.2.3.4", "1.2.3", "1.2.3.4.", "rocket.example.com", "a.b", "-bad.example.com", "Example.com", ""
+    };
+
+    size_t mismatches = 0;
+    for (const std::string& address : addresses) {
+        if (std::regex_match(address, ipv4Regex) != Networking::IsValidIPv4(address) ||
+            std::regex_match(address, domainNameRegex) != Networking::IsValidDomainName(address)) {
+            BM_ERROR_LOG("{:s} is validated differently than by the regex", quote(address));
+            mismatches++;
+        }
+    }
+
+    size_t valid = 0;
+    const double regexNs = bench_ns(iterations, [&]() {
+        for (const std::string& address : addresses) {
+            valid += std::regex_match(address, ipv4Regex) || std::regex_match(address, domainNameRegex);
+        }
+    });
+    const double parserNs = bench_ns(iterations, [&]() {
+        for (const std::string& address : addresses) {
+            valid += Networking::GetDestAddrType(address) != Networking::DestAddrType::UNKNOWN_ADDR;
+        }
+    });
+
+    const double perAddress = static_cast<double>(addresses.size());
+    BM_INFO_LOG("address validation, {:d} iterations over {:d} addresses, {:d} mismatches", iterations, addresses.size(), mismatches);
+    BM_INFO_LOG("\tregex:                    {:8.1f}ns per address", regexNs / perAddress);
+    BM_INFO_LOG("\tparser and range table:   {:8.1f}ns per address, {:d} valid", parserNs / perAddress, valid);
+}, "Measures validating addresses with the parser against the old regexes, usage: rp_bench_address_validation [iterations]", PERMISSION_ALL); }
@@ -1,6 +1,7 @@
 #include "RocketPlugin.h"
 
 #include "ExternalModules.h"
+#include "Networking/RPLoopbackTransport.h"
 
 
 /*
@@ -35,3 +36,183 @@ RP_EXTERNAL_DEBUG_NOTIFIER("rp_crash", [](const std::vector<std::string>&) {
 RP_EXTERNAL_DEBUG_NOTIFIER("rp_throw", [](const std::vector<std::string>&) {
     throw std::runtime_error("NotifierInterrupt");
 }, "Throws exception", PERMISSION_ALL); }
+
+
+#ifdef DEBUG
+namespace LoopbackTest
+{
+    /// <summary>Checks that the messages of every sender arrive complete and in order.</summary>
+    /// <remarks>Registers under the reserved test NetId, so it does not need a NetId from the networked modules list.</remarks>
+    class OrderedReceiver final : public NetworkedModule
+    {
+    public:
+        explicit OrderedReceiver(RPNetCode& netCode, const NetId netId = RP_TEST_NET_ID) : NetworkedModule(netId, netCode) {}
+
+        /// <summary>Sends the next message to the given player, the payload is our player id and a counter.</summary>
+        /// <param name="playerId">Player id of the player to send the message to</param>
+        /// <param name="counter">Counter of the message</param>
+        void Send(const int playerId, const uint32_t counter) const
+        {
+            std::string message(8, '\0');
+            write_le(message.data(), netCode.GetLocalPlayerId());
+            write_le(message.data() + 4, counter);
+            SendMessageToPlayer(playerId, message, RPChannel::RELIABLE_ORDERED);
+        }
+
+        /// <summary>Counts the message and checks if it arrived in order.</summary>
+        /// <param name="message">Received message</param>
+        void Receive(PriWrapper, const std::string_view message) override
+        {
+            if (message.size() != 8) {
+                ++OutOfOrder;
+                return;
+            }
+            const int sender = read_le<int>(message.data());
+            const uint32_t counter = read_le<uint32_t>(message.data() + 4);
+            uint32_t& nextCounter = nextCounters[sender];
+            if (counter != nextCounter) {
+                ++OutOfOrder;
+            }
+            nextCounter = counter + 1;
+            ++Received;
+        }
+
+        size_t Received = 0;
+        size_t OutOfOrder = 0;
+
+    private:
+        std::unordered_map<int, uint32_t> nextCounters;
+    };
+
+
+    /// <summary>Gets the numeric argument at the given index.</summary>
+    /// <param name="arguments">Notifier arguments</param>
+    /// <param name="index">Index of the argument</param>
+    /// <param name="defaultValue">Value to use when the argument is missing</param>
+    /// <returns>The argument or the default value</returns>
+    double get_argument(const std::vector<std::string>& arguments, const size_t index, const double defaultValue)
+    {
+        if (arguments.size() > index && IsFloat(arguments[index])) {
+            return std::strtod(arguments[index].c_str(), nullptr);
+        }
+
+        return defaultValue;
+    }
+
+
+    /// <summary>Sends the given amount of messages from every player to every other player and waits for them to arrive.</summary>
+    /// <remarks>Every receiver expects counters from zero, so each sender has to start over with every call.</remarks>
+    /// <param name="network">Network to send the messages over</param>
+    /// <param name="modules">Receivers of the simulated players</param>
+    /// <param name="messages">Messages to send per pair</param>
+    /// <param name="timeout">Maximum simulated time to wait</param>
+    /// <returns>Amount of messages received</returns>
+    size_t exchange(RPLoopbackNetwork& network, const std::vector<std::unique_ptr<OrderedReceiver>>& modules,
+        const size_t messages, const std::chrono::microseconds timeout)
+    {
+        constexpr std::chrono::milliseconds tickRate = std::chrono::milliseconds(8);
+        // Messages send to every other player per tick, stays below the reliable window size.
+        constexpr size_t messagesPerTick = 4;
+
+        const size_t players = network.GetPlayerCount();
+        size_t receivedBefore = 0;
+        for (const std::unique_ptr<OrderedReceiver>& module : modules) {
+            receivedBefore += module->Received;
+        }
+        const size_t expected = players * (players - 1) * messages;
+        const auto simulationStart = network.Now();
+        size_t send = 0;
+        size_t received = 0;
+        while (received < expected && network.Now() - simulationStart < timeout) {
+            if (send < messages) {
+                const size_t sendUntil = std::min(messages, send + messagesPerTick);
+                for (size_t sender = 0; sender < players; sender++) {
+                    for (size_t receiver = 0; receiver < players; receiver++) {
+                        if (sender == receiver) {
+                            continue;
+                        }
+                        for (size_t counter = send; counter < sendUntil; counter++) {
+                            modules[sender]->Send(network.GetPlayerId(receiver), static_cast<uint32_t>(counter));
+                        }
+                    }
+                }
+                send = sendUntil;
+            }
+            network.Tick(tickRate);
+            received = 0;
+            for (const std::unique_ptr<OrderedReceiver>& module : modules) {
+                received += module->Received;
+            }
+            received -= receivedBefore;
+        }
+
+        return received;
+    }
+}
+
+
+RP_EXTERNAL_DEBUG_NOTIFIER("rp_test_netcode_loopback", [](const std::vector<std::string>& arguments) {
+    const size_t messages = static_cast<size_t>(LoopbackTest::get_argument(arguments, 1, 50));
+    RPLoopbackNetwork::Settings settings;
+    settings.Latency = std::chrono::microseconds(static_cast<int64_t>(LoopbackTest::get_argument(arguments, 2, 50) * 1000));
+    settings.Jitter = settings.Latency / 5;
+    settings.Loss = LoopbackTest::get_argument(arguments, 3, 5) / 100;
+    settings.Reorder = LoopbackTest::get_argument(arguments, 4, 10) / 100;
+    settings.Seed = static_cast<uint32_t>(LoopbackTest::get_argument(arguments, 5, 0));
+    constexpr std::chrono::seconds timeout = std::chrono::seconds(300);
+
+    BM_INFO_LOG("loopback netcode, {:d} messages per pair, {:d}ms latency, {:.1f}% loss, {:.1f}% reorder, seed {:d}",
+        messages, std::chrono::duration_cast<std::chrono::milliseconds>(settings.Latency).count(),
+        settings.Loss * 100, settings.Reorder * 100, settings.Seed);
+    for (const size_t players : std::initializer_list<size_t>{ 2, 4, 8, 16, 32, 64 }) {
+        RPLoopbackNetwork network(players, settings);
+        std::vector<std::unique_ptr<LoopbackTest::OrderedReceiver>> modules;
+        for (size_t i = 0; i < players; i++) {
+            modules.push_back(std::make_unique<LoopbackTest::OrderedReceiver>(network.GetNetCode(i)));
+        }
+
+        const size_t expected = players * (players - 1) * messages;
+        const auto start = std::chrono::steady_clock::now();
+        const auto simulationStart = network.Now();
+        const size_t received = LoopbackTest::exchange(network, modules, messages, timeout);
+        const auto duration = std::chrono::steady_clock::now() - start;
+        const double seconds = std::max(1e-9, std::chrono::duration<double>(duration).count());
+
+        size_t outOfOrder = 0;
+        for (const std::unique_ptr<LoopbackTest::OrderedReceiver>& module : modules) {
+            outOfOrder += module->OutOfOrder;
+        }
+        const bool passed = received == expected && outOfOrder == 0;
+        BM_INFO_LOG("\t{:s} {:2d} players: {:d}/{:d} received, {:d} out of order, {:d} forwarded, {:d}/{:d} packets lost, "
+            "{:.2f}s simulated, {:.1f}ms wall, {:.0f} msg/s",
+            passed ? "PASS" : "FAIL", players, received, expected, outOfOrder,
+            network.GetNetCode(0).GetMetrics().MessagesForwarded, network.MessagesLost, network.MessagesSend,
+            std::chrono::duration<double>(network.Now() - simulationStart).count(), seconds * 1000,
+            static_cast<double>(received) / seconds);
+    }
+
+    // Cut every connection until the senders give up on their messages, the channels have to recover afterwards.
+    constexpr size_t players = 4;
+    RPLoopbackNetwork network(players, settings);
+    std::vector<std::unique_ptr<LoopbackTest::OrderedReceiver>> modules;
+    for (size_t i = 0; i < players; i++) {
+        modules.push_back(std::make_unique<LoopbackTest::OrderedReceiver>(network.GetNetCode(i)));
+    }
+    RPLoopbackNetwork::Settings outage = settings;
+    outage.Loss = 1;
+    network.SetSettings(outage);
+    const size_t lostDuringOutage = LoopbackTest::exchange(network, modules, messages,
+        RP_RETRANSMIT_TIMEOUT * (RP_MAX_RETRANSMITS + 2));
+    network.SetSettings(settings);
+
+    const size_t expected = players * (players - 1) * messages;
+    const size_t received = LoopbackTest::exchange(network, modules, messages, timeout);
+    size_t outOfOrder = 0;
+    for (const std::unique_ptr<LoopbackTest::OrderedReceiver>& module : modules) {
+        outOfOrder += module->OutOfOrder;
+    }
+    const bool passed = lostDuringOutage == 0 && received == expected && outOfOrder == 0;
+    BM_INFO_LOG("\t{:s} {:2d} players after giving up: {:d}/{:d} received, {:d} out of order",
+        passed ? "PASS" : "FAIL", players, received, expected, outOfOrder);
+}, "Simulates a host with clients in process and checks reliable ordered delivery, usage: rp_test_netcode_loopback [messages] [latency ms] [loss %] [reorder %] [seed]", PERMISSION_ALL); }
+#endif
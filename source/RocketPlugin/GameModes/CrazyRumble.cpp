@@ -182,6 +182,7 @@ void CrazyRumble::Activate(const bool active)
     }
 
     isActive = active;
+    replicatedState.Enabled = active;
 }
 
 
@@ -204,12 +205,29 @@ std::string CrazyRumble::GetGameModeDescription()
 /// <summary>Gets called when it receives a networked message from the host.</summary>
 /// <param name="sender">Original sender of the message</param>
 /// <param name="message">Message contents</param>
-void CrazyRumble::Receive(PriWrapper sender, const std::string& message)
+void CrazyRumble::Receive(PriWrapper sender, std::string_view message)
 {
     __noop;
 }
 
 
+/// <summary>Gets the rumble settings that get replicated to the clients.</summary>
+/// <returns>The replicated rumble settings</returns>
+ReplicatedState* CrazyRumble::GetReplicatedState()
+{
+    return &replicatedState;
+}
+
+
+/// <summary>Gets called when it receives new rumble settings from the host.</summary>
+/// <param name="sender">Host that send the settings</param>
+void CrazyRumble::OnReplicated(PriWrapper sender)
+{
+    networked = true;
+    updateRumbleOptions();
+}
+
+
 /// <summary>Resets the rumble items values</summary>
 void CrazyRumble::ResetItemsValues()
 {
@@ -267,7 +285,6 @@ void CrazyRumble::updateRumbleOptions(CarWrapper car) const
     for (const std::shared_ptr<RumbleWrapper>& rumbleItem : rumbleItems) {
         if (rumbleItem->InternalName == rumbleItemName) {
             rumbleItem->Update(attachedPickup.memory_address);
-            // TODO, replicate rumble settings.
             return;
         }
     }
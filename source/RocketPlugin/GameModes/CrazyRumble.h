@@ -5,11 +5,13 @@
 #include "RumbleItems/RumbleItems.h"
 #include "RumbleItems/RumbleConstants.inc"
 
+#include "Networking/ReplicatedState.h"
+
 
 class CrazyRumble final : public RocketGameMode, public NetworkedModule
 {
 public:
-    CrazyRumble()
+    CrazyRumble() : NetworkedModule(net_id_of<CrazyRumble>())
     {
         typeIdx = std::make_unique<std::type_index>(typeid(*this));
 
@@ -39,6 +41,14 @@ public:
         rumbleItems.push_back(haunted);
         rugby = std::make_unique<RugbyWrapper>(&RumbleConstants::rugby);
         rumbleItems.push_back(rugby);
+
+        replicatedState.AddField(&forceMultiplier);
+        replicatedState.AddField(&rangeMultiplier);
+        replicatedState.AddField(&durationMultiplier);
+        replicatedState.AddField(&maxTimeTillItem);
+        for (const std::shared_ptr<RumbleWrapper>& rumbleItem : rumbleItems) {
+            rumbleItem->Replicate(replicatedState);
+        }
     }
 
     void RenderOptions() override;
@@ -47,7 +57,9 @@ public:
     std::string GetGameModeName() override;
     std::string GetGameModeDescription() override;
 
-    void Receive(PriWrapper sender, const std::string& message) override;
+    void Receive(PriWrapper sender, std::string_view message) override;
+    ReplicatedState* GetReplicatedState() override;
+    void OnReplicated(PriWrapper sender) override;
 
     void ResetItemsValues();
     void UpdateItemsValues(float newForceMultiplier, float newRangeMultiplier, float newDurationMultiplier);
@@ -81,5 +93,6 @@ private:
 
     bool refreshRumbleConstants = true;
     std::vector<std::shared_ptr<RumbleWrapper>> rumbleItems;
+    ReplicatedState replicatedState;
     std::future<std::pair<bool, std::string>> rumbleConstantsRequest;
 };
@@ -21,7 +21,7 @@ void GhostCars::RenderOptions()
 
     if (update) {
         Execute([this](GameWrapper*) {
-            serverUpdateRBCollidesWithChannels("Update");
+            serverUpdateRBCollidesWithChannels("Update", UPDATE_COALESCE_KEY);
             updateRBCollidesWithChannels();
         });
     }
@@ -83,12 +83,12 @@ std::string GhostCars::GetGameModeDescription()
 /// <summary>Gets called when it receives a networked message from the host.</summary>
 /// <param name="sender">Original sender of the message</param>
 /// <param name="message">Message contents</param>
-void GhostCars::Receive(PriWrapper sender, const std::string& message)
+void GhostCars::Receive(PriWrapper sender, const std::string_view message)
 {
     BMCHECK(sender);
-    BM_TRACE_LOG("{:s} send: {:s}", quote(sender.GetPlayerName().ToString()), quote(message));
+    BM_TRACE_LOG("{:s} send: \"{:s}\"", quote(sender.GetPlayerName().ToString()), message);
 
-    std::string params;
+    std::string_view params;
     if (message.starts_with("Activate true ")) {
         networked = true;
         params = message.substr(14);
@@ -129,10 +129,13 @@ void GhostCars::Receive(PriWrapper sender, const std::string& message)
 
 
 /// <summary>Broadcast messages to the clients.</summary>
+/// <remarks>Collision toggles have to arrive, so they are send over the reliable ordered channel.</remarks>
 /// <param name="prefix">Prefix of the message</param>
-void GhostCars::serverUpdateRBCollidesWithChannels(const std::string& prefix) const
+/// <param name="coalesceKey">Optional key to drop superseded messages with</param>
+void GhostCars::serverUpdateRBCollidesWithChannels(const std::string& prefix, const uint16_t coalesceKey) const
 {
     if (Outer()->IsHostingLocalGame()) {
-        BroadcastMessage(fmt::format("{:s} {} {}", prefix, enableBallCollision, enableVehicleCollision));
+        BroadcastMessage(fmt::format("{:s} {} {}", prefix, enableBallCollision, enableVehicleCollision),
+            RPChannel::RELIABLE_ORDERED, coalesceKey);
     }
 }
@@ -7,7 +7,7 @@
 class GhostCars final : public RocketGameMode, public NetworkedModule
 {
 public:
-    GhostCars() { typeIdx = std::make_unique<std::type_index>(typeid(*this)); }
+    GhostCars() : NetworkedModule(net_id_of<GhostCars>()) { typeIdx = std::make_unique<std::type_index>(typeid(*this)); }
 
     void RenderOptions() override;
     bool IsActive() override;
@@ -15,16 +15,19 @@ public:
     std::string GetGameModeName() override;
     std::string GetGameModeDescription() override;
 
-    void Receive(PriWrapper sender, const std::string& message) override;
+    void Receive(PriWrapper sender, std::string_view message) override;
 
 private:
     void setRBCollidesWithChannel(const ObjectWrapper&) const;
     void updateRBCollidesWithChannels() const;
     void resetRBCollidesWithChannels() const;
 
-    void serverUpdateRBCollidesWithChannels(const std::string& prefix) const;
+    void serverUpdateRBCollidesWithChannels(const std::string& prefix, uint16_t coalesceKey = RP_NO_COALESCE_KEY) const;
     void clientUpdateRBCollidesWithChannels() const;
 
+    // Only the latest collision update per tick needs to be send.
+    static constexpr uint16_t UPDATE_COALESCE_KEY = 1;
+
     bool enableBallCollision = false;
     bool enableVehicleCollision = false;
 };
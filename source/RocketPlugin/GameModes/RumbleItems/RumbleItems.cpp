@@ -6,6 +6,8 @@
 
 #include "RumbleItems.h"
 
+#include "Networking/ReplicatedState.h"
+
 
 bool RumbleWrapper::Render()
 {
@@ -37,6 +39,13 @@ void RumbleWrapper::Multiply(const float, const float, const float durationMulti
 }
 
 
+void RumbleWrapper::Replicate(ReplicatedState& state)
+{
+    state.AddField(&Enabled);
+    state.AddField(&ActivationDuration);
+}
+
+
 bool TargetedWrapper::Render()
 {
     bool update = Super::Render();
@@ -79,6 +88,17 @@ void TargetedWrapper::Multiply(const float forceMultiplier, const float rangeMul
 }
 
 
+void TargetedWrapper::Replicate(ReplicatedState& state)
+{
+    Super::Replicate(state);
+    state.AddField(&CanTargetBall);
+    state.AddField(&CanTargetCars);
+    state.AddField(&CanTargetEnemyCars);
+    state.AddField(&CanTargetTeamCars);
+    state.AddField(&Range);
+}
+
+
 bool SpringWrapper::Render()
 {
     bool update = Super::Render();
@@ -137,6 +157,21 @@ void SpringWrapper::Multiply(const float forceMultiplier, const float rangeMulti
 }
 
 
+void SpringWrapper::Replicate(ReplicatedState& state)
+{
+    Super::Replicate(state);
+    state.AddField(&Force);
+    state.AddField(&VerticalForce);
+    state.AddField(&Torque);
+    state.AddField(&RelativeForceNormalDirection);
+    state.AddField(&MaxSpringLength);
+    state.AddField(&ConstantForce);
+    state.AddField(&MinSpringLength);
+    state.AddField(&WeldedForceScalar);
+    state.AddField(&WeldedVerticalForce);
+}
+
+
 bool BallCarSpringWrapper::Render()
 {
     return Super::Render();
@@ -230,6 +265,15 @@ void BallFreezeWrapper::Multiply(const float forceMultiplier, const float rangeM
 }
 
 
+void BallFreezeWrapper::Replicate(ReplicatedState& state)
+{
+    Super::Replicate(state);
+    state.AddField(&MaintainMomentum);
+    state.AddField(&TimeToStop);
+    state.AddField(&StopMomentumPercentage);
+}
+
+
 bool GrapplingHookWrapper::Render()
 {
     bool update = Super::Render();
@@ -273,6 +317,16 @@ void GrapplingHookWrapper::Multiply(const float forceMultiplier, const float ran
 }
 
 
+void GrapplingHookWrapper::Replicate(ReplicatedState& state)
+{
+    Super::Replicate(state);
+    state.AddField(&Impulse);
+    state.AddField(&Force);
+    state.AddField(&MaxRopeLength);
+    state.AddField(&PredictionSpeed);
+}
+
+
 bool GravityWrapper::Render()
 {
     bool update = Super::Render();
@@ -312,6 +366,15 @@ void GravityWrapper::Multiply(const float forceMultiplier, const float rangeMult
 }
 
 
+void GravityWrapper::Replicate(ReplicatedState& state)
+{
+    Super::Replicate(state);
+    state.AddField(&BallGravity);
+    state.AddField(&Range);
+    state.AddField(&DeactivateOnTouch);
+}
+
+
 bool BallLassoWrapper::Render()
 {
     return Super::Render();
@@ -373,6 +436,13 @@ void BattarangWrapper::Multiply(const float forceMultiplier, const float rangeMu
 }
 
 
+void BattarangWrapper::Replicate(ReplicatedState& state)
+{
+    Super::Replicate(state);
+    state.AddField(&SpinSpeed);
+}
+
+
 bool HitForceWrapper::Render()
 {
     bool update = Super::Render();
@@ -416,6 +486,17 @@ void HitForceWrapper::Multiply(const float forceMultiplier, const float rangeMul
 }
 
 
+void HitForceWrapper::Replicate(ReplicatedState& state)
+{
+    Super::Replicate(state);
+    state.AddField(&BallForce);
+    state.AddField(&CarForce);
+    state.AddField(&DemolishCars);
+    state.AddField(&BallHitForce);
+    state.AddField(&CarHitForce);
+}
+
+
 bool VelcroWrapper::Render()
 {
     bool update = Super::Render();
@@ -465,6 +546,18 @@ void VelcroWrapper::Multiply(const float forceMultiplier, const float rangeMulti
 }
 
 
+void VelcroWrapper::Replicate(ReplicatedState& state)
+{
+    Super::Replicate(state);
+    state.AddField(&AfterHitDuration);
+    state.AddField(&PostBreakDuration);
+    state.AddField(&MinBreakForce);
+    state.AddField(&MinBreakTime);
+    state.AddField(&AttachTime);
+    state.AddField(&BreakTime);
+}
+
+
 bool SwapperWrapper::Render()
 {
     return Super::Render();
@@ -550,6 +643,21 @@ void TornadoWrapper::Multiply(const float forceMultiplier, const float rangeMult
 }
 
 
+void TornadoWrapper::Replicate(ReplicatedState& state)
+{
+    Super::Replicate(state);
+    state.AddField(&Height);
+    state.AddField(&Radius);
+    state.AddField(&RotationalForce);
+    state.AddField(&Torque);
+    state.AddField(&FxScale);
+    state.AddField(&MeshScale);
+    state.AddField(&MaxVelocityOffset);
+    state.AddField(&BallMultiplier);
+    state.AddField(&VelocityEase);
+}
+
+
 bool HauntedWrapper::Render()
 {
     return Super::Render();
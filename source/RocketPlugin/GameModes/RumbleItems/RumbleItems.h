@@ -1,6 +1,8 @@
 #pragma once
 #include <utility>
 
+class ReplicatedState;
+
 
 class RumbleWrapper
 {
@@ -22,6 +24,7 @@ public:
     virtual void Reset();
     virtual void Update(std::uintptr_t item) const;
     virtual void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier);
+    virtual void Replicate(ReplicatedState& state);
 
     const RumbleWrapper* Archetype = nullptr;
     /*const*/ std::string DisplayName;
@@ -56,6 +59,7 @@ public:
     void Reset() override;
     void Update(std::uintptr_t item) const override;
     void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier) override;
+    void Replicate(ReplicatedState& state) override;
 
     bool CanTargetBall;
     bool CanTargetCars;
@@ -98,6 +102,7 @@ public:
     void Reset() override;
     void Update(std::uintptr_t item) const override;
     void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier) override;
+    void Replicate(ReplicatedState& state) override;
 
     float Force;
     float VerticalForce;
@@ -159,6 +164,7 @@ public:
     void Reset() override;
     void Update(std::uintptr_t item) const override;
     void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier) override;
+    void Replicate(ReplicatedState& state) override;
 
     bool MaintainMomentum;
     float TimeToStop;
@@ -188,6 +194,7 @@ public:
     void Reset() override;
     void Update(std::uintptr_t item) const override;
     void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier) override;
+    void Replicate(ReplicatedState& state) override;
 
     float Impulse;
     float Force;
@@ -215,6 +222,7 @@ public:
     void Reset() override;
     void Update(std::uintptr_t item) const override;
     void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier) override;
+    void Replicate(ReplicatedState& state) override;
 
     float BallGravity;
     float Range;
@@ -251,6 +259,7 @@ public:
     void Reset() override;
     void Update(std::uintptr_t item) const override;
     void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier) override;
+    void Replicate(ReplicatedState& state) override;
 
     float SpinSpeed;
 };
@@ -280,6 +289,7 @@ public:
     void Reset() override;
     void Update(std::uintptr_t item) const override;
     void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier) override;
+    void Replicate(ReplicatedState& state) override;
 
     bool BallForce;
     bool CarForce;
@@ -315,6 +325,7 @@ public:
     void Reset() override;
     void Update(std::uintptr_t item) const override;
     void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier) override;
+    void Replicate(ReplicatedState& state) override;
 
     float AfterHitDuration;
     float PostBreakDuration;
@@ -372,6 +383,7 @@ public:
     void Reset() override;
     void Update(std::uintptr_t item) const override;
     void Multiply(float forceMultiplier, float rangeMultiplier, float durationMultiplier) override;
+    void Replicate(ReplicatedState& state) override;
 
     float Height;
     float Radius;
@@ -0,0 +1,203 @@
+// HostQuality.cpp
+// Connection quality measurements to hosts for Rocket Plugin.
+//
+// Author:       Stanbroek
+// Version:      0.6.9 10/10/21
+
+#include "HostQuality.h"
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+
+HostQualitySampler::~HostQualitySampler()
+{
+    for (Socket& socket : sockets) {
+        NetworkContext::Get().ReleaseUdpSocket(std::move(socket));
+    }
+}
+
+
+/// <summary>Sets the hosts to sample, statistics of hosts that stay are kept.</summary>
+/// <remarks>Cheap when nothing changed, so it can be called every frame.</remarks>
+/// <param name="hostKeys">Address and port of the responder of every host</param>
+void HostQualitySampler::SetHosts(const std::vector<HostKey>& hostKeys)
+{
+    std::vector<HostKey> sortedKeys = hostKeys;
+    std::ranges::sort(sortedKeys);
+    sortedKeys.erase(std::ranges::unique(sortedKeys).begin(), sortedKeys.end());
+    if (std::ranges::equal(sortedKeys, hosts, {}, {}, &SampledHost::Key)) {
+        return;
+    }
+
+    NetworkContext& context = NetworkContext::Get();
+    std::vector<SampledHost> sampledHosts;
+    for (HostKey& key : sortedKeys) {
+        const auto host = std::ranges::lower_bound(hosts, key, {}, &SampledHost::Key);
+        if (host != hosts.end() && host->Key == key) {
+            sampledHosts.push_back(*host);
+            continue;
+        }
+
+        SampledHost sampledHost;
+        sampledHost.Key = std::move(key);
+        std::error_code error = context.Resolve(sampledHost.Key.first, sampledHost.Key.second, SOCK_DGRAM, IPPROTO_UDP,
+            sampledHost.Address);
+        if (error) {
+            BM_ERROR_LOG("could not resolve {:s}, {:s}", quote(sampledHost.Key.first), quote(error.message()));
+            continue;
+        }
+        const auto socket = std::ranges::find(sockets, sampledHost.Address.Family, &Socket::GetFamily);
+        sampledHost.SocketIndex = static_cast<size_t>(socket - sockets.begin());
+        if (socket == sockets.end()) {
+            Socket newSocket = context.AcquireUdpSocket(sampledHost.Address.Family, error);
+            if (error) {
+                BM_ERROR_LOG("could not open socket, {:s}", quote(error.message()));
+                continue;
+            }
+            sockets.push_back(std::move(newSocket));
+        }
+        sampledHosts.push_back(std::move(sampledHost));
+    }
+    hosts = std::move(sampledHosts);
+}
+
+
+/// <summary>Sends echo requests when it is time to and handles the replies that arrived, without blocking.</summary>
+void HostQualitySampler::Update()
+{
+    if (hosts.empty()) {
+        return;
+    }
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now >= nextRequest) {
+        for (SampledHost& host : hosts) {
+            sendRequest(host, now);
+        }
+        nextRequest = now + HOST_QUALITY_INTERVAL;
+    }
+
+    char recvBuf[64];
+    for (Socket& socket : sockets) {
+        while (!socket.WaitReadable(std::chrono::milliseconds::zero())) {
+            size_t received = 0;
+            SocketAddress from;
+            if (!socket.Receive(recvBuf, sizeof recvBuf, &received, &from)) {
+                handleReply(std::string_view(recvBuf, received), from, std::chrono::steady_clock::now());
+            }
+        }
+    }
+
+    for (SampledHost& host : hosts) {
+        updateQuality(host, now);
+    }
+}
+
+
+/// <summary>Gets the connection quality to the given host.</summary>
+/// <param name="host">Address of the host, as given to <see cref="HostQualitySampler::SetHosts"/></param>
+/// <param name="port">Port of the responder of the host</param>
+/// <returns>The connection quality, or nothing if the host is not sampled or no request finished yet</returns>
+std::optional<HostQuality> HostQualitySampler::GetQuality(const std::string& host, const unsigned short port) const
+{
+    const auto sampledHost = std::ranges::lower_bound(hosts, HostKey(host, port), {}, &SampledHost::Key);
+    if (sampledHost == hosts.end() || sampledHost->Key.first != host || sampledHost->Key.second != port ||
+        sampledHost->Quality.Samples == 0) {
+        return std::nullopt;
+    }
+
+    return sampledHost->Quality;
+}
+
+
+/// <summary>Sends an echo request with the next sequence number to the host.</summary>
+/// <param name="host">Host to send the request to</param>
+/// <param name="now">Time the request is send</param>
+void HostQualitySampler::sendRequest(SampledHost& host, const std::chrono::steady_clock::time_point now)
+{
+    const uint32_t sequence = nextSequence++;
+    std::string request(LAN_ECHO_MAGIC);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        request += static_cast<char>(sequence >> shift & 0xFF);
+    }
+    // Requests that could not be send are counted as lost.
+    if (const std::error_code error = sockets[host.SocketIndex].SendTo(request, host.Address)) {
+        BM_TRACE_LOG("could not send echo request to {:s}, {:s}", host.Address.ToString(), quote(error.message()));
+    }
+
+    host.Probes.push_back({ sequence, now, std::nullopt });
+    if (host.Probes.size() > HOST_QUALITY_WINDOW) {
+        host.Probes.pop_front();
+    }
+}
+
+
+/// <summary>Records the round trip time of the request the reply belongs to.</summary>
+/// <remarks>Replies that arrive after <see cref="HOST_QUALITY_PROBE_TIMEOUT"/> are ignored, the request already counts as lost.</remarks>
+/// <param name="reply">Received datagram</param>
+/// <param name="from">Address the datagram came from</param>
+/// <param name="now">Time the datagram was received</param>
+void HostQualitySampler::handleReply(std::string_view reply, const SocketAddress& from,
+    const std::chrono::steady_clock::time_point now)
+{
+    if (!reply.starts_with(LAN_ECHO_REPLY_MAGIC) || reply.size() != LAN_ECHO_REPLY_MAGIC.size() + sizeof(uint32_t)) {
+        return;
+    }
+    reply.remove_prefix(LAN_ECHO_REPLY_MAGIC.size());
+    uint32_t sequence = 0;
+    for (const char byte : reply) {
+        sequence = sequence << 8 | static_cast<uint8_t>(byte);
+    }
+
+    const auto host = std::ranges::find(hosts, from, &SampledHost::Address);
+    if (host == hosts.end()) {
+        return;
+    }
+    const auto probe = std::ranges::find(host->Probes, sequence, &Probe::Sequence);
+    if (probe == host->Probes.end() || probe->RTT || now - probe->SentAt >= HOST_QUALITY_PROBE_TIMEOUT) {
+        return;
+    }
+    probe->RTT = now - probe->SentAt;
+}
+
+
+/// <summary>Calculates the statistics of the host over its finished requests.</summary>
+/// <param name="host">Host to update</param>
+/// <param name="now">Current time, to see which requests timed out</param>
+void HostQualitySampler::updateQuality(SampledHost& host, const std::chrono::steady_clock::time_point now)
+{
+    size_t finished = 0;
+    size_t answered = 0;
+    size_t jitterSamples = 0;
+    std::chrono::steady_clock::duration totalRTT = std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::duration totalJitter = std::chrono::steady_clock::duration::zero();
+    std::optional<std::chrono::steady_clock::duration> lastRTT;
+    for (const Probe& probe : host.Probes) {
+        if (probe.RTT) {
+            finished++;
+            answered++;
+            totalRTT += *probe.RTT;
+            if (lastRTT) {
+                totalJitter += *probe.RTT > *lastRTT ? *probe.RTT - *lastRTT : *lastRTT - *probe.RTT;
+                jitterSamples++;
+            }
+            lastRTT = probe.RTT;
+        }
+        else if (now - probe.SentAt >= HOST_QUALITY_PROBE_TIMEOUT) {
+            finished++;
+        }
+    }
+
+    host.Quality.Samples = finished;
+    host.Quality.Loss = finished == 0 ? 0 : 1 - static_cast<float>(answered) / static_cast<float>(finished);
+    host.Quality.RTT = answered == 0 ? std::chrono::microseconds::zero() : std::chrono::duration_cast<std::chrono::microseconds>(
+        totalRTT / static_cast<std::chrono::steady_clock::rep>(answered));
+    host.Quality.Jitter = jitterSamples == 0 ? std::chrono::microseconds::zero() : std::chrono::duration_cast<std::chrono::microseconds>(
+        totalJitter / static_cast<std::chrono::steady_clock::rep>(jitterSamples));
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "LanDiscovery.h"
+
+// Echo requests are send to every sampled host this often.
+constexpr std::chrono::milliseconds HOST_QUALITY_INTERVAL = std::chrono::milliseconds(500);
+// Echo requests that are not answered within this time count as lost.
+constexpr std::chrono::milliseconds HOST_QUALITY_PROBE_TIMEOUT = std::chrono::seconds(1);
+// Number of most recent echo requests the statistics are taken over.
+constexpr size_t HOST_QUALITY_WINDOW = 20;
+
+
+/// <summary>Connection quality to a host, over its most recent echo requests.</summary>
+struct HostQuality
+{
+    // Average round trip time of the answered requests.
+    std::chrono::microseconds RTT = std::chrono::microseconds::zero();
+    // Average difference in round trip time between consecutive answered requests.
+    std::chrono::microseconds Jitter = std::chrono::microseconds::zero();
+    // Fraction of the finished requests that went unanswered.
+    float Loss = 0;
+    // Number of requests that were answered or timed out.
+    size_t Samples = 0;
+};
+
+
+/// <summary>Keeps rolling round trip time, jitter and loss statistics per host, by sending echo requests to the responder of the host.</summary>
+/// <remarks>
+/// Does not block or spawn threads, <see cref="HostQualitySampler::Update"/> is meant to be called every frame.
+/// Hosts are resolved when they are added, so pass addresses to not wait on a lookup.
+/// </remarks>
+class HostQualitySampler
+{
+public:
+    using HostKey = std::pair<std::string, unsigned short>;
+
+    HostQualitySampler() = default;
+    ~HostQualitySampler();
+
+    HostQualitySampler(HostQualitySampler&&) = delete;
+    HostQualitySampler(const HostQualitySampler&) = delete;
+    HostQualitySampler& operator=(HostQualitySampler&&) = delete;
+    HostQualitySampler& operator=(const HostQualitySampler&) = delete;
+
+    void SetHosts(const std::vector<HostKey>& hostKeys);
+    void Update();
+    std::optional<HostQuality> GetQuality(const std::string& host, unsigned short port = LAN_DISCOVERY_PORT) const;
+
+private:
+    struct Probe
+    {
+        uint32_t Sequence = 0;
+        std::chrono::steady_clock::time_point SentAt;
+        std::optional<std::chrono::steady_clock::duration> RTT;
+    };
+
+    struct SampledHost
+    {
+        HostKey Key;
+        SocketAddress Address;
+        size_t SocketIndex = 0;
+        // Oldest first, at most HOST_QUALITY_WINDOW.
+        std::deque<Probe> Probes;
+        HostQuality Quality;
+    };
+
+    void sendRequest(SampledHost& host, std::chrono::steady_clock::time_point now);
+    void handleReply(std::string_view reply, const SocketAddress& from, std::chrono::steady_clock::time_point now);
+    static void updateQuality(SampledHost& host, std::chrono::steady_clock::time_point now);
+
+    // One socket per address family, shared by all hosts of that family.
+    std::vector<Socket> sockets;
+    // Sorted by key.
+    std::vector<SampledHost> hosts;
+    uint32_t nextSequence = 0;
+    std::chrono::steady_clock::time_point nextRequest;
+};
@@ -0,0 +1,284 @@
+// LanDiscovery.cpp
+// Finding hosts on the local network for Rocket Plugin.
+//
+// Author:       Stanbroek
+// Version:      0.6.9 10/10/21
+
+#include "LanDiscovery.h"
+#include "Networking.h"
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+// The responder checks this often if it should stop.
+constexpr std::chrono::milliseconds LAN_RESPONDER_POLL_INTERVAL = std::chrono::milliseconds(100);
+
+
+/// <summary>Encodes the beacon as magic, format, flags, players, max players, port and the length prefixed version and map name.</summary>
+/// <returns>The encoded beacon</returns>
+std::string LanBeacon::Encode() const
+{
+    const std::string_view version = std::string_view(Version).substr(0, UINT8_MAX);
+    const std::string_view mapName = std::string_view(MapName).substr(0, UINT8_MAX);
+
+    std::string data(LAN_BEACON_MAGIC);
+    data += static_cast<char>(LAN_BEACON_FORMAT);
+    data += static_cast<char>(Password ? 1 : 0);
+    data += static_cast<char>(Players);
+    data += static_cast<char>(MaxPlayers);
+    data += static_cast<char>(Port >> 8);
+    data += static_cast<char>(Port & 0xFF);
+    data += static_cast<char>(version.size());
+    data += version;
+    data += static_cast<char>(mapName.size());
+    data += mapName;
+
+    return data;
+}
+
+
+/// <summary>Decodes a beacon from a host.</summary>
+/// <param name="data">Received datagram</param>
+/// <returns>The beacon, or nothing if the datagram is not a beacon this version understands</returns>
+std::optional<LanBeacon> LanBeacon::Decode(std::string_view data)
+{
+    // Format, flags, players, max players and port.
+    constexpr size_t fixedSize = 6;
+    if (!data.starts_with(LAN_BEACON_MAGIC) || data.size() < LAN_BEACON_MAGIC.size() + fixedSize) {
+        return std::nullopt;
+    }
+    data.remove_prefix(LAN_BEACON_MAGIC.size());
+    const auto byte = [&data](const size_t i) { return static_cast<uint8_t>(data[i]); };
+    if (byte(0) != LAN_BEACON_FORMAT) {
+        return std::nullopt;
+    }
+
+    LanBeacon beacon;
+    beacon.Password = byte(1) != 0;
+    beacon.Players = byte(2);
+    beacon.MaxPlayers = byte(3);
+    beacon.Port = static_cast<unsigned short>(byte(4) << 8 | byte(5));
+    data.remove_prefix(fixedSize);
+
+    for (std::string* field : { &beacon.Version, &beacon.MapName }) {
+        if (data.empty()) {
+            return std::nullopt;
+        }
+        const size_t length = byte(0);
+        if (data.size() < 1 + length) {
+            return std::nullopt;
+        }
+        *field = data.substr(1, length);
+        data.remove_prefix(1 + length);
+    }
+
+    return beacon;
+}
+
+
+/// <summary>Starts listening for discovery queries, which are not answered until a beacon is set.</summary>
+/// <param name="discoveryPort">Port to listen on, shared with other responders on the same machine</param>
+/// <param name="host">Address to bind to</param>
+LanBeaconResponder::LanBeaconResponder(const unsigned short discoveryPort, const std::string& host)
+{
+    NetworkContext& context = NetworkContext::Get();
+    SocketAddress address;
+    std::error_code error = context.Resolve(host, discoveryPort, SOCK_DGRAM, IPPROTO_UDP, address);
+    if (!error) {
+        error = socket.Open(address.Family, SOCK_DGRAM, IPPROTO_UDP);
+    }
+    if (!error) {
+        // Every host on this machine should receive the broadcast queries.
+        error = socket.SetOption(SOL_SOCKET, SO_REUSEADDR, 1);
+    }
+    if (!error) {
+        error = socket.Bind(address);
+    }
+    if (error) {
+        BM_ERROR_LOG("could not listen for discovery queries on port {:d}, {:s}", discoveryPort, quote(error.message()));
+        socket.Close();
+        return;
+    }
+
+    responderThread = save_thread("LanBeaconResponder", [this]() {
+        respond();
+    });
+}
+
+
+LanBeaconResponder::~LanBeaconResponder()
+{
+    stopping = true;
+    if (responderThread.joinable()) {
+        responderThread.join();
+    }
+}
+
+
+/// <summary>Sets the beacon that queries are answered with.</summary>
+/// <param name="beacon">Beacon of the hosted game, or nothing to stop answering</param>
+void LanBeaconResponder::SetBeacon(const std::optional<LanBeacon>& beacon)
+{
+    const std::scoped_lock lock(beaconMutex);
+    if (this->beacon == beacon) {
+        return;
+    }
+    this->beacon = beacon;
+    encodedBeacon = beacon ? beacon->Encode() : std::string();
+}
+
+
+/// <summary>Checks if the address is a private, loopback or link-local address.</summary>
+/// <remarks>
+/// A beacon can be over a hundred times larger than the query, so answering spoofed queries from anywhere would
+/// make a forwarded host a reflection amplifier.
+/// </remarks>
+/// <param name="address">Address to check</param>
+/// <returns>Bool with if the address is on the local network</returns>
+bool LanBeaconResponder::IsLocalAddress(const SocketAddress& address)
+{
+    if (address.Family == AF_INET) {
+        const uint32_t ipAddr = ntohl(reinterpret_cast<const sockaddr_in*>(address.Storage.data())->sin_addr.s_addr);
+        const Networking::IPv4Range range = Networking::GetIPv4Range(ipAddr);
+        // 169.254.0.0/16 - link-local
+        return range == Networking::IPv4Range::PRIVATE || range == Networking::IPv4Range::LOOPBACK || ipAddr >> 16 == 0xA9FE;
+    }
+    if (address.Family == AF_INET6) {
+        const in6_addr& ipAddr = reinterpret_cast<const sockaddr_in6*>(address.Storage.data())->sin6_addr;
+        // fc00::/7 - unique local
+        return IN6_IS_ADDR_LOOPBACK(&ipAddr) || IN6_IS_ADDR_LINKLOCAL(&ipAddr) || (ipAddr.s6_addr[0] & 0xFE) == 0xFC;
+    }
+
+    return false;
+}
+
+
+/// <summary>Answers discovery queries and echo requests until the responder is stopped.</summary>
+void LanBeaconResponder::respond()
+{
+    char recvBuf[64];
+    while (!stopping) {
+        if (socket.WaitReadable(LAN_RESPONDER_POLL_INTERVAL)) {
+            continue;
+        }
+        size_t received = 0;
+        SocketAddress from;
+        if (socket.Receive(recvBuf, sizeof recvBuf, &received, &from)) {
+            continue;
+        }
+        if (!IsLocalAddress(from)) {
+            BM_TRACE_LOG("ignoring request from {:s}", from.ToString());
+            continue;
+        }
+
+        std::string reply;
+        const std::string_view request(recvBuf, received);
+        if (request.starts_with(LAN_ECHO_MAGIC)) {
+            reply = std::string(LAN_ECHO_REPLY_MAGIC) + std::string(request.substr(LAN_ECHO_MAGIC.size()));
+        }
+        else if (request.starts_with(LAN_QUERY_MAGIC)) {
+            const std::scoped_lock lock(beaconMutex);
+            reply = encodedBeacon;
+        }
+        if (reply.empty()) {
+            continue;
+        }
+        if (const std::error_code error = socket.SendTo(reply, from)) {
+            BM_TRACE_LOG("could not answer {:s}, {:s}", from.ToString(), quote(error.message()));
+        }
+    }
+}
+
+
+/// <summary>Sets up the socket discovery queries are broadcast from, the first query is send on the next update.</summary>
+/// <param name="broadcastAddress">Address to send the queries to</param>
+/// <param name="discoveryPort">Port the hosts listen on</param>
+LanDiscovery::LanDiscovery(const std::string& broadcastAddress, const unsigned short discoveryPort)
+{
+    NetworkContext& context = NetworkContext::Get();
+    std::error_code error = context.Resolve(broadcastAddress, discoveryPort, SOCK_DGRAM, IPPROTO_UDP, this->broadcastAddress);
+    if (!error) {
+        error = socket.Open(this->broadcastAddress.Family, SOCK_DGRAM, IPPROTO_UDP);
+    }
+    if (!error) {
+        error = socket.SetOption(SOL_SOCKET, SO_BROADCAST, 1);
+    }
+    if (error) {
+        BM_ERROR_LOG("could not broadcast discovery queries to {:s}, {:s}", quote(broadcastAddress), quote(error.message()));
+        socket.Close();
+    }
+}
+
+
+/// <summary>Sends a query when it is time to and handles the beacons that arrived, without blocking.</summary>
+/// <returns>Bool with if the list of hosts changed</returns>
+bool LanDiscovery::Update()
+{
+    if (!socket.IsOpen()) {
+        return false;
+    }
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now >= nextQuery) {
+        if (const std::error_code error = sendQuery()) {
+            BM_TRACE_LOG("could not send discovery query, {:s}", quote(error.message()));
+        }
+        nextQuery = now + LAN_DISCOVERY_INTERVAL;
+    }
+
+    bool changed = false;
+    char recvBuf[600];
+    while (!socket.WaitReadable(std::chrono::milliseconds::zero())) {
+        size_t received = 0;
+        SocketAddress from;
+        if (socket.Receive(recvBuf, sizeof recvBuf, &received, &from)) {
+            continue;
+        }
+        const std::optional<LanBeacon> beacon = LanBeacon::Decode(std::string_view(recvBuf, received));
+        if (!beacon) {
+            continue;
+        }
+
+        const std::string address = from.GetHost();
+        const auto host = std::ranges::lower_bound(hosts, std::tie(address, beacon->Port), std::less<>(),
+            [](const LanHost& lanHost) { return std::tie(lanHost.Address, lanHost.Beacon.Port); });
+        if (host != hosts.end() && host->Address == address && host->Beacon.Port == beacon->Port) {
+            changed |= host->Beacon != *beacon;
+            host->Beacon = *beacon;
+            host->LastSeen = now;
+        }
+        else {
+            hosts.insert(host, { address, *beacon, now });
+            changed = true;
+        }
+    }
+
+    changed |= std::erase_if(hosts, [now](const LanHost& lanHost) {
+        return lanHost.LastSeen + LAN_HOST_TIMEOUT < now;
+    }) > 0;
+
+    return changed;
+}
+
+
+/// <summary>Sends a query on the next update, instead of waiting for the interval.</summary>
+void LanDiscovery::Refresh()
+{
+    nextQuery = std::chrono::steady_clock::time_point();
+}
+
+
+/// <summary>Broadcasts a discovery query.</summary>
+/// <returns>Error code</returns>
+std::error_code LanDiscovery::sendQuery()
+{
+    std::string query(LAN_QUERY_MAGIC);
+    query += static_cast<char>(LAN_BEACON_FORMAT);
+
+    return socket.SendTo(query, broadcastAddress);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "Socket.h"
+
+// Port hosts listen on for discovery queries, next to the default game port.
+constexpr unsigned short LAN_DISCOVERY_PORT = 7778;
+// Address discovery queries are broadcast to.
+constexpr const char* LAN_DISCOVERY_ADDRESS = "255.255.255.255";
+// Clients repeat their query this often, so the server list stays up to date.
+constexpr std::chrono::seconds LAN_DISCOVERY_INTERVAL = std::chrono::seconds(2);
+// Hosts that did not answer for this long are removed from the server list.
+constexpr std::chrono::seconds LAN_HOST_TIMEOUT = std::chrono::seconds(7);
+// Queries and beacons start with these magic bytes, followed by the format version.
+constexpr std::string_view LAN_QUERY_MAGIC = "RPLQ";
+constexpr std::string_view LAN_BEACON_MAGIC = "RPLB";
+constexpr uint8_t LAN_BEACON_FORMAT = 1;
+// Echo requests are send back as is with the reply magic, so clients can measure the connection to the host.
+constexpr std::string_view LAN_ECHO_MAGIC = "RPLE";
+constexpr std::string_view LAN_ECHO_REPLY_MAGIC = "RPLR";
+
+
+/// <summary>What a host tells about its game when it answers a discovery query.</summary>
+struct LanBeacon
+{
+    std::string Version;
+    std::string MapName;
+    uint8_t Players = 0;
+    uint8_t MaxPlayers = 0;
+    bool Password = false;
+    // Port of the game, the match file server listens on the same port.
+    unsigned short Port = 0;
+
+    std::string Encode() const;
+    static std::optional<LanBeacon> Decode(std::string_view data);
+
+    bool operator==(const LanBeacon& other) const = default;
+};
+
+
+/// <summary>Answers discovery queries with the beacon of the hosted game and echo requests, on its own thread.</summary>
+/// <remarks>Only requests from the local network are answered.</remarks>
+class LanBeaconResponder
+{
+public:
+    explicit LanBeaconResponder(unsigned short discoveryPort = LAN_DISCOVERY_PORT, const std::string& host = "0.0.0.0");
+    ~LanBeaconResponder();
+
+    LanBeaconResponder(LanBeaconResponder&&) = delete;
+    LanBeaconResponder(const LanBeaconResponder&) = delete;
+    LanBeaconResponder& operator=(LanBeaconResponder&&) = delete;
+    LanBeaconResponder& operator=(const LanBeaconResponder&) = delete;
+
+    void SetBeacon(const std::optional<LanBeacon>& beacon);
+    bool IsListening() const { return socket.IsOpen(); }
+
+    static bool IsLocalAddress(const SocketAddress& address);
+
+private:
+    void respond();
+
+    std::mutex beaconMutex;
+    // Encoded beacon, queries are not answered while it is empty.
+    std::string encodedBeacon;
+    std::optional<LanBeacon> beacon;
+    Socket socket;
+    std::atomic<bool> stopping = false;
+    std::thread responderThread;
+};
+
+
+/// <summary>Keeps a list of the hosts on the local network, by broadcasting discovery queries.</summary>
+/// <remarks>Does not block or spawn threads, <see cref="LanDiscovery::Update"/> is meant to be called every frame.</remarks>
+class LanDiscovery
+{
+public:
+    struct LanHost
+    {
+        std::string Address;
+        LanBeacon Beacon;
+        std::chrono::steady_clock::time_point LastSeen;
+    };
+
+    explicit LanDiscovery(const std::string& broadcastAddress = LAN_DISCOVERY_ADDRESS,
+        unsigned short discoveryPort = LAN_DISCOVERY_PORT);
+
+    bool Update();
+    void Refresh();
+    const std::vector<LanHost>& GetHosts() const { return hosts; }
+
+private:
+    std::error_code sendQuery();
+
+    SocketAddress broadcastAddress;
+    Socket socket;
+    std::chrono::steady_clock::time_point nextQuery;
+    // Sorted by address and port, a host is listed once no matter how often it answers.
+    std::vector<LanHost> hosts;
+};
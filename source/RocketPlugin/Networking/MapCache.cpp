@@ -0,0 +1,291 @@
+#include "MapCache.h"
+#include "RocketPlugin.h"
+
+
+/// <summary>Gets the current time in seconds since epoch.</summary>
+/// <returns>Current time in seconds since epoch</returns>
+int64_t get_timestamp()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+/// <summary>Checks if the given string is a sha256 hex digest.</summary>
+/// <remarks>Hashes come from the host and are used as file names, so anything else is rejected.</remarks>
+/// <param name="hash">Hash to check</param>
+/// <returns>Bool with if the hash is valid</returns>
+bool is_valid_hash(const std::string& hash)
+{
+    return hash.size() == 64 && std::ranges::all_of(hash, [](const char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+    });
+}
+
+
+/// <summary>Creates a map cache, the index is read on first use.</summary>
+/// <param name="cachePath">Directory to store the maps in, defaults to <see cref="MAP_CACHE_PATH"/></param>
+MapCache::MapCache(std::filesystem::path cachePath) : cachePath(std::move(cachePath)) {}
+
+
+/// <summary>Sets the disk budget and evicts maps until the cache fits.</summary>
+/// <param name="budget">Maximum number of bytes of maps to keep</param>
+void MapCache::SetBudget(const size_t budget)
+{
+    const std::scoped_lock lock(cacheMutex);
+    this->budget = budget;
+    load();
+    evict(0);
+    save();
+}
+
+
+/// <summary>Checks if the map is in the cache.</summary>
+/// <param name="guid">Guid of the map</param>
+/// <param name="hash">Hash of the map contents</param>
+/// <returns>Bool with if the map is in the cache</returns>
+bool MapCache::Contains(const std::string& guid, const std::string& hash)
+{
+    const std::scoped_lock lock(cacheMutex);
+    load();
+
+    return find(guid, hash) != entries.end();
+}
+
+
+/// <summary>Copies the map from the cache to the given path.</summary>
+/// <param name="guid">Guid of the map</param>
+/// <param name="hash">Hash of the map contents</param>
+/// <param name="filePath">Path to restore the map to</param>
+/// <returns>Bool with if the map was restored</returns>
+bool MapCache::Restore(const std::string& guid, const std::string& hash, const std::filesystem::path& filePath)
+{
+    const std::scoped_lock lock(cacheMutex);
+    load();
+
+    const auto entry = find(guid, hash);
+    if (entry == entries.end()) {
+        return false;
+    }
+
+    // Hard link the map when the cache is on the same volume, maps are never modified in place.
+    std::error_code ec;
+    std::filesystem::remove(filePath, ec);
+    std::filesystem::create_hard_link(getEntryPath(hash), filePath, ec);
+    if (ec) {
+        std::filesystem::copy_file(getEntryPath(hash), filePath, std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec) {
+            BM_ERROR_LOG("Could not restore {:s} from the map cache, {:s}", quote(entry->MapName), quote(ec.message()));
+            return false;
+        }
+    }
+
+    entry->LastUsed = get_timestamp();
+    save();
+    BM_INFO_LOG("Restored {:s} from the map cache", quote(entry->MapName));
+
+    return true;
+}
+
+
+/// <summary>Adds the given map to the cache, evicting the least recently used maps when over budget.</summary>
+/// <param name="guid">Guid of the map</param>
+/// <param name="hash">Hash of the map contents</param>
+/// <param name="mapName">Name of the map</param>
+/// <param name="filePath">Path to the map</param>
+/// <returns>Bool with if the map was added</returns>
+bool MapCache::Insert(const std::string& guid, const std::string& hash, const std::string& mapName,
+    const std::filesystem::path& filePath)
+{
+    if (!is_valid_hash(hash)) {
+        BM_WARNING_LOG("Not caching {:s}, invalid hash {:s}", quote(mapName), quote(hash));
+        return false;
+    }
+
+    std::error_code ec;
+    const size_t fileSize = std::filesystem::file_size(filePath, ec);
+    if (ec) {
+        BM_ERROR_LOG("Could not cache {:s}, {:s}", quote(mapName), quote(ec.message()));
+        return false;
+    }
+
+    const std::scoped_lock lock(cacheMutex);
+    load();
+
+    if (fileSize > budget) {
+        BM_TRACE_LOG("Not caching {:s}, the map is larger than the cache", quote(mapName));
+        return false;
+    }
+
+    const auto entry = std::ranges::find_if(entries, [&](const Entry& cachedEntry) {
+        return cachedEntry.Hash == hash;
+    });
+    if (entry != entries.end()) {
+        if (std::ranges::find(entry->Guids, guid) == entry->Guids.end()) {
+            entry->Guids.push_back(guid);
+        }
+        entry->MapName = mapName;
+        entry->LastUsed = get_timestamp();
+        save();
+        return true;
+    }
+
+    evict(fileSize);
+    std::filesystem::create_directories(getCachePath(), ec);
+    const std::filesystem::path entryPath = getEntryPath(hash);
+    std::filesystem::create_hard_link(filePath, entryPath, ec);
+    if (ec) {
+        std::filesystem::copy_file(filePath, entryPath, std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec) {
+            BM_ERROR_LOG("Could not cache {:s}, {:s}", quote(mapName), quote(ec.message()));
+            std::filesystem::remove(entryPath, ec);
+            return false;
+        }
+    }
+
+    entries.push_back({ { guid }, hash, mapName, fileSize, get_timestamp() });
+    save();
+    BM_TRACE_LOG("Cached {:s} as {:s}", quote(mapName), hash);
+
+    return true;
+}
+
+
+/// <summary>Gets the directory the maps are stored in.</summary>
+/// <returns>Path to the cache directory</returns>
+std::filesystem::path MapCache::getCachePath() const
+{
+    if (cachePath.empty()) {
+        return MAP_CACHE_PATH;
+    }
+
+    return cachePath;
+}
+
+
+/// <summary>Gets the path a map is stored at.</summary>
+/// <param name="hash">Hash of the map contents</param>
+/// <returns>Path to the cached map</returns>
+std::filesystem::path MapCache::getEntryPath(const std::string& hash) const
+{
+    return getCachePath() / hash;
+}
+
+
+/// <summary>Finds the entry of a map, dropping it if the cached file went missing.</summary>
+/// <remarks>Expects the cache to be locked.</remarks>
+/// <param name="guid">Guid of the map</param>
+/// <param name="hash">Hash of the map contents</param>
+/// <returns>Iterator to the entry, or end if the map is not cached</returns>
+std::vector<MapCache::Entry>::iterator MapCache::find(const std::string& guid, const std::string& hash)
+{
+    if (!is_valid_hash(hash)) {
+        return entries.end();
+    }
+
+    const auto entry = std::ranges::find_if(entries, [&](const Entry& cachedEntry) {
+        return cachedEntry.Hash == hash && std::ranges::find(cachedEntry.Guids, guid) != cachedEntry.Guids.end();
+    });
+    if (entry == entries.end()) {
+        return entries.end();
+    }
+
+    std::error_code ec;
+    if (std::filesystem::file_size(getEntryPath(hash), ec) != entry->FileSize || ec) {
+        BM_WARNING_LOG("Cached {:s} went missing", quote(entry->MapName));
+        entries.erase(entry);
+        save();
+        return entries.end();
+    }
+
+    return entry;
+}
+
+
+/// <summary>Reads the cache index, if it was not read yet.</summary>
+/// <remarks>Expects the cache to be locked.</remarks>
+void MapCache::load()
+{
+    if (loaded) {
+        return;
+    }
+    loaded = true;
+
+    std::ifstream file(getCachePath() / MAP_CACHE_INDEX_FILE_NAME);
+    if (!file.is_open()) {
+        return;
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    try {
+        simdjson::ondemand::parser parser;
+        const simdjson::padded_string paddedData = data;
+        simdjson::ondemand::document doc = parser.iterate(paddedData);
+
+        for (simdjson::ondemand::object object : doc.get_array()) {
+            Entry entry;
+            for (const std::string_view guid : object["Guids"].get_array()) {
+                entry.Guids.emplace_back(guid);
+            }
+            entry.Hash = std::string_view(object["Hash"].get_string());
+            entry.MapName = std::string_view(object["MapName"].get_string());
+            entry.FileSize = object["FileSize"].get_uint64();
+            entry.LastUsed = object["LastUsed"].get_int64();
+            if (is_valid_hash(entry.Hash)) {
+                entries.push_back(std::move(entry));
+            }
+        }
+    }
+    catch (const simdjson::simdjson_error& e) {
+        BM_WARNING_LOG("Could not read the map cache index, {:s}", e.what());
+        entries.clear();
+    }
+}
+
+
+/// <summary>Writes the cache index.</summary>
+/// <remarks>Expects the cache to be locked.</remarks>
+void MapCache::save() const
+{
+    std::string index;
+    for (const Entry& entry : entries) {
+        std::string guids;
+        for (const std::string& guid : entry.Guids) {
+            guids += fmt::format("{:s}{:s}", guids.empty() ? "" : ", ", quote(guid));
+        }
+        index += fmt::format(R"({:s}{{"Guids": [{:s}], "Hash": {:s}, "MapName": {:s}, "FileSize": {:d}, "LastUsed": {:d}}})",
+            index.empty() ? "\n    " : ",\n    ", guids, quote(entry.Hash), quote(entry.MapName), entry.FileSize,
+            entry.LastUsed);
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(getCachePath(), ec);
+    std::ofstream file(getCachePath() / MAP_CACHE_INDEX_FILE_NAME, std::ios::trunc);
+    file << "[" << index << "\n]\n";
+    if (file.fail()) {
+        BM_ERROR_LOG("Could not write the map cache index");
+    }
+}
+
+
+/// <summary>Evicts the least recently used maps until the given number of bytes fit in the budget.</summary>
+/// <remarks>Expects the cache to be locked.</remarks>
+/// <param name="reserved">Number of bytes to make room for</param>
+void MapCache::evict(const size_t reserved)
+{
+    size_t cacheSize = 0;
+    for (const Entry& entry : entries) {
+        cacheSize += entry.FileSize;
+    }
+
+    std::ranges::sort(entries, [](const Entry& lhs, const Entry& rhs) {
+        return lhs.LastUsed > rhs.LastUsed;
+    });
+    while (!entries.empty() && cacheSize + reserved > budget) {
+        const Entry& entry = entries.back();
+        BM_TRACE_LOG("Evicting {:s} from the map cache", quote(entry.MapName));
+        std::error_code ec;
+        std::filesystem::remove(getEntryPath(entry.Hash), ec);
+        cacheSize -= entry.FileSize;
+        entries.pop_back();
+    }
+}
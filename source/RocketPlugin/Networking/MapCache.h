@@ -0,0 +1,49 @@
+#pragma once
+
+
+// Default disk budget for the map cache, least recently used maps are evicted beyond this.
+constexpr size_t MAP_CACHE_DEFAULT_BUDGET_MB = 2048;
+constexpr const char* MAP_CACHE_INDEX_FILE_NAME = "index.json";
+
+
+/// <summary>Content addressed cache of downloaded maps.</summary>
+/// <remarks>
+/// Maps are stored by the hash of their contents and looked up by their guid and hash, so joining a match on a map that
+/// was played before does not download it again.
+/// </remarks>
+class MapCache
+{
+public:
+    explicit MapCache(std::filesystem::path cachePath = {});
+
+    void SetBudget(size_t budget);
+    bool Contains(const std::string& guid, const std::string& hash);
+    bool Restore(const std::string& guid, const std::string& hash, const std::filesystem::path& filePath);
+    bool Insert(const std::string& guid, const std::string& hash, const std::string& mapName,
+        const std::filesystem::path& filePath);
+
+private:
+    struct Entry
+    {
+        // Every guid the map was inserted under, the same contents can be published under multiple guids.
+        std::vector<std::string> Guids;
+        std::string Hash;
+        std::string MapName;
+        size_t FileSize = 0;
+        // Seconds since epoch.
+        int64_t LastUsed = 0;
+    };
+
+    std::filesystem::path getCachePath() const;
+    std::filesystem::path getEntryPath(const std::string& hash) const;
+    std::vector<Entry>::iterator find(const std::string& guid, const std::string& hash);
+    void load();
+    void save() const;
+    void evict(size_t reserved);
+
+    std::filesystem::path cachePath;
+    size_t budget = MAP_CACHE_DEFAULT_BUDGET_MB * 1024 * 1024;
+    bool loaded = false;
+    std::vector<Entry> entries;
+    std::mutex cacheMutex;
+};
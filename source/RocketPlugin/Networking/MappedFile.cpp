@@ -0,0 +1,86 @@
+#include "MappedFile.h"
+
+
+/// <summary>Maps the given file into memory.</summary>
+/// <remarks>Check IsOpen to see if the file could be mapped.</remarks>
+/// <param name="filePath">Path to the file to map</param>
+MappedFile::MappedFile(const std::filesystem::path& filePath)
+{
+    file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        BM_ERROR_LOG("CreateFileW: {:s}", std::system_category().message(static_cast<int>(GetLastError())));
+        return;
+    }
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(file, &fileSize)) {
+        BM_ERROR_LOG("GetFileSizeEx: {:s}", std::system_category().message(static_cast<int>(GetLastError())));
+        return;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+    // Empty files can not be mapped.
+    if (size == 0) {
+        open = true;
+        return;
+    }
+
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        BM_ERROR_LOG("CreateFileMappingW: {:s}", std::system_category().message(static_cast<int>(GetLastError())));
+        return;
+    }
+
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr) {
+        BM_ERROR_LOG("MapViewOfFile: {:s}", std::system_category().message(static_cast<int>(GetLastError())));
+        return;
+    }
+
+    open = true;
+}
+
+
+/// <summary>Unmaps the file.</summary>
+MappedFile::~MappedFile()
+{
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping != nullptr) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+}
+
+
+/// <summary>Gets if the file was mapped.</summary>
+/// <returns>Bool with if the file was mapped</returns>
+bool MappedFile::IsOpen() const
+{
+    return open;
+}
+
+
+/// <summary>Gets the size of the mapped file.</summary>
+/// <returns>Size of the mapped file</returns>
+size_t MappedFile::GetSize() const
+{
+    return size;
+}
+
+
+/// <summary>Gets a view into the mapped file.</summary>
+/// <param name="offset">Offset into the file</param>
+/// <param name="length">Maximum length of the view</param>
+/// <returns>View into the mapped file, clamped to the end of the file</returns>
+std::string_view MappedFile::GetData(const size_t offset, const size_t length) const
+{
+    if (data == nullptr || offset >= size) {
+        return {};
+    }
+
+    return std::string_view(data + offset, std::min(length, size - offset));
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+
+/// <summary>Read only memory mapping of a file.</summary>
+/// <remarks>Readers get views into the mapping, so serving a file does not copy it into intermediate buffers.</remarks>
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path& filePath);
+    ~MappedFile();
+
+    MappedFile(MappedFile&&) = delete;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOpen() const;
+    size_t GetSize() const;
+    std::string_view GetData(size_t offset = 0, size_t length = std::string_view::npos) const;
+
+private:
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    const char* data = nullptr;
+    size_t size = 0;
+    bool open = false;
+};
@@ -10,20 +10,81 @@
 //  https://developer.mozilla.org/en-US/docs/Web/HTTP/Basics_of_HTTP/MIME_types/Common_types
 
 #include "MatchFileServer.h"
+#include "MappedFile.h"
+#include "Sha256.h"
+#include "RPCompression.h"
 #include "RocketPlugin.h"
 
 
+/// <summary>Starts a match file server that serves the current map.</summary>
+/// <param name="host">Address to bind to</param>
+/// <param name="port">Port to bind to</param>
+/// <param name="socket_flags">Socket flags to bind with</param>
 MatchFileServer::MatchFileServer(const std::string& host, const int port, const int socket_flags)
+    : lanResponder(std::make_unique<LanBeaconResponder>())
 {
-    serverThread = save_thread("MatchFileServer", [this, host, port, socket_flags]() {
+    startServer(host, port, socket_flags, nullptr);
+}
+
+
+/// <summary>Starts a match file server that serves a downloaded map to other players, which takes load off the host.</summary>
+/// <param name="host">Address to bind to</param>
+/// <param name="port">Port to bind to</param>
+/// <param name="map">Status of the map, as send by the host</param>
+/// <param name="filePath">Path to the downloaded map</param>
+/// <param name="originHost">Host of the match file server the map came from, to register at as peer</param>
+/// <param name="originPort">Port of the match file server the map came from, 0 to not register</param>
+MatchFileServer::MatchFileServer(const std::string& host, const int port, const ServerStatus::MapStatus& map,
+    const std::filesystem::path& filePath, const std::string& originHost, const int originPort)
+    : servedMap(ServedMap{ map.MapName, map.Guid, filePath })
+{
+    startServer(host, port, 0, [originHost, originPort, port, hash = map.Hash]() {
+        if (originPort != 0) {
+            registerPeer(originHost, originPort, port, hash);
+        }
+    });
+}
+
+
+MatchFileServer::~MatchFileServer()
+{
+    svr.stop();
+    if (serverThread.joinable()) {
+        serverThread.join();
+    }
+}
+
+
+/// <summary>Binds the server and handles requests on the server thread.</summary>
+/// <param name="host">Address to bind to</param>
+/// <param name="port">Port to bind to</param>
+/// <param name="socket_flags">Socket flags to bind with</param>
+/// <param name="onBound">Gets called on the server thread once the server is bound, can be nullptr</param>
+void MatchFileServer::startServer(const std::string& host, const int port, const int socket_flags,
+    const std::function<void()>& onBound)
+{
+    serverThread = save_thread("MatchFileServer", [this, host, port, socket_flags, onBound]() {
         BM_INFO_LOG("Starting match file server on {:s}:{:d}", host, port);
-        svr.Get("/status", serverStatusRequest);
-        svr.Get("/map", serverDownloadMapRequest);
+        svr.Get("/status", [this](const httplib::Request& req, httplib::Response& res) {
+            serverStatusRequest(req, res);
+        });
+        svr.Get("/map", [this](const httplib::Request& req, httplib::Response& res) {
+            serverDownloadMapRequest(req, res);
+        });
+        svr.Get("/bundle", [this](const httplib::Request& req, httplib::Response& res) {
+            serverDownloadBundleRequest(req, res);
+        });
+        svr.Get("/peer", [this](const httplib::Request& req, httplib::Response& res) {
+            serverRegisterPeerRequest(req, res);
+        });
 
         if (!svr.bind_to_port(host.c_str(), port, socket_flags)) {
             BM_ERROR_LOG("Failed to bind match file server to port {:d}", port);
             return;
         }
+        if (onBound != nullptr) {
+            onBound();
+        }
 
         if (svr.listen_after_bind()) {
             BM_INFO_LOG("Stopping match file server");
@@ -35,15 +96,105 @@ MatchFileServer::MatchFileServer(const std::string& host, const int port, const
 }
 
 
-MatchFileServer::~MatchFileServer()
+/// <summary>Sets the beacon local network discovery queries are answered with.</summary>
+/// <remarks>Peers do not answer queries.</remarks>
+/// <param name="beacon">Beacon of the hosted game, or nothing to stop answering</param>
+void MatchFileServer::SetLanBeacon(const std::optional<LanBeacon>& beacon)
 {
-    svr.stop();
-    if (serverThread.joinable()) {
-        serverThread.join();
+    if (lanResponder != nullptr) {
+        lanResponder->SetBeacon(beacon);
+    }
+}
+
+
+/// <summary>Sets the upload limits, the global rate is lowered while a match is active.</summary>
+/// <remarks>Limits per connection apply to new transfers.</remarks>
+/// <param name="limits">Upload limits</param>
+/// <param name="matchActive">Bool with if a match is active</param>
+void MatchFileServer::SetUploadLimits(const UploadLimits& limits, const bool matchActive)
+{
+    size_t rate = limits.Rate;
+    if (matchActive && limits.MatchRate > 0) {
+        rate = rate > 0 ? std::min(rate, limits.MatchRate) : limits.MatchRate;
+    }
+    if (uploadBucket.GetRate() != rate) {
+        BM_TRACE_LOG("upload rate set to {:d} bytes per second", rate);
+        uploadBucket.SetRate(rate);
+    }
+
+    const std::scoped_lock lock(transferMutex);
+    uploadLimits = limits;
+}
+
+
+/// <summary>Takes up a transfer slot for the given player.</summary>
+/// <remarks>The slot is counted by <see cref="MatchFileServer::beginTransfer"/>.</remarks>
+/// <param name="server">Server the player downloads from</param>
+/// <param name="client">Address of the player</param>
+/// <param name="connectionRate">Bytes per second for this connection, 0 for no limit</param>
+MatchFileServer::Transfer::Transfer(MatchFileServer& server, std::string client, const size_t connectionRate)
+    : server(server), client(std::move(client)), connectionBucket(connectionRate)
+{}
+
+
+MatchFileServer::Transfer::~Transfer()
+{
+    const std::scoped_lock lock(server.transferMutex);
+    const auto activeTransfer = server.activeTransfers.find(client);
+    if (activeTransfer != server.activeTransfers.end() && --activeTransfer->second == 0) {
+        server.activeTransfers.erase(activeTransfer);
     }
 }
 
 
+/// <summary>Gets how many bytes to hand to the socket at once.</summary>
+/// <param name="length">Bytes that are left to send</param>
+/// <returns>Bytes to send at once</returns>
+size_t MatchFileServer::Transfer::GetChunkSize(const size_t length)
+{
+    if (connectionBucket.GetRate() > 0 || server.uploadBucket.GetRate() > 0) {
+        return std::min(length, MAP_UPLOAD_SHAPED_CHUNK_SIZE);
+    }
+
+    return std::min(length, MAP_UPLOAD_CHUNK_SIZE);
+}
+
+
+/// <summary>Waits until the given amount of bytes fits in the global and the connection rate.</summary>
+/// <param name="bytes">Bytes that are about to be send</param>
+void MatchFileServer::Transfer::Throttle(const size_t bytes)
+{
+    const std::chrono::nanoseconds wait = std::max(server.uploadBucket.Reserve(bytes), connectionBucket.Reserve(bytes));
+    if (wait > std::chrono::nanoseconds::zero()) {
+        std::this_thread::sleep_for(wait);
+    }
+}
+
+
+/// <summary>Maps the compressed copy of the map.</summary>
+/// <param name="filePath">Path to the compressed copy, gets removed with the compressed map</param>
+MatchFileServer::CompressedMap::CompressedMap(std::filesystem::path filePath)
+    : filePath(std::move(filePath)), mappedFile(std::make_unique<MappedFile>(this->filePath))
+{}
+
+
+MatchFileServer::CompressedMap::~CompressedMap()
+{
+    // Unmap before removing, so the file is gone right away.
+    mappedFile.reset();
+    std::error_code ec;
+    std::filesystem::remove(filePath, ec);
+}
+
+
+/// <summary>Gets the mapping of the compressed copy.</summary>
+/// <returns>The mapping of the compressed copy</returns>
+const MappedFile& MatchFileServer::CompressedMap::GetMappedFile() const
+{
+    return *mappedFile;
+}
+
+
 std::string get_errno_str(errno_t error)
 {
     char errmsg[128];
@@ -95,32 +246,202 @@ std::string GetCurrentMapGuid()
 }
 
 
+std::vector<std::string> GetCurrentMapDependencies()
+{
+    BM_WARNING_LOG("redacted function");
+
+    return {};
+}
+
+
+/// <summary>Gets the status response of the current map, which is only build again when the map or its file changes.</summary>
+/// <remarks>
+/// A new response is build on its own thread, until it is done requests are answered with Service Unavailable and asked
+/// to retry after <see cref="MAP_STATUS_RETRY_AFTER"/>.
+/// </remarks>
+/// <param name="res">Response to set the error status of when there is no status response</param>
+/// <returns>The status response, or nullptr if it is still being build or the current map could not be loaded</returns>
+std::shared_ptr<const MatchFileServer::StatusResponse> MatchFileServer::getStatusResponse(httplib::Response& res)
+{
+    StatusKey key;
+    key.MapName = servedMap ? servedMap->MapName : GetCurrentMapName();
+    key.Guid = servedMap ? servedMap->Guid : GetCurrentMapGuid();
+    key.FilePath = servedMap ? servedMap->FilePath : get_map_file_path(to_wstring(key.MapName));
+    key.FileSize = get_file_size(key.FilePath);
+    if (key.FileSize == 0) {
+        BM_ERROR_LOG("{:s} could not be loaded.", quote(key.MapName));
+        res.status = 503;  // Service Unavailable.
+        return nullptr;
+    }
+    std::error_code ec;
+    key.LastWriteTime = std::filesystem::last_write_time(key.FilePath, ec);
+
+    const std::scoped_lock lock(statusMutex);
+    if (statusResponse != nullptr && statusResponse->Key == key) {
+        return statusResponse;
+    }
+
+    if (pendingStatusResponse.valid() &&
+        pendingStatusResponse.wait_for(std::chrono::seconds::zero()) == std::future_status::ready) {
+        std::shared_ptr<const StatusResponse> response = pendingStatusResponse.get();
+        if (response != nullptr) {
+            statusResponse = std::move(response);
+            if (statusResponse->Key == key) {
+                return statusResponse;
+            }
+        }
+        else if (pendingStatusKey == key) {
+            // Build again on the next request, the map might be readable by then.
+            res.status = 503;  // Service Unavailable.
+            return nullptr;
+        }
+    }
+
+    // A build for a map that is no longer current finishes first, so there is only one build at a time.
+    if (!pendingStatusResponse.valid()) {
+        BM_TRACE_LOG("building status of {:s}", quote(key.MapName));
+        pendingStatusKey = key;
+        const std::vector<std::string> dependencyNames = servedMap ? std::vector<std::string>() : GetCurrentMapDependencies();
+        pendingStatusResponse = save_promise<std::shared_ptr<const StatusResponse>>("StatusResponse", [key, dependencyNames]() {
+            return buildStatusResponse(key, dependencyNames);
+        });
+    }
+
+    res.status = 503;  // Service Unavailable.
+    res.set_header("Retry-After", std::to_string(MAP_STATUS_RETRY_AFTER.count()));
+    return nullptr;
+}
+
+
+/// <summary>Builds the status response of the given map, by hashing the map and its dependencies and compressing the map.</summary>
+/// <param name="key">Map to build the status response of</param>
+/// <param name="dependencyNames">Names of the dependencies of the map</param>
+/// <returns>The status response, or nullptr if the map could not be loaded</returns>
+std::shared_ptr<const MatchFileServer::StatusResponse> MatchFileServer::buildStatusResponse(const StatusKey& key,
+    const std::vector<std::string>& dependencyNames)
+{
+    const MappedFile mappedFile(key.FilePath);
+    if (!mappedFile.IsOpen()) {
+        BM_ERROR_LOG("{:s} could not be loaded.", quote(key.MapName));
+        return nullptr;
+    }
+
+    StatusResponse response;
+    response.Key = key;
+
+    // Hash the whole map and every chunk in one walk over the mapping, so each chunk is hashed twice while it is paged in.
+    Sha256 mapHash;
+    std::string chunkHashes;
+    for (size_t offset = 0; offset < mappedFile.GetSize(); offset += MAP_CHUNK_SIZE) {
+        const std::string_view chunk = mappedFile.GetData(offset, MAP_CHUNK_SIZE);
+        mapHash.Update(chunk);
+        chunkHashes += (chunkHashes.empty() ? "" : ", ") + quote(Sha256::Hash(chunk));
+    }
+    response.Hash = mapHash.Finish();
+    response.Files.emplace(response.Hash, key.FilePath);
+
+    // Clients save the dependencies next to the map, under their file name.
+    std::string dependencies;
+    for (const std::string& dependency : dependencyNames) {
+        const std::filesystem::path dependencyPath = get_map_file_path(to_wstring(dependency));
+        const size_t dependencySize = get_file_size(dependencyPath);
+        const std::string dependencyHash = dependencySize > 0 ? Sha256::HashFile(dependencyPath) : "";
+        if (dependencyHash.empty()) {
+            BM_WARNING_LOG("Dependency {:s} could not be loaded.", quote(dependency));
+            continue;
+        }
+        dependencies += fmt::format(R"({:s}{{"MapName": {:s}, "FileSize": {:d}, "Hash": {:s}}})",
+            dependencies.empty() ? "" : ", ", quote(dependencyPath.filename().string()), dependencySize, quote(dependencyHash));
+        response.Files.emplace(dependencyHash, dependencyPath);
+    }
+
+    // Upload bandwidth of the host is usually the bottleneck, so clients that support it get a compressed copy.
+    // The copy is written to a temporary file a block at a time, so it does not take as much memory as the map itself.
+    // Builds of the same map can overlap with downloads of the previous copy, so every copy gets its own file.
+    static std::atomic<size_t> compressedCopies = 0;
+    std::error_code ec;
+    const std::filesystem::path compressedPath = std::filesystem::temp_directory_path(ec) /
+        (std::filesystem::path(fmt::format("{:s}_{:d}", response.Hash, compressedCopies++)) += MAP_COMPRESSED_EXTENSION);
+    std::ofstream compressedFile(compressedPath, std::ios::binary | std::ios::trunc);
+    std::string block;
+    size_t compressedSize = 0;
+    for (size_t offset = 0; offset < mappedFile.GetSize() && compressedSize < mappedFile.GetSize() && compressedFile.good();
+         offset += RP_COMPRESSION_BLOCK_SIZE) {
+        block.clear();
+        compressedSize += lz_compress_block(mappedFile.GetData(offset, RP_COMPRESSION_BLOCK_SIZE), block);
+        compressedFile.write(block.data(), static_cast<std::streamsize>(block.size()));
+    }
+    compressedFile.close();
+    if (!ec && !compressedFile.fail() && compressedSize < mappedFile.GetSize()) {
+        response.Compressed = std::make_shared<const CompressedMap>(compressedPath);
+    }
+    else {
+        std::filesystem::remove(compressedPath, ec);
+    }
+    if (response.Compressed != nullptr && response.Compressed->GetMappedFile().GetSize() == compressedSize) {
+        BM_TRACE_LOG("compressed {:s} from {:d} to {:d} bytes", quote(key.MapName), mappedFile.GetSize(), compressedSize);
+        response.CompressedSize = compressedSize;
+    }
+    else {
+        response.Compressed = nullptr;
+    }
+    response.Metadata = fmt::format(R"("Version": {:s}, "CurrentMap": {:s}, "FileSize": {:d}, "Guid": {:s}, "Hash": {:s}, )"
+        R"("CompressedSize": {:d}, "ChunkSize": {:d}, "ChunkHashes": [{:s}], "Dependencies": [{:s}])", quote(PLUGIN_VERSION),
+        quote(key.MapName), key.FileSize, quote(key.Guid), quote(response.Hash), response.CompressedSize, MAP_CHUNK_SIZE,
+        chunkHashes, dependencies);
+    formatStatusBody(response);
+
+    return std::make_shared<const StatusResponse>(std::move(response));
+}
+
+
+/// <summary>Formats the body of the status response from its metadata and peers.</summary>
+/// <param name="response">Status response to format the body of</param>
+void MatchFileServer::formatStatusBody(StatusResponse& response)
+{
+    std::string peers;
+    for (const auto& [peerHost, peerPort] : response.Peers) {
+        peers += fmt::format(R"({:s}{{"Host": {:s}, "Port": {:d}}})", peers.empty() ? "" : ", ", quote(peerHost), peerPort);
+    }
+
+    response.Body = fmt::format(R"({{{:s}, "Peers": [{:s}]}})", response.Metadata, peers);
+    response.ETag = quote(Sha256::Hash(response.Body).substr(0, 32));
+    BM_TRACE_LOG("status: {:s}", response.Body);
+}
+
+
 void MatchFileServer::serverStatusRequest(const httplib::Request& req, httplib::Response& res)
 {
     BM_TRACE_LOG("incomming request from {:s}:{:d}", req.remote_addr, req.remote_port);
 
-    if (!Outer()->IsHostingLocalGame()) {
+    if (!servedMap && !Outer()->IsHostingLocalGame()) {
         BM_ERROR_LOG("Could not find local game.");
         res.status = 503;  // Service Unavailable.
         return;
     }
     
-    const std::string currentMap = GetCurrentMapName();
-    const std::string currentMapGuid = GetCurrentMapGuid();
+    const std::shared_ptr<const StatusResponse> currentStatus = getStatusResponse(res);
+    if (currentStatus == nullptr) {
+        return;
+    }
 
-    const std::filesystem::path filePath = get_map_file_path(to_wstring(currentMap));
-    const size_t fileSize = get_file_size(filePath);
-    if (fileSize == 0) {
-        BM_ERROR_LOG("{:s} could not be loaded.", quote(currentMap));
-        res.status = 503;  // Service Unavailable.
+    res.set_header("Cache-Control", "no-cache");
+    // Queued players get their own position, which is not cached.
+    const size_t queuePosition = getQueuePosition(req.remote_addr);
+    if (queuePosition > 0) {
+        res.set_content(fmt::format(R"({{"QueuePosition": {:d}, {:s})", queuePosition, currentStatus->Body.substr(1)), "application/json");
         return;
     }
 
-    const std::string body = fmt::format(R"({{"Version": {:s}, "CurrentMap": {:s}, "FileSize": {:d}, "Guid": {:s}}})",
-        quote(PLUGIN_VERSION), quote(currentMap), fileSize, quote(currentMapGuid));
-    BM_TRACE_LOG("response: {:s}", body);
+    // The response only changes with the map, so clients that poll can revalidate without getting the body again.
+    res.set_header("ETag", currentStatus->ETag);
+    const std::string ifNoneMatch = req.get_header_value("If-None-Match");
+    if (ifNoneMatch == "*" || ifNoneMatch.find(currentStatus->ETag) != std::string::npos) {
+        res.status = 304;  // Not Modified.
+        return;
+    }
 
-    res.set_content(body, "application/json");
+    res.set_content(currentStatus->Body, "application/json");
 }
 
 
@@ -128,61 +449,282 @@ void MatchFileServer::serverDownloadMapRequest(const httplib::Request& req, http
 {
     BM_TRACE_LOG("incomming request from {:s}:{:d}", req.remote_addr, req.remote_port);
 
-    if (Outer()->GetGame().IsNull()) {
+    if (!servedMap && Outer()->GetGame().IsNull()) {
         BM_ERROR_LOG("Could not find local game.");
         res.status = 503;  // Service Unavailable.
         return;
     }
 
-    const std::string currentMap = GetCurrentMapName();
-    if (currentMap.empty()) {
-        BM_ERROR_LOG("Could not find current map.");
-        res.status = 503;  // Service Unavailable.
+    const std::shared_ptr<const StatusResponse> currentStatus = getStatusResponse(res);
+    if (currentStatus == nullptr) {
         return;
     }
 
-    const std::filesystem::path filePath = get_map_file_path(to_wstring(currentMap));
-    if (filePath.empty()) {
-        BM_ERROR_LOG("Current map file could not be loaded.");
-        res.status = 503;  // Service Unavailable.
+    const std::filesystem::path& filePath = currentStatus->Key.FilePath;
+    // Kept alive by the content provider, unmapped when the response is done.
+    const std::shared_ptr<MappedFile> mappedFile = std::make_shared<MappedFile>(filePath);
+    if (!mappedFile->IsOpen()) {
+        BM_ERROR_LOG("Could not open the current map file");
+        res.status = 500;  // Internal Server Error
         return;
     }
 
-    int fd = 0;
-    const errno_t error = _wsopen_s(&fd, filePath.c_str(), _O_RDONLY | _O_BINARY, _SH_DENYNO, NULL);
-    if (error) {
-        BM_ERROR_LOG("Could not open the current map file");
-        BM_DEBUG_ERROR_LOG("_wsopen_s: {:s}", get_errno_str(error));
-        res.status = 500;  // Internal Server Error
+    // Kept alive by the content provider, the slot is given back when the response is done.
+    const std::shared_ptr<Transfer> transfer = beginTransfer(req, res);
+    if (transfer == nullptr) {
         return;
     }
 
-    struct _stati64 stats{};
-    if (_fstati64(fd, &stats) == -1) {
-        BM_ERROR_LOG("Could not access the current map file");
-        BM_DEBUG_ERROR_LOG("_fstati64: {:s}", get_errno_str(errno));
-        res.status = 500;  // Internal Server Error
+    // Clients that can decompress the map get the compressed copy, ranges are then in the compressed copy.
+    res.set_header("Vary", "Accept-Encoding");
+    if (currentStatus->CompressedSize > 0 &&
+        req.get_header_value("Accept-Encoding").find(MAP_CONTENT_ENCODING) != std::string::npos) {
+        res.set_header("Accept-Ranges", "bytes");
+        res.set_header("Content-Encoding", MAP_CONTENT_ENCODING);
+        res.set_content_provider(
+            currentStatus->CompressedSize,  // Content length
+            "application/octet-stream",  // Content type
+            [compressed = currentStatus->Compressed, transfer](const size_t offset, const size_t length, httplib::DataSink& sink) {
+                const std::string_view chunk = compressed->GetMappedFile().GetData(offset, transfer->GetChunkSize(length));
+                if (chunk.empty()) {
+                    BM_ERROR_LOG("Could not read the compressed map at {:d}", offset);
+                    return false;
+                }
+                transfer->Throttle(chunk.size());
+                sink.write(chunk.data(), chunk.size());
+                return true;
+            }
+        );
+
+        BM_TRACE_LOG("uploading compressed: {:s}", currentStatus->Key.MapName);
         return;
     }
 
+    // Range requests are handled by httplib, which passes the start of the range as offset to the content provider.
+    res.set_header("Accept-Ranges", "bytes");
     res.set_content_provider(
-        stats.st_size,  // Content length
+        mappedFile->GetSize(),  // Content length
         "application/octet-stream",  // Content type
-        [fd](size_t /*offset*/, const size_t length, httplib::DataSink& sink) {
-            //_seek(fd, offset);
-            std::vector<char> data(length);
-            if (_read(fd, data.data(), static_cast<unsigned int>(length)) <= 0) {
-                BM_ERROR_LOG("Could not read the current map file");
-                BM_DEBUG_ERROR_LOG("_read: {:s}", get_errno_str(errno));
+        [mappedFile, transfer](const size_t offset, const size_t length, httplib::DataSink& sink) {
+            // Write straight from the mapping, in chunks so a slow client does not hold on to the whole file.
+            const std::string_view chunk = mappedFile->GetData(offset, transfer->GetChunkSize(length));
+            if (chunk.empty()) {
+                BM_ERROR_LOG("Could not read the current map file at {:d}", offset);
                 return false;
             }
-            sink.write(data.data(), length);
+            transfer->Throttle(chunk.size());
+            sink.write(chunk.data(), chunk.size());
             return true; // return 'false' if you want to cancel the process.
-        },
-        [fd](bool /*success*/) { _close(fd); }
+        }
+    );
+
+    BM_TRACE_LOG("uploading: {:s}", currentStatus->Key.MapName);
+}
+
+
+/// <summary>Streams the requested files of the current map back to back, so all missing dependencies take one request.</summary>
+/// <remarks>
+/// Files are requested by their hash in the comma separated files parameter, and are send as
+/// [hash: <see cref="MAP_BUNDLE_HASH_SIZE"/> bytes] [size: 8 bytes] [data].
+/// </remarks>
+void MatchFileServer::serverDownloadBundleRequest(const httplib::Request& req, httplib::Response& res)
+{
+    BM_TRACE_LOG("incomming request from {:s}:{:d}", req.remote_addr, req.remote_port);
+
+    if (!servedMap && Outer()->GetGame().IsNull()) {
+        BM_ERROR_LOG("Could not find local game.");
+        res.status = 503;  // Service Unavailable.
+        return;
+    }
+
+    const std::shared_ptr<const StatusResponse> currentStatus = getStatusResponse(res);
+    if (currentStatus == nullptr) {
+        return;
+    }
+
+    struct BundleFile
+    {
+        std::string Hash;
+        std::shared_ptr<MappedFile> File;
+    };
+    // Kept alive by the content provider, unmapped when the response is done.
+    const std::shared_ptr<std::vector<BundleFile>> bundle = std::make_shared<std::vector<BundleFile>>();
+    const std::string files = req.get_param_value("files");
+    size_t contentLength = 0;
+    for (size_t start = 0; start < files.size();) {
+        const size_t end = std::min(files.find(',', start), files.size());
+        const std::string hash = files.substr(start, end - start);
+        start = end + 1;
+
+        const auto file = currentStatus->Files.find(hash);
+        if (file == currentStatus->Files.end() || bundle->size() >= currentStatus->Files.size()) {
+            BM_ERROR_LOG("Requested file {:s} is not part of the current map", quote(hash));
+            res.status = 404;  // Not Found.
+            return;
+        }
+        const std::shared_ptr<MappedFile> mappedFile = std::make_shared<MappedFile>(file->second);
+        if (!mappedFile->IsOpen()) {
+            BM_ERROR_LOG("Could not open {:s}", quote(file->second.string()));
+            res.status = 500;  // Internal Server Error
+            return;
+        }
+        contentLength += MAP_BUNDLE_HEADER_SIZE + mappedFile->GetSize();
+        bundle->push_back({ hash, mappedFile });
+    }
+
+    // Kept alive by the content provider, the slot is given back when the response is done.
+    const std::shared_ptr<Transfer> transfer = beginTransfer(req, res);
+    if (transfer == nullptr) {
+        return;
+    }
+
+    res.set_content_provider(
+        contentLength,  // Content length
+        "application/octet-stream",  // Content type
+        [bundle, transfer](const size_t offset, const size_t length, httplib::DataSink& sink) {
+            size_t fileStart = 0;
+            for (const BundleFile& bundleFile : *bundle) {
+                const size_t fileSize = bundleFile.File->GetSize();
+                if (offset >= fileStart + MAP_BUNDLE_HEADER_SIZE + fileSize) {
+                    fileStart += MAP_BUNDLE_HEADER_SIZE + fileSize;
+                    continue;
+                }
+
+                if (offset < fileStart + MAP_BUNDLE_HEADER_SIZE) {
+                    std::string header = bundleFile.Hash;
+                    header.resize(MAP_BUNDLE_HEADER_SIZE);
+                    write_le<uint64_t>(header.data() + MAP_BUNDLE_HASH_SIZE, fileSize);
+                    sink.write(header.data() + (offset - fileStart), MAP_BUNDLE_HEADER_SIZE - (offset - fileStart));
+                    return true;
+                }
+
+                const std::string_view chunk = bundleFile.File->GetData(offset - fileStart - MAP_BUNDLE_HEADER_SIZE,
+                    transfer->GetChunkSize(length));
+                if (chunk.empty()) {
+                    BM_ERROR_LOG("Could not read the bundle at {:d}", offset);
+                    return false;
+                }
+                transfer->Throttle(chunk.size());
+                sink.write(chunk.data(), chunk.size());
+                return true;
+            }
+
+            return false;
+        }
     );
 
-    BM_TRACE_LOG("uploading: {:s}", currentMap);
+    BM_TRACE_LOG("uploading bundle of {:d} files", bundle->size());
+}
+
+
+/// <summary>Gives the requesting player a transfer slot, or queues them when all slots are taken.</summary>
+/// <remarks>
+/// All connections of a player share their slot. Queued players are told to retry later, and keep their place as long
+/// as they keep asking within <see cref="MAP_TRANSFER_QUEUE_TIMEOUT"/>.
+/// </remarks>
+/// <returns>The transfer, or nullptr if the player is queued</returns>
+std::shared_ptr<MatchFileServer::Transfer> MatchFileServer::beginTransfer(const httplib::Request& req, httplib::Response& res)
+{
+    const auto now = std::chrono::steady_clock::now();
+    std::unique_lock lock(transferMutex);
+    std::erase_if(transferQueue, [now](const QueuedClient& queuedClient) {
+        return now - queuedClient.LastSeen > MAP_TRANSFER_QUEUE_TIMEOUT;
+    });
+
+    auto queuedClient = std::ranges::find(transferQueue, req.remote_addr, &QueuedClient::Address);
+    const size_t position = static_cast<size_t>(queuedClient - transferQueue.begin());
+    const size_t maxTransfers = uploadLimits.MaxTransfers;
+    const size_t freeSlots = maxTransfers - std::min(activeTransfers.size(), maxTransfers);
+    if (maxTransfers > 0 && !activeTransfers.contains(req.remote_addr) && position >= freeSlots) {
+        if (queuedClient == transferQueue.end()) {
+            queuedClient = transferQueue.insert(transferQueue.end(), { req.remote_addr, now });
+        }
+        queuedClient->LastSeen = now;
+        BM_TRACE_LOG("queued {:s} at position {:d}", req.remote_addr, position + 1);
+        res.status = 503;  // Service Unavailable.
+        res.set_header("Retry-After", std::to_string(MAP_TRANSFER_RETRY_AFTER.count()));
+        return nullptr;
+    }
+
+    if (queuedClient != transferQueue.end()) {
+        transferQueue.erase(queuedClient);
+    }
+    activeTransfers[req.remote_addr]++;
+    const size_t connectionRate = uploadLimits.ConnectionRate;
+    lock.unlock();
+
+    return std::make_shared<Transfer>(*this, req.remote_addr, connectionRate);
+}
+
+
+/// <summary>Gets the position of the given player in the transfer queue, which keeps their place.</summary>
+/// <param name="client">Address of the player</param>
+/// <returns>Position in the queue starting at 1, 0 if the player is not queued</returns>
+size_t MatchFileServer::getQueuePosition(const std::string& client)
+{
+    const std::scoped_lock lock(transferMutex);
+    const auto queuedClient = std::ranges::find(transferQueue, client, &QueuedClient::Address);
+    if (queuedClient == transferQueue.end()) {
+        return 0;
+    }
+    queuedClient->LastSeen = std::chrono::steady_clock::now();
+
+    return static_cast<size_t>(queuedClient - transferQueue.begin()) + 1;
+}
+
+
+/// <summary>Registers the requesting player as peer that serves the current map to other players.</summary>
+/// <remarks>Peers are advertised in the status until the map changes, clients verify everything they get from them.</remarks>
+void MatchFileServer::serverRegisterPeerRequest(const httplib::Request& req, httplib::Response& res)
+{
+    BM_TRACE_LOG("incomming request from {:s}:{:d}", req.remote_addr, req.remote_port);
+
+    const std::shared_ptr<const StatusResponse> currentStatus = getStatusResponse(res);
+    if (currentStatus == nullptr) {
+        return;
+    }
+
+    const std::string portParam = req.get_param_value("port");
+    char* portEnd = nullptr;
+    const int peerPort = static_cast<int>(std::strtol(portParam.c_str(), &portEnd, 10));
+    if (portParam.empty() || *portEnd != '\0' || !Networking::IsValidPort(peerPort)) {
+        res.status = 400;  // Bad Request.
+        return;
+    }
+
+    const std::scoped_lock lock(statusMutex);
+    if (statusResponse == nullptr || req.get_param_value("hash") != statusResponse->Hash) {
+        BM_WARNING_LOG("Peer {:s}:{:d} does not have the current map", req.remote_addr, peerPort);
+        res.status = 409;  // Conflict.
+        return;
+    }
+
+    StatusResponse response = *statusResponse;
+    const std::pair<std::string, int> peer = { req.remote_addr, peerPort };
+    std::erase(response.Peers, peer);
+    if (response.Peers.size() >= MAP_MAX_PEERS) {
+        response.Peers.erase(response.Peers.begin());
+    }
+    response.Peers.push_back(peer);
+    formatStatusBody(response);
+    statusResponse = std::make_shared<const StatusResponse>(std::move(response));
+    BM_INFO_LOG("Registered peer {:s}:{:d}", peer.first, peer.second);
+
+    res.status = 204;  // No Content.
+}
+
+
+/// <summary>Gets how long the host asked to wait before retrying a request.</summary>
+/// <param name="response">Response of the host</param>
+/// <returns>Time to wait, or 0 if the host did not ask to retry</returns>
+std::chrono::seconds get_retry_after(const httplib::Response& response)
+{
+    if (response.status != 503 || !response.has_header("Retry-After")) {
+        return std::chrono::seconds::zero();
+    }
+
+    const std::string retryAfter = response.get_header_value("Retry-After");
+    return std::chrono::seconds(std::clamp<long long>(std::strtoll(retryAfter.c_str(), nullptr, 10), 1, 60));
 }
 
 
@@ -196,24 +738,56 @@ std::future<MatchFileServer::ServerStatus> MatchFileServer::GetServerStatus(cons
             return serverStatus;
         }
 
+        // Last status body per host, revalidated with its ETag so polling hosts do not send the body again.
+        static std::mutex statusCacheMutex;
+        static std::unordered_map<std::string, std::pair<std::string, std::string>> statusCache;
+        const std::string statusCacheKey = fmt::format("{:s}:{:d}", host, port);
+        std::pair<std::string, std::string> cachedStatus;
+        {
+            const std::scoped_lock lock(statusCacheMutex);
+            cachedStatus = statusCache[statusCacheKey];
+        }
+        auto& [cachedETag, cachedBody] = cachedStatus;
+
         httplib::Client cli(host, port);
 
-        const httplib::Result res = cli.Get("/status");
+        httplib::Headers headers;
+        if (!cachedETag.empty()) {
+            headers.emplace("If-None-Match", cachedETag);
+        }
+        httplib::Result res = cli.Get("/status", headers);
+        // The host builds the status of a new map on its own thread, and asks to retry until it is done.
+        const auto statusDeadline = std::chrono::steady_clock::now() + MAP_STATUS_TIMEOUT;
+        while (res.error() == httplib::Error::Success && res != nullptr) {
+            const std::chrono::seconds retryAfter = get_retry_after(*res);
+            if (retryAfter == std::chrono::seconds::zero() || std::chrono::steady_clock::now() + retryAfter > statusDeadline) {
+                break;
+            }
+            BM_TRACE_LOG("waiting {:d} seconds for the host to build its status", retryAfter.count());
+            std::this_thread::sleep_for(retryAfter);
+            res = cli.Get("/status", headers);
+        }
         if (res.error() != httplib::Error::Success || res == nullptr) {
             BM_ERROR_LOG("Could not get the host status: {:s}", httplib::to_string(res.error()));
             return serverStatus;
         }
-        if (res->status != 200) {
+        if (res->status == 200) {
+            cachedETag = res->get_header_value("ETag");
+            cachedBody = res->body;
+            const std::scoped_lock lock(statusCacheMutex);
+            statusCache[statusCacheKey] = cachedStatus;
+        }
+        else if (res->status != 304 || cachedBody.empty()) {
             BM_ERROR_LOG("Host status returned: {:s}", httplib::detail::status_message(res->status));
             return serverStatus;
         }
 
-        BM_TRACE_LOG("{:s}", res->body);
+        BM_TRACE_LOG("{:s}", cachedBody);
 
         serverStatus.Online = true;
 
         simdjson::ondemand::parser parser;
-        const simdjson::padded_string paddedData = res->body;
+        const simdjson::padded_string paddedData = cachedBody;
         simdjson::ondemand::document doc = parser.iterate(paddedData);
 
         const auto version = doc["Version"].get_string();
@@ -222,6 +796,12 @@ std::future<MatchFileServer::ServerStatus> MatchFileServer::GetServerStatus(cons
             return serverStatus;
         }
         serverStatus.Version = version.value_unsafe();
+
+        const auto queuePosition = doc["QueuePosition"].get_uint64();
+        if (!queuePosition.error()) {
+            serverStatus.QueuePosition = queuePosition.value_unsafe();
+            BM_INFO_LOG("Waiting for the host to send the map, position {:d} in the queue", serverStatus.QueuePosition);
+        }
         if (serverStatus.Version != PLUGIN_VERSION) {
             BM_WARNING_LOG("Server version does not match your clients version, {:s} != {:s}", serverStatus.Version, PLUGIN_VERSION);
         }
@@ -247,6 +827,65 @@ std::future<MatchFileServer::ServerStatus> MatchFileServer::GetServerStatus(cons
         }
         serverStatus.CurrentMap.Guid = guid.value_unsafe();
 
+        // Hosts running an older version do not send a hash, their maps are not cached.
+        const auto hash = doc["Hash"].get_string();
+        if (!hash.error()) {
+            serverStatus.CurrentMap.Hash = hash.value_unsafe();
+            serverStatus.CurrentMap.Cached = Outer()->mapCache.Contains(serverStatus.CurrentMap.Guid, serverStatus.CurrentMap.Hash);
+        }
+
+        const auto compressedSize = doc["CompressedSize"].get_uint64();
+        if (!compressedSize.error()) {
+            serverStatus.CurrentMap.CompressedSize = compressedSize.value_unsafe();
+        }
+
+        const auto chunkSize = doc["ChunkSize"].get_uint64();
+        if (!chunkSize.error()) {
+            serverStatus.CurrentMap.ChunkSize = chunkSize.value_unsafe();
+        }
+
+        try {
+            auto chunkHashes = doc["ChunkHashes"].get_array();
+            if (!chunkHashes.error()) {
+                for (simdjson::ondemand::value chunkHash : chunkHashes) {
+                    serverStatus.CurrentMap.ChunkHashes.emplace_back(std::string_view(chunkHash.get_string()));
+                }
+            }
+            // Chunk hashes that do not cover the map can not be used.
+            const size_t chunkCount = serverStatus.CurrentMap.ChunkSize > 0 ?
+                (serverStatus.CurrentMap.FileSize + serverStatus.CurrentMap.ChunkSize - 1) / serverStatus.CurrentMap.ChunkSize : 0;
+            if (serverStatus.CurrentMap.ChunkHashes.size() != chunkCount) {
+                serverStatus.CurrentMap.ChunkSize = 0;
+                serverStatus.CurrentMap.ChunkHashes.clear();
+            }
+
+            auto dependencies = doc["Dependencies"].get_array();
+            if (!dependencies.error()) {
+                for (simdjson::ondemand::object dependency : dependencies) {
+                    ServerStatus::MapStatus dependencyStatus;
+                    dependencyStatus.MapName = std::string_view(dependency["MapName"].get_string());
+                    dependencyStatus.FileSize = dependency["FileSize"].get_uint64();
+                    dependencyStatus.Hash = std::string_view(dependency["Hash"].get_string());
+                    dependencyStatus.Cached = Outer()->mapCache.Contains(dependencyStatus.Guid, dependencyStatus.Hash);
+                    serverStatus.Dependencies.push_back(std::move(dependencyStatus));
+                }
+            }
+
+            auto peers = doc["Peers"].get_array();
+            if (!peers.error()) {
+                for (simdjson::ondemand::object peer : peers) {
+                    ServerStatus::Peer peerStatus;
+                    peerStatus.Host = std::string_view(peer["Host"].get_string());
+                    peerStatus.Port = static_cast<int>(peer["Port"].get_int64());
+                    serverStatus.CurrentMap.Peers.push_back(std::move(peerStatus));
+                }
+            }
+        }
+        catch (const simdjson::simdjson_error& e) {
+            BM_ERROR_LOG("Invalid map status in server status.\n{:s}", e.what());
+            return serverStatus;
+        }
+
         BM_WARNING_LOG("redacted function");
         serverStatus.CurrentMap.Loaded = false;
 
@@ -255,43 +894,789 @@ std::future<MatchFileServer::ServerStatus> MatchFileServer::GetServerStatus(cons
 }
 
 
-std::future<bool> MatchFileServer::DownloadMap(const std::string& host, const int port, const std::filesystem::path& filePath, float* downloadStatus)
+/// <summary>Registers at the host the map came from, as peer that serves the map to other players.</summary>
+/// <param name="originHost">Host of the match file server the map came from</param>
+/// <param name="originPort">Port of the match file server the map came from</param>
+/// <param name="port">Port the peer serves the map on</param>
+/// <param name="hash">Hash of the served map</param>
+/// <returns>Bool with if the host registered the peer</returns>
+bool MatchFileServer::registerPeer(const std::string& originHost, const int originPort, const int port, const std::string& hash)
+{
+    httplib::Client cli(originHost, originPort);
+    const httplib::Result res = cli.Get(fmt::format("/peer?port={:d}&hash={:s}", port, hash).c_str());
+    if (res == nullptr || res.error() != httplib::Error::Success) {
+        BM_ERROR_LOG("Could not register as peer: {:s}", httplib::to_string(res.error()));
+        return false;
+    }
+    if (res->status != 204) {
+        BM_ERROR_LOG("Host status returned: {:s}", httplib::detail::status_message(res->status));
+        return false;
+    }
+
+    BM_TRACE_LOG("Registered as peer at {:s}:{:d}", originHost, originPort);
+
+    return true;
+}
+
+
+/// <summary>Gets the path a dependency is saved to, next to the map.</summary>
+/// <param name="directory">Directory of the map</param>
+/// <param name="fileName">File name of the dependency, as send by the host</param>
+/// <returns>Path to save the dependency to, or an empty path if the name is not a plain file name</returns>
+std::filesystem::path get_dependency_path(const std::filesystem::path& directory, const std::string& fileName)
+{
+    const std::filesystem::path dependencyPath = to_wstring(fileName);
+    if (!dependencyPath.has_filename() || dependencyPath.filename() != dependencyPath ||
+        dependencyPath == "." || dependencyPath == "..") {
+        return {};
+    }
+
+    return directory / dependencyPath;
+}
+
+
+/// <summary>Downloads the given files of the current map of the host in a single bundle.</summary>
+/// <remarks>Every file is checked against its hash and added to the map cache.</remarks>
+/// <param name="host">Host of the match file server</param>
+/// <param name="port">Port of the match file server</param>
+/// <param name="directory">Directory to save the files in</param>
+/// <param name="files">Status of the files to download</param>
+/// <returns>Bool with if all files were downloaded</returns>
+bool MatchFileServer::downloadBundle(const std::string& host, const int port, const std::filesystem::path& directory,
+    const std::vector<ServerStatus::MapStatus>& files)
+{
+    std::string hashes;
+    for (const ServerStatus::MapStatus& file : files) {
+        hashes += (hashes.empty() ? "" : ",") + file.Hash;
+    }
+
+    std::string header;
+    const ServerStatus::MapStatus* currentFile = nullptr;
+    std::filesystem::path currentPath;
+    std::ofstream currentStream;
+    std::unique_ptr<Sha256> currentHash;
+    size_t remaining = 0;
+    size_t received = 0;
+    std::error_code ec;
+    const auto finishFile = [&]() -> bool {
+        const std::filesystem::path partPath = std::filesystem::path(currentPath) += MAP_DOWNLOAD_PART_EXTENSION;
+        currentStream.close();
+        if (currentStream.fail() || currentHash->Finish() != currentFile->Hash) {
+            BM_ERROR_LOG("Downloaded {:s} does not match the hash of the host", quote(currentFile->MapName));
+            std::filesystem::remove(partPath, ec);
+            return false;
+        }
+        std::filesystem::rename(partPath, currentPath, ec);
+        if (ec) {
+            BM_ERROR_LOG("Could not move {:s} to {:s}, {:s}", quote(currentFile->MapName), quote(currentPath.string()), quote(ec.message()));
+            return false;
+        }
+        Outer()->mapCache.Insert(currentFile->Guid, currentFile->Hash, currentFile->MapName, currentPath);
+        currentFile = nullptr;
+        received++;
+        return true;
+    };
+
+    int status = 0;
+    std::chrono::seconds retryAfter = std::chrono::seconds::zero();
+    const auto onResponse = [&](const httplib::Response& response) -> bool {
+        status = response.status;
+        retryAfter = get_retry_after(response);
+        return status == 200;
+    };
+    const auto onData = [&](const char* data, const size_t data_length) -> bool {
+        std::string_view view(data, data_length);
+        while (!view.empty() || (currentFile != nullptr && remaining == 0)) {
+            if (currentFile == nullptr) {
+                const size_t headerLength = std::min(view.size(), MAP_BUNDLE_HEADER_SIZE - header.size());
+                header.append(view.substr(0, headerLength));
+                view.remove_prefix(headerLength);
+                if (header.size() < MAP_BUNDLE_HEADER_SIZE) {
+                    break;
+                }
+
+                const std::string hash = header.substr(0, MAP_BUNDLE_HASH_SIZE);
+                remaining = read_le<uint64_t>(header.data() + MAP_BUNDLE_HASH_SIZE);
+                header.clear();
+                const auto file = std::ranges::find_if(files, [&](const ServerStatus::MapStatus& requestedFile) {
+                    return requestedFile.Hash == hash && requestedFile.FileSize == remaining;
+                });
+                if (file == files.end()) {
+                    BM_ERROR_LOG("Received a file that was not requested");
+                    return false;
+                }
+                currentFile = &*file;
+                currentPath = get_dependency_path(directory, currentFile->MapName);
+                if (!currentPath.empty()) {
+                    currentStream.open(std::filesystem::path(currentPath) += MAP_DOWNLOAD_PART_EXTENSION, std::ios::binary | std::ios::trunc);
+                }
+                if (!currentStream.is_open()) {
+                    BM_ERROR_LOG("Could not open file: {:s}", quote(currentFile->MapName));
+                    return false;
+                }
+                currentHash = std::make_unique<Sha256>();
+                continue;
+            }
+
+            const std::string_view fileData = view.substr(0, remaining);
+            currentStream.write(fileData.data(), static_cast<std::streamsize>(fileData.size()));
+            currentHash->Update(fileData);
+            view.remove_prefix(fileData.size());
+            remaining -= fileData.size();
+            if (remaining == 0 && !finishFile()) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    httplib::Client cli(host, port);
+    const auto requestBundle = [&]() -> httplib::Result {
+        status = 0;
+        retryAfter = std::chrono::seconds::zero();
+        return cli.Get(fmt::format("/bundle?files={:s}", hashes).c_str(), onResponse, onData);
+    };
+    // Players that are queued by the host keep asking until it is their turn.
+    const auto queueDeadline = std::chrono::steady_clock::now() + MAP_DOWNLOAD_QUEUE_TIMEOUT;
+    httplib::Result res = requestBundle();
+    while (retryAfter > std::chrono::seconds::zero() && std::chrono::steady_clock::now() < queueDeadline) {
+        BM_TRACE_LOG("Dependencies are queued by the host, retrying in {:d}s", retryAfter.count());
+        std::this_thread::sleep_for(retryAfter);
+        res = requestBundle();
+    }
+    if (status != 0 && status != 200) {
+        BM_ERROR_LOG("Host status returned: {:s}", httplib::detail::status_message(status));
+        return false;
+    }
+    if (res == nullptr || res.error() != httplib::Error::Success) {
+        BM_ERROR_LOG("Could not download the dependencies: {:s}", httplib::to_string(res.error()));
+        return false;
+    }
+    if (received != files.size()) {
+        BM_ERROR_LOG("Received {:d} out of {:d} dependencies", received, files.size());
+        return false;
+    }
+
+    return true;
+}
+
+
+/// <summary>Reads the progress record of a partial map download.</summary>
+/// <param name="progressPath">Path to the progress record</param>
+/// <returns>The recorded progress, empty if there is no valid record</returns>
+MatchFileServer::DownloadProgress MatchFileServer::loadDownloadProgress(const std::filesystem::path& progressPath)
+{
+    std::ifstream file(progressPath);
+    if (!file.is_open()) {
+        return {};
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    try {
+        simdjson::ondemand::parser parser;
+        const simdjson::padded_string paddedData = data;
+        simdjson::ondemand::document doc = parser.iterate(paddedData);
+
+        DownloadProgress progress;
+        progress.Guid = std::string_view(doc["Guid"].get_string());
+        progress.FileSize = doc["FileSize"].get_uint64();
+        for (simdjson::ondemand::value received : doc["Received"].get_array()) {
+            progress.Received.push_back(received.get_uint64());
+        }
+        progress.CompressedSize = doc["CompressedSize"].get_uint64();
+        progress.Consumed = doc["Consumed"].get_uint64();
+        return progress;
+    }
+    catch (const simdjson::simdjson_error& e) {
+        BM_WARNING_LOG("Could not read download progress {:s}, {:s}", quote(progressPath.string()), e.what());
+    }
+
+    return {};
+}
+
+
+/// <summary>Writes the progress record of a partial map download.</summary>
+/// <param name="progressPath">Path to the progress record</param>
+/// <param name="progress">Progress to record</param>
+/// <returns>Bool with if the progress was saved</returns>
+bool MatchFileServer::saveDownloadProgress(const std::filesystem::path& progressPath, const DownloadProgress& progress)
+{
+    std::string received;
+    for (const size_t rangeReceived : progress.Received) {
+        received += (received.empty() ? "" : ", ") + std::to_string(rangeReceived);
+    }
+
+    std::ofstream file(progressPath, std::ios::trunc);
+    file << fmt::format(R"({{"Guid": {:s}, "FileSize": {:d}, "Received": [{:s}], "CompressedSize": {:d}, "Consumed": {:d}}})",
+        quote(progress.Guid), progress.FileSize, received, progress.CompressedSize, progress.Consumed);
+
+    return !file.fail();
+}
+
+
+std::future<bool> MatchFileServer::DownloadMap(const std::string& host, const int port, const std::filesystem::path& filePath,
+    const ServerStatus::MapStatus& map, const std::vector<ServerStatus::MapStatus>& dependencies, float* downloadStatus)
 {
     return save_promise<bool>("DownloadMap", [=]() -> bool {
-        BM_TRACE_LOG("Requesting server map");
-        std::ofstream file(filePath, std::ios::trunc | std::ios::binary);
+        // Dependencies that are not in the map cache are downloaded in a single bundle.
+        std::vector<ServerStatus::MapStatus> missingDependencies;
+        for (const ServerStatus::MapStatus& dependency : dependencies) {
+            const std::filesystem::path dependencyPath = get_dependency_path(filePath.parent_path(), dependency.MapName);
+            if (dependencyPath.empty()) {
+                BM_ERROR_LOG("Invalid dependency {:s}", quote(dependency.MapName));
+                return false;
+            }
+            if (!Outer()->mapCache.Restore(dependency.Guid, dependency.Hash, dependencyPath)) {
+                missingDependencies.push_back(dependency);
+            }
+        }
+        if (!missingDependencies.empty()) {
+            BM_TRACE_LOG("Requesting {:d} dependencies", missingDependencies.size());
+            if (!downloadBundle(host, port, filePath.parent_path(), missingDependencies)) {
+                return false;
+            }
+        }
+
+        if (Outer()->mapCache.Restore(map.Guid, map.Hash, filePath)) {
+            if (downloadStatus != nullptr) {
+                *downloadStatus = 1.f;
+            }
+        }
+        else {
+            BM_TRACE_LOG("Requesting server map");
+            if (!DownloadMapFile(host, port, filePath, map, MAP_DOWNLOAD_CONNECTIONS, downloadStatus)) {
+                return false;
+            }
+            BM_TRACE_LOG("Map download completed");
+
+            if (!map.Hash.empty()) {
+                // Maps with chunk hashes are verified while they are downloaded, others are read again to verify them.
+                if (map.ChunkHashes.empty() && Sha256::HashFile(filePath) != map.Hash) {
+                    BM_ERROR_LOG("Downloaded map does not match the hash of the host");
+                    std::error_code ec;
+                    std::filesystem::remove(filePath, ec);
+                    return false;
+                }
+                Outer()->mapCache.Insert(map.Guid, map.Hash, map.MapName, filePath);
+            }
+        }
+
+        BM_WARNING_LOG("redacted function");
+        BM_ERROR_LOG("Could not load the map, restart your game to load the map.");
+        return false;
+    });
+}
+
+
+/// <summary>Verifies the chunks of a map while it is written, so bad data is found without reading the map again.</summary>
+class ChunkVerifier
+{
+public:
+    ChunkVerifier(const MatchFileServer::ServerStatus::MapStatus& map, size_t offset, const std::filesystem::path& partPath);
+
+    bool Update(std::string_view data);
+    size_t GetChunk() const;
+
+private:
+    const MatchFileServer::ServerStatus::MapStatus& map;
+    size_t offset = 0;
+    std::unique_ptr<Sha256> chunkHash = std::make_unique<Sha256>();
+};
+
+
+/// <summary>Starts verifying at the given offset of the map.</summary>
+/// <remarks>Resumed downloads start halfway a chunk, so the part of the chunk that is already written is hashed first.</remarks>
+/// <param name="map">Status of the map with its chunk hashes</param>
+/// <param name="offset">Offset in the map the data starts at</param>
+/// <param name="partPath">Path to the partial download</param>
+ChunkVerifier::ChunkVerifier(const MatchFileServer::ServerStatus::MapStatus& map, const size_t offset,
+    const std::filesystem::path& partPath)
+    : map(map), offset(offset)
+{
+    const size_t chunkStart = offset - offset % map.ChunkSize;
+    if (chunkStart == offset) {
+        return;
+    }
+
+    const MappedFile partFile(partPath);
+    chunkHash->Update(partFile.GetData(chunkStart, offset - chunkStart));
+}
+
+
+/// <summary>Adds the next data of the map, every completed chunk is checked against its hash.</summary>
+/// <param name="data">Data that was written after the previous data</param>
+/// <returns>Bool with if all completed chunks match, <see cref="ChunkVerifier::GetChunk"/> is then the bad chunk</returns>
+bool ChunkVerifier::Update(std::string_view data)
+{
+    while (!data.empty()) {
+        const size_t chunk = offset / map.ChunkSize;
+        if (chunk >= map.ChunkHashes.size()) {
+            return false;
+        }
+        const size_t chunkEnd = std::min((chunk + 1) * map.ChunkSize, map.FileSize);
+        const std::string_view chunkData = data.substr(0, chunkEnd - offset);
+        chunkHash->Update(chunkData);
+        data.remove_prefix(chunkData.size());
+        offset += chunkData.size();
+        if (offset == chunkEnd) {
+            if (chunkHash->Finish() != map.ChunkHashes[chunk]) {
+                offset = chunk * map.ChunkSize;
+                return false;
+            }
+            chunkHash = std::make_unique<Sha256>();
+        }
+    }
+
+    return true;
+}
+
+
+/// <summary>Gets the chunk that is being verified.</summary>
+/// <returns>Index of the current chunk</returns>
+size_t ChunkVerifier::GetChunk() const
+{
+    return offset / map.ChunkSize;
+}
+
+
+/// <summary>Downloads the current map of the host, split in ranges that are fetched concurrently.</summary>
+/// <remarks>
+/// Partial downloads are kept next to the file with a progress record, so a dropped download resumes where it left off.
+/// When the host has a compressed copy of the map it is downloaded over a single connection and decompressed while
+/// it is received. Maps with chunk hashes are fetched per chunk from the host and its peers, every chunk is verified
+/// before it is written. Compressed maps are verified per chunk while they are decompressed, a bad chunk continues the
+/// download per chunk from there.
+/// </remarks>
+/// <param name="host">Host of the match file server</param>
+/// <param name="port">Port of the match file server</param>
+/// <param name="filePath">Path to save the map to</param>
+/// <param name="map">Status of the map to download</param>
+/// <param name="connections">Maximum number of concurrent connections</param>
+/// <param name="downloadStatus">Gets updated with the download progress between 0 and 1</param>
+/// <returns>Bool with if the map was downloaded</returns>
+bool MatchFileServer::DownloadMapFile(const std::string& host, const int port, const std::filesystem::path& filePath,
+    const ServerStatus::MapStatus& map, const size_t connections, float* downloadStatus)
+{
+    const std::filesystem::path partPath = std::filesystem::path(filePath) += MAP_DOWNLOAD_PART_EXTENSION;
+    const std::filesystem::path progressPath = std::filesystem::path(filePath) += MAP_DOWNLOAD_PROGRESS_EXTENSION;
+    // Chunks can be verified on their own, so they are fetched from peers as well. Chunks are fetched as is, so the
+    // compressed copy is only used when there are no peers to share the load with.
+    const bool chunked = !map.ChunkHashes.empty() && (!map.Peers.empty() || map.CompressedSize == 0);
+    const bool compressed = !chunked && map.CompressedSize > 0;
+    const size_t rangeCount = chunked ? map.ChunkHashes.size() : compressed ? 1 :
+        std::clamp<size_t>(map.FileSize / MAP_DOWNLOAD_MIN_RANGE_SIZE, 1, std::max<size_t>(connections, 1));
+
+    // Resume a previous download of the same map, the recorded progress never exceeds what was written to disk.
+    DownloadProgress progress = loadDownloadProgress(progressPath);
+    std::error_code ec;
+    const size_t partSize = std::filesystem::exists(partPath, ec) ? std::filesystem::file_size(partPath, ec) : 0;
+    if (progress.Guid != map.Guid || progress.FileSize != map.FileSize || progress.Received.size() != rangeCount ||
+        progress.CompressedSize != (compressed ? map.CompressedSize : 0) || partSize != map.FileSize) {
+        progress = { map.Guid, map.FileSize, std::vector<size_t>(rangeCount, 0), compressed ? map.CompressedSize : 0 };
+    }
+
+    // Preallocate the file, so every range can be written at its own position.
+    std::ofstream(partPath, std::ios::binary | std::ios::app).close();
+    std::filesystem::resize_file(partPath, map.FileSize, ec);
+    if (ec) {
+        BM_ERROR_LOG("Could not allocate {:s}, {:s}", quote(partPath.string()), quote(ec.message()));
+        return false;
+    }
+
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t totalReceived = 0;
+    for (size_t i = 0; i < rangeCount; i++) {
+        if (chunked) {
+            ranges.emplace_back(i * map.ChunkSize, std::min((i + 1) * map.ChunkSize, map.FileSize));
+        }
+        else {
+            ranges.emplace_back(map.FileSize * i / rangeCount, map.FileSize * (i + 1) / rangeCount);
+        }
+        progress.Received[i] = std::min(progress.Received[i], ranges[i].second - ranges[i].first);
+        // Chunks are only written once they are verified, anything less is left over from an older download.
+        if (chunked && progress.Received[i] != ranges[i].second - ranges[i].first) {
+            progress.Received[i] = 0;
+        }
+        totalReceived += progress.Received[i];
+    }
+    if (totalReceived > 0) {
+        BM_INFO_LOG("Resuming map download at {:d}/{:d} bytes", totalReceived, map.FileSize);
+    }
+
+    std::mutex progressMutex;
+    size_t lastRecorded = totalReceived;
+    // Progress that gets saved while ranges are downloading, a range only updates its entry after flushing its stream.
+    DownloadProgress flushedProgress = progress;
+    std::atomic<bool> rangesUnsupported = false;
+    std::atomic<bool> compressionUnsupported = false;
+    // Chunks before this one are verified, when the compressed copy turned out bad.
+    std::optional<size_t> badCompressedChunk;
+    // Players that are queued by the host keep asking until it is their turn.
+    const auto queueDeadline = std::chrono::steady_clock::now() + MAP_DOWNLOAD_QUEUE_TIMEOUT;
+    const auto downloadRange = [&](const size_t range) -> bool {
+        const auto [rangeStart, rangeEnd] = ranges[range];
+        std::fstream file(partPath, std::ios::in | std::ios::out | std::ios::binary);
         if (!file.is_open()) {
-            BM_ERROR_LOG("Could not open file: {:s}", filePath.string());
+            BM_ERROR_LOG("Could not open file: {:s}", partPath.string());
             return false;
         }
 
+        // Expects the progress mutex to be locked and the file to be flushed.
+        const auto saveFlushedProgress = [&] {
+            flushedProgress.Received[range] = progress.Received[range];
+            flushedProgress.Consumed = progress.Consumed;
+            saveDownloadProgress(progressPath, flushedProgress);
+        };
+        // Expects the progress mutex to be locked.
+        const auto restartRange = [&] {
+            totalReceived -= progress.Received[range];
+            lastRecorded = totalReceived;
+            progress.Received[range] = 0;
+            progress.Consumed = 0;
+            flushedProgress.Received[range] = 0;
+            flushedProgress.Consumed = 0;
+        };
+
         httplib::Client cli(host, port);
+        // The compressed copy is decompressed by us.
+        cli.set_decompress(false);
+        bool queued = false;
+        for (size_t attempt = 0; rangeStart + progress.Received[range] < rangeEnd; attempt++) {
+            if (attempt > MAP_DOWNLOAD_RETRIES) {
+                BM_ERROR_LOG("Giving up on the map download after {:d} retries", MAP_DOWNLOAD_RETRIES);
+                return false;
+            }
+            if (attempt > 0 && !queued) {
+                BM_WARNING_LOG("Map download dropped, resuming range {:d} at {:d}/{:d} bytes",
+                    range, progress.Received[range], rangeEnd - rangeStart);
+                std::this_thread::sleep_for(std::chrono::seconds(attempt));
+            }
 
-        httplib::Result res = cli.Get("/map",
-            [&file](const char* data, const size_t data_length) -> bool {
-                file.write(data, data_length);
-                return !file.fail();
-            },
-            [downloadStatus](const uint64_t current, const uint64_t total) -> bool {
-                BM_TRACE_LOG("{:d}/{:d}", current, total);
-                if (downloadStatus != nullptr) {
-                    *downloadStatus = static_cast<float>(current) / static_cast<float>(total);
+            size_t offset = rangeStart + progress.Received[range];
+            file.seekp(static_cast<std::streamoff>(offset));
+            // Compressed blocks are decoded as a whole, so a compressed download resumes at the last complete block.
+            LZStreamDecoder decoder(progress.Consumed, progress.Received[range]);
+            std::optional<ChunkVerifier> verifier;
+            if (compressed && !map.ChunkHashes.empty()) {
+                verifier.emplace(map, offset, partPath);
+            }
+            httplib::Headers headers = {
+                { "Range", compressed ? fmt::format("bytes={:d}-{:d}", progress.Consumed, map.CompressedSize - 1) :
+                    fmt::format("bytes={:d}-{:d}", offset, rangeEnd - 1) }
+            };
+            if (compressed) {
+                headers.emplace("Accept-Encoding", MAP_CONTENT_ENCODING);
+            }
+            int status = 0;
+            std::chrono::seconds retryAfter = std::chrono::seconds::zero();
+            httplib::Result res = cli.Get("/map", headers,
+                [&](const httplib::Response& response) -> bool {
+                    status = response.status;
+                    retryAfter = get_retry_after(response);
+                    if (status != 200 && status != 206) {
+                        return false;
+                    }
+                    if (compressed && response.get_header_value("Content-Encoding") != MAP_CONTENT_ENCODING) {
+                        compressionUnsupported = true;
+                        return false;
+                    }
+                    if (status == 206) {
+                        return true;
+                    }
+                    // Servers without range support send the whole file, which is only usable for a single range.
+                    if (rangeCount > 1) {
+                        rangesUnsupported = true;
+                        return false;
+                    }
+                    if (offset > 0) {
+                        BM_WARNING_LOG("Host does not support resuming downloads, restarting");
+                        const std::scoped_lock lock(progressMutex);
+                        offset = 0;
+                        restartRange();
+                        decoder = LZStreamDecoder();
+                        if (verifier) {
+                            verifier.emplace(map, 0, partPath);
+                        }
+                        file.seekp(0);
+                    }
+                    return true;
+                },
+                [&](const char* data, const size_t data_length) -> bool {
+                    size_t written = data_length;
+                    if (compressed) {
+                        try {
+                            decoder.Update(std::string_view(data, data_length), [&](const std::string_view block) {
+                                if (decoder.GetDecoded() + block.size() > rangeEnd) {
+                                    throw std::range_error("decompressed map is larger than expected");
+                                }
+                                file.write(block.data(), static_cast<std::streamsize>(block.size()));
+                                if (verifier && !verifier->Update(block)) {
+                                    const std::scoped_lock lock(progressMutex);
+                                    badCompressedChunk = verifier->GetChunk();
+                                    throw std::range_error(fmt::format("chunk {:d} does not match the hash of the host", *badCompressedChunk));
+                                }
+                            });
+                        }
+                        catch (const std::range_error& e) {
+                            BM_ERROR_LOG("Could not decompress the map: {:s}", e.what());
+                            return false;
+                        }
+                        written = decoder.GetDecoded() - offset;
+                    }
+                    else if (offset + data_length > rangeEnd) {
+                        BM_ERROR_LOG("Received more data than requested");
+                        return false;
+                    }
+                    else {
+                        file.write(data, static_cast<std::streamsize>(data_length));
+                    }
+                    if (file.fail()) {
+                        return false;
+                    }
+                    offset += written;
+
+                    const std::scoped_lock lock(progressMutex);
+                    progress.Received[range] += written;
+                    if (compressed) {
+                        progress.Consumed = decoder.GetConsumed();
+                    }
+                    totalReceived += written;
+                    if (downloadStatus != nullptr) {
+                        *downloadStatus = static_cast<float>(totalReceived) / static_cast<float>(map.FileSize);
+                    }
+                    if (totalReceived - lastRecorded >= MAP_DOWNLOAD_PROGRESS_INTERVAL) {
+                        file.flush();
+                        saveFlushedProgress();
+                        lastRecorded = totalReceived;
+                    }
+                    return true;
                 }
-                return true;
+            );
+            file.flush();
+            if (status == 416) {
+                // Range Not Satisfiable, the file on the host changed since the partial download.
+                BM_WARNING_LOG("Host rejected the resumed download of range {:d}, restarting it", range);
+                const std::scoped_lock lock(progressMutex);
+                restartRange();
+                continue;
+            }
+            if (rangesUnsupported || compressionUnsupported || badCompressedChunk) {
+                return false;
+            }
+            queued = retryAfter > std::chrono::seconds::zero() && std::chrono::steady_clock::now() < queueDeadline;
+            if (queued) {
+                BM_TRACE_LOG("Map download is queued by the host, retrying range {:d} in {:d}s", range, retryAfter.count());
+                std::this_thread::sleep_for(retryAfter);
+                // Waiting in the queue is not a retry.
+                attempt--;
+                continue;
+            }
+            if (status != 0 && status != 200 && status != 206) {
+                BM_ERROR_LOG("Host status returned: {:s}", httplib::detail::status_message(status));
+                return false;
+            }
+            if (res == nullptr || res.error() != httplib::Error::Success) {
+                BM_ERROR_LOG("Could not download the map: {:s}", httplib::to_string(res.error()));
+                const std::scoped_lock lock(progressMutex);
+                saveFlushedProgress();
             }
-        );
-        if (res.error() != httplib::Error::Success || res == nullptr) {
-            BM_ERROR_LOG("Could not get the host status: {:s}", httplib::to_string(res.error()));
-            return false;
         }
-        if (res->status != 200) {
-            BM_ERROR_LOG("Host status returned: {:s}", httplib::detail::status_message(res->status));
+
+        return true;
+    };
+
+    // Chunks are handed out to workers that each start on their own source, a worker whose peer fails falls back to
+    // the host.
+    std::vector<ServerStatus::Peer> sources = { { host, port } };
+    sources.insert(sources.end(), map.Peers.begin(), map.Peers.end());
+    std::deque<size_t> pendingChunks;
+    std::vector<size_t> chunkAttempts(rangeCount, 0);
+    size_t chunksInFlight = 0;
+    size_t peerReceived = 0;
+    bool chunkFailed = false;
+    std::condition_variable chunksChanged;
+    const auto downloadChunks = [&](const size_t worker) -> bool {
+        std::fstream file(partPath, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file.is_open()) {
+            BM_ERROR_LOG("Could not open file: {:s}", partPath.string());
+            const std::scoped_lock lock(progressMutex);
+            chunkFailed = true;
+            chunksChanged.notify_all();
             return false;
         }
-        BM_TRACE_LOG("Map download completed");
 
-        BM_WARNING_LOG("redacted function");
-        BM_ERROR_LOG("Could not load the map, restart your game to load the map.");
+        size_t source = worker % sources.size();
+        std::unique_ptr<httplib::Client> cli;
+        while (true) {
+            size_t chunk;
+            {
+                std::unique_lock lock(progressMutex);
+                chunksChanged.wait(lock, [&] { return chunkFailed || !pendingChunks.empty() || chunksInFlight == 0; });
+                if (chunkFailed) {
+                    return false;
+                }
+                if (pendingChunks.empty()) {
+                    return true;
+                }
+                chunk = pendingChunks.front();
+                pendingChunks.pop_front();
+                chunksInFlight++;
+            }
+
+            if (cli == nullptr) {
+                cli = std::make_unique<httplib::Client>(sources[source].Host, sources[source].Port);
+                cli->set_decompress(false);
+            }
+            const auto [chunkStart, chunkEnd] = ranges[chunk];
+            std::string chunkData;
+            chunkData.reserve(chunkEnd - chunkStart);
+            // Hashed while it is received, so verifying does not wait for the whole chunk.
+            Sha256 chunkHash;
+            std::chrono::seconds retryAfter = std::chrono::seconds::zero();
+            const httplib::Result res = cli->Get("/map",
+                { { "Range", fmt::format("bytes={:d}-{:d}", chunkStart, chunkEnd - 1) } },
+                [&](const httplib::Response& response) -> bool {
+                    retryAfter = get_retry_after(response);
+                    // A whole file is only usable when it is the only chunk.
+                    return response.status == 206 || (response.status == 200 && rangeCount == 1);
+                },
+                [&](const char* data, const size_t data_length) -> bool {
+                    if (chunkData.size() + data_length > chunkEnd - chunkStart) {
+                        return false;
+                    }
+                    chunkData.append(data, data_length);
+                    chunkHash.Update(std::string_view(data, data_length));
+                    return true;
+                }
+            );
+
+            bool verified = false;
+            if (res != nullptr && res.error() == httplib::Error::Success && chunkData.size() == chunkEnd - chunkStart &&
+                chunkHash.Finish() == map.ChunkHashes[chunk]) {
+                file.seekp(static_cast<std::streamoff>(chunkStart));
+                file.write(chunkData.data(), static_cast<std::streamsize>(chunkData.size()));
+                file.flush();
+                verified = !file.fail();
+            }
+
+            std::unique_lock lock(progressMutex);
+            chunksInFlight--;
+            if (verified) {
+                progress.Received[chunk] = chunkData.size();
+                totalReceived += chunkData.size();
+                if (source != 0) {
+                    peerReceived += chunkData.size();
+                }
+                if (downloadStatus != nullptr) {
+                    *downloadStatus = static_cast<float>(totalReceived) / static_cast<float>(map.FileSize);
+                }
+                if (totalReceived - lastRecorded >= MAP_DOWNLOAD_PROGRESS_INTERVAL) {
+                    saveDownloadProgress(progressPath, progress);
+                    lastRecorded = totalReceived;
+                }
+                chunksChanged.notify_all();
+                continue;
+            }
+
+            if (retryAfter > std::chrono::seconds::zero() && std::chrono::steady_clock::now() < queueDeadline) {
+                BM_TRACE_LOG("Chunk {:d} is queued by {:s}:{:d}, retrying in {:d}s", chunk, sources[source].Host,
+                    sources[source].Port, retryAfter.count());
+                pendingChunks.push_front(chunk);
+                chunksChanged.notify_all();
+                lock.unlock();
+                std::this_thread::sleep_for(retryAfter);
+                continue;
+            }
+            BM_WARNING_LOG("Could not download chunk {:d} from {:s}:{:d}", chunk, sources[source].Host, sources[source].Port);
+            if (++chunkAttempts[chunk] > MAP_DOWNLOAD_RETRIES) {
+                BM_ERROR_LOG("Giving up on the map download after {:d} retries", MAP_DOWNLOAD_RETRIES);
+                saveDownloadProgress(progressPath, progress);
+                chunkFailed = true;
+                chunksChanged.notify_all();
+                return false;
+            }
+            pendingChunks.push_back(chunk);
+            chunksChanged.notify_all();
+            const size_t attempt = chunkAttempts[chunk];
+            lock.unlock();
+            if (source != 0) {
+                source = 0;
+                cli = nullptr;
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::seconds(attempt));
+            }
+        }
+    };
+
+    bool downloaded = true;
+    if (chunked) {
+        for (size_t i = 0; i < rangeCount; i++) {
+            if (progress.Received[i] == 0) {
+                pendingChunks.push_back(i);
+            }
+        }
+        const size_t workerCount = std::min(std::max(connections, sources.size()), pendingChunks.size());
+        std::vector<std::future<bool>> chunkDownloads;
+        for (size_t i = 0; i < workerCount; i++) {
+            chunkDownloads.push_back(save_promise<bool>("DownloadMapChunks", [&downloadChunks, i]() -> bool {
+                return downloadChunks(i);
+            }));
+        }
+        for (std::future<bool>& chunkDownload : chunkDownloads) {
+            downloaded &= chunkDownload.get();
+        }
+        if (peerReceived > 0) {
+            BM_INFO_LOG("Received {:d}/{:d} bytes of the map from {:d} peers", peerReceived, map.FileSize, map.Peers.size());
+        }
+    }
+    else {
+        std::vector<std::future<bool>> rangeDownloads;
+        for (size_t i = 0; i < rangeCount; i++) {
+            rangeDownloads.push_back(save_promise<bool>("DownloadMapRange", [&downloadRange, i]() -> bool {
+                return downloadRange(i);
+            }));
+        }
+        for (std::future<bool>& rangeDownload : rangeDownloads) {
+            downloaded &= rangeDownload.get();
+        }
+    }
+
+    if (compressionUnsupported) {
+        BM_WARNING_LOG("Host did not send the compressed map, downloading it as is");
+        std::filesystem::remove(progressPath, ec);
+        ServerStatus::MapStatus uncompressedMap = map;
+        uncompressedMap.CompressedSize = 0;
+        return DownloadMapFile(host, port, filePath, uncompressedMap, connections, downloadStatus);
+    }
+    if (badCompressedChunk) {
+        BM_WARNING_LOG("Compressed map does not match the hash of the host, downloading the rest per chunk");
+        // The chunks before the bad one are verified, the per chunk download only fetches the others.
+        DownloadProgress chunkProgress = { map.Guid, map.FileSize, std::vector<size_t>(map.ChunkHashes.size(), 0), 0 };
+        for (size_t chunk = 0; chunk < *badCompressedChunk; chunk++) {
+            chunkProgress.Received[chunk] = std::min((chunk + 1) * map.ChunkSize, map.FileSize) - chunk * map.ChunkSize;
+        }
+        saveDownloadProgress(progressPath, chunkProgress);
+        ServerStatus::MapStatus uncompressedMap = map;
+        uncompressedMap.CompressedSize = 0;
+        return DownloadMapFile(host, port, filePath, uncompressedMap, connections, downloadStatus);
+    }
+    if (rangesUnsupported) {
+        BM_WARNING_LOG("Host does not support ranges, downloading over a single connection");
+        std::filesystem::remove(progressPath, ec);
+        return DownloadMapFile(host, port, filePath, map, 1, downloadStatus);
+    }
+    if (!downloaded || totalReceived != map.FileSize) {
+        saveDownloadProgress(progressPath, progress);
         return false;
-    });
+    }
+
+    std::filesystem::rename(partPath, filePath, ec);
+    if (ec) {
+        BM_ERROR_LOG("Could not move the downloaded map to {:s}, {:s}", quote(filePath.string()), quote(ec.message()));
+        return false;
+    }
+    std::filesystem::remove(progressPath, ec);
+
+    return true;
 }
@@ -2,9 +2,52 @@
 #include "Modules/RocketPluginModule.h"
 
 #include "Networking.h"
+#include "LanDiscovery.h"
+#include "TokenBucket.h"
 
 #include "cpp-httplib/httplib.h"
 
+class MappedFile;
+
+// Maximum number of bytes handed to the socket per content provider call when uploading a map.
+constexpr size_t MAP_UPLOAD_CHUNK_SIZE = 256 * 1024;
+// Content encoding of the compressed map, a block stream from lz_compress_stream.
+constexpr const char* MAP_CONTENT_ENCODING = "x-rp-lz";
+// Every file in a bundle starts with its hash as hex string and its size as 64 bit little endian.
+constexpr size_t MAP_BUNDLE_HASH_SIZE = 64;
+constexpr size_t MAP_BUNDLE_HEADER_SIZE = MAP_BUNDLE_HASH_SIZE + sizeof(uint64_t);
+// Partial map downloads are kept next to the map with these extensions, until the download finishes.
+constexpr const wchar_t* MAP_DOWNLOAD_PART_EXTENSION = L".part";
+constexpr const wchar_t* MAP_DOWNLOAD_PROGRESS_EXTENSION = L".part.json";
+// Compressed copies of the served map are kept in the temp directory with this extension, while they are served.
+constexpr const wchar_t* MAP_COMPRESSED_EXTENSION = L".rplz";
+// Number of times a dropped map download is resumed before giving up.
+constexpr size_t MAP_DOWNLOAD_RETRIES = 5;
+// Number of concurrent connections a map is downloaded over, each fetching its own range of the file.
+constexpr size_t MAP_DOWNLOAD_CONNECTIONS = 4;
+// Maps smaller than this per connection use fewer connections.
+constexpr size_t MAP_DOWNLOAD_MIN_RANGE_SIZE = 4 * 1024 * 1024;
+// The progress record is updated every time this many bytes are received.
+constexpr size_t MAP_DOWNLOAD_PROGRESS_INTERVAL = 4 * 1024 * 1024;
+// Maps are hashed per chunk of this size, so chunks from peers can be verified on their own.
+constexpr size_t MAP_CHUNK_SIZE = 4 * 1024 * 1024;
+// Maximum number of peers the host advertises, the oldest peer is replaced by new ones.
+constexpr size_t MAP_MAX_PEERS = 8;
+// Maximum number of players that download from the host at the same time, others wait in a queue.
+constexpr size_t MAP_MAX_TRANSFERS = 2;
+// Queued players that did not ask for their transfer within this time lose their place in the queue.
+constexpr std::chrono::seconds MAP_TRANSFER_QUEUE_TIMEOUT = std::chrono::seconds(10);
+// Queued players are asked to retry after this time.
+constexpr std::chrono::seconds MAP_TRANSFER_RETRY_AFTER = std::chrono::seconds(2);
+// Players give up on waiting in the queue of the host after this time.
+constexpr std::chrono::minutes MAP_DOWNLOAD_QUEUE_TIMEOUT = std::chrono::minutes(10);
+// Clients are asked to retry after this time while the status of a new map is being build.
+constexpr std::chrono::seconds MAP_STATUS_RETRY_AFTER = std::chrono::seconds(1);
+// Players give up on waiting for the host to build the status of a new map after this time.
+constexpr std::chrono::seconds MAP_STATUS_TIMEOUT = std::chrono::seconds(30);
+// Rate limited uploads are handed to the socket in chunks of this size, so the rate stays smooth.
+constexpr size_t MAP_UPLOAD_SHAPED_CHUNK_SIZE = 64 * 1024;
+
 
 class MatchFileServer final : RocketPluginModule
 {
@@ -18,10 +61,131 @@ public:
     MatchFileServer& operator=(MatchFileServer&&) = delete;
     MatchFileServer& operator=(const MatchFileServer&) = delete;
 
+    struct UploadLimits
+    {
+        // Bytes per second over all transfers, 0 for no limit.
+        size_t Rate = 0;
+        // Bytes per second over all transfers while a match is active, 0 for no limit.
+        size_t MatchRate = 0;
+        // Bytes per second per connection, 0 for no limit.
+        size_t ConnectionRate = 0;
+        // Players that download at the same time, 0 for no limit.
+        size_t MaxTransfers = MAP_MAX_TRANSFERS;
+    };
+
+    void SetUploadLimits(const UploadLimits& limits, bool matchActive);
+    void SetLanBeacon(const std::optional<LanBeacon>& beacon);
+
 private:
-    static void serverStatusRequest(const httplib::Request& req, httplib::Response& res);
-    static void serverDownloadMapRequest(const httplib::Request& req, httplib::Response& res);
+    struct ServedMap
+    {
+        std::string MapName;
+        std::string Guid;
+        std::filesystem::path FilePath;
+    };
+
+    // The status response is build again when any of these change, the map file can be replaced under the same guid.
+    struct StatusKey
+    {
+        std::string MapName;
+        std::string Guid;
+        std::filesystem::path FilePath;
+        size_t FileSize = 0;
+        std::filesystem::file_time_type LastWriteTime;
 
+        bool operator==(const StatusKey& other) const = default;
+    };
+
+    // Compressed copy of the map in a temporary file, which is removed when the last response that serves it is done.
+    class CompressedMap
+    {
+    public:
+        explicit CompressedMap(std::filesystem::path filePath);
+        ~CompressedMap();
+
+        CompressedMap(CompressedMap&&) = delete;
+        CompressedMap(const CompressedMap&) = delete;
+        CompressedMap& operator=(CompressedMap&&) = delete;
+        CompressedMap& operator=(const CompressedMap&) = delete;
+
+        const MappedFile& GetMappedFile() const;
+
+    private:
+        std::filesystem::path filePath;
+        std::unique_ptr<MappedFile> mappedFile;
+    };
+
+    struct StatusResponse
+    {
+        StatusKey Key;
+        std::string Hash;
+        // Status of the map and its dependencies, without the peers.
+        std::string Metadata;
+        std::vector<std::pair<std::string, int>> Peers;
+        std::string Body;
+        std::string ETag;
+        // Size of the compressed copy of the map, 0 if the map is only send as is.
+        size_t CompressedSize = 0;
+        // Compressed once when the response is build, so every download is served from the same copy.
+        std::shared_ptr<const CompressedMap> Compressed;
+        // Files of the current map and its dependencies, by hash.
+        std::unordered_map<std::string, std::filesystem::path> Files;
+    };
+
+    // Slot of a player that is downloading, given back when the last connection of the player is done.
+    class Transfer
+    {
+    public:
+        Transfer(MatchFileServer& server, std::string client, size_t connectionRate);
+        ~Transfer();
+
+        Transfer(Transfer&&) = delete;
+        Transfer(const Transfer&) = delete;
+        Transfer& operator=(Transfer&&) = delete;
+        Transfer& operator=(const Transfer&) = delete;
+
+        size_t GetChunkSize(size_t length);
+        void Throttle(size_t bytes);
+
+    private:
+        MatchFileServer& server;
+        std::string client;
+        TokenBucket connectionBucket;
+    };
+
+    struct QueuedClient
+    {
+        std::string Address;
+        std::chrono::steady_clock::time_point LastSeen;
+    };
+
+    void startServer(const std::string& host, int port, int socket_flags, const std::function<void()>& onBound);
+    std::shared_ptr<const StatusResponse> getStatusResponse(httplib::Response& res);
+    static std::shared_ptr<const StatusResponse> buildStatusResponse(const StatusKey& key,
+        const std::vector<std::string>& dependencyNames);
+    static void formatStatusBody(StatusResponse& response);
+    void serverStatusRequest(const httplib::Request& req, httplib::Response& res);
+    void serverDownloadMapRequest(const httplib::Request& req, httplib::Response& res);
+    void serverDownloadBundleRequest(const httplib::Request& req, httplib::Response& res);
+    void serverRegisterPeerRequest(const httplib::Request& req, httplib::Response& res);
+    std::shared_ptr<Transfer> beginTransfer(const httplib::Request& req, httplib::Response& res);
+    size_t getQueuePosition(const std::string& client);
+
+    // Set for peers, which serve a map they downloaded instead of the current map.
+    std::optional<ServedMap> servedMap;
+    std::mutex statusMutex;
+    std::shared_ptr<const StatusResponse> statusResponse;
+    // Status response of a new map, which is build on its own thread so requests do not wait on hashing the map.
+    StatusKey pendingStatusKey;
+    std::future<std::shared_ptr<const StatusResponse>> pendingStatusResponse;
+    std::mutex transferMutex;
+    UploadLimits uploadLimits;
+    TokenBucket uploadBucket;
+    // Connections per downloading player.
+    std::unordered_map<std::string, size_t> activeTransfers;
+    std::deque<QueuedClient> transferQueue;
+    // Answers discovery queries from the local network, only hosts have one.
+    std::unique_ptr<LanBeaconResponder> lanResponder;
     std::thread serverThread;
     httplib::Server svr;
 
@@ -31,20 +195,65 @@ public:
     {
         bool Online = false;
         std::string Version;
+        // Position in the download queue of the host, 0 if not queued.
+        size_t QueuePosition = 0;
+        struct Peer
+        {
+            std::string Host;
+            int Port = 0;
+        };
         struct MapStatus
         {
             std::string MapName;
             size_t FileSize = 0;
             std::string Guid = "00000000 00000000 00000000 00000000";
+            // Sha256 of the map file, empty for hosts that do not send it.
+            std::string Hash;
+            // Size of the compressed copy the host serves, 0 if the map is only send as is.
+            size_t CompressedSize = 0;
+            // Sha256 per chunk of the map file.
+            size_t ChunkSize = 0;
+            std::vector<std::string> ChunkHashes;
+            // Other players that serve the same map.
+            std::vector<Peer> Peers;
             bool Loaded = false;
             bool Override = false;
+            // The map is in the local map cache.
+            bool Cached = false;
         };
         MapStatus CurrentMap;
         std::vector<MapStatus> Dependencies;
 
-        bool ShouldDownloadMap() const { return Online && CurrentMap.FileSize > 0 && (!CurrentMap.Loaded || CurrentMap.Override); }
+        bool IsCached() const { return CurrentMap.Cached && std::ranges::all_of(Dependencies, [](const MapStatus& dependency) { return dependency.Cached; }); }
+        bool ShouldDownloadMap() const { return Online && CurrentMap.FileSize > 0 && !IsCached() && (!CurrentMap.Loaded || CurrentMap.Override); }
+        bool ShouldRestoreMap() const { return Online && IsCached() && (!CurrentMap.Loaded || CurrentMap.Override); }
     };
 
+    MatchFileServer(const std::string& host, int port, const ServerStatus::MapStatus& map,
+        const std::filesystem::path& filePath, const std::string& originHost = "", int originPort = 0);
+
     static std::future<ServerStatus> GetServerStatus(const std::string& host, int port, Networking::HostStatus* hostStatus = nullptr);
-    static std::future<bool> DownloadMap(const std::string& host, int port, const std::filesystem::path& filePath, float* downloadStatus = nullptr);
+    static std::future<bool> DownloadMap(const std::string& host, int port, const std::filesystem::path& filePath,
+        const ServerStatus::MapStatus& map, const std::vector<ServerStatus::MapStatus>& dependencies,
+        float* downloadStatus = nullptr);
+    static bool DownloadMapFile(const std::string& host, int port, const std::filesystem::path& filePath,
+        const ServerStatus::MapStatus& map, size_t connections = MAP_DOWNLOAD_CONNECTIONS, float* downloadStatus = nullptr);
+
+private:
+    struct DownloadProgress
+    {
+        std::string Guid;
+        size_t FileSize = 0;
+        // Bytes received per range, the file is split in equal ranges.
+        std::vector<size_t> Received;
+        // Compressed downloads use a single range, which continues at this position in the compressed copy.
+        size_t CompressedSize = 0;
+        size_t Consumed = 0;
+    };
+
+    static bool registerPeer(const std::string& originHost, int originPort, int port, const std::string& hash);
+    static bool downloadBundle(const std::string& host, int port, const std::filesystem::path& directory,
+        const std::vector<ServerStatus::MapStatus>& files);
+    static DownloadProgress loadDownloadProgress(const std::filesystem::path& progressPath);
+    static bool saveDownloadProgress(const std::filesystem::path& progressPath, const DownloadProgress& progress);
 };
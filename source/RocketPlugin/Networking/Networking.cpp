@@ -5,8 +5,8 @@
 // Version:      0.6.9 10/10/21
 
 #include "Networking.h"
+#include "Socket.h"
 
-#include <regex>
 #include <system_error>
 
 #pragma comment(lib,"Ws2_32.lib")
@@ -17,7 +17,22 @@
 
 #include "utils/winsock_error_category.h"
 
-constexpr timeval NETWORK_TIMEOUT = { 3, 0 };
+constexpr std::chrono::milliseconds NETWORK_TIMEOUT = std::chrono::seconds(3);
+
+// Address ranges that are not public, checked in order.
+constexpr struct
+{
+    uint32_t Prefix;
+    int PrefixLength;
+    Networking::IPv4Range Range;
+} IPV4_RANGES[] = {
+    { 0x0A000000, 8,  Networking::IPv4Range::PRIVATE  },  // 10.0.0.0/8      - private networks
+    { 0xAC100000, 12, Networking::IPv4Range::PRIVATE  },  // 172.16.0.0/12   - private networks
+    { 0xC0A80000, 16, Networking::IPv4Range::PRIVATE  },  // 192.168.0.0/16  - private networks
+    { 0x19000000, 8,  Networking::IPv4Range::HAMACHI  },  // 25.0.0.0/8      - Hamachi
+    { 0x64400000, 10, Networking::IPv4Range::CGNAT    },  // 100.64.0.0/10   - carrier-grade NAT deployment
+    { 0x7F000000, 8,  Networking::IPv4Range::LOOPBACK },  // 127.0.0.0/8     - localhost
+};
 
 
 /// <summary>Get the type of address that is given.</summary>
@@ -25,17 +40,18 @@ constexpr timeval NETWORK_TIMEOUT = { 3, 0 };
 /// <returns>The type of the given address</returns>
 Networking::DestAddrType Networking::GetDestAddrType(const std::string& addr)
 {
-    if (IsValidIPv4(addr)) {
-        if (IsPrivateIPv4(addr)) {
-            return DestAddrType::PRIVATE_ADDR;
-        }
-        if (IsHamachiIPv4(addr)) {
-            return DestAddrType::HAMACHI_ADDR;
-        }
-        if (IsExternalIPv4(addr)) {
-            return DestAddrType::EXTERNL_ADDR;
+    if (const std::optional<ParsedIPv4> ipAddr = ParseIPv4(addr)) {
+        switch (ipAddr->Range) {
+            case IPv4Range::PRIVATE:
+                return DestAddrType::PRIVATE_ADDR;
+            case IPv4Range::HAMACHI:
+                return DestAddrType::HAMACHI_ADDR;
+            case IPv4Range::PUBLIC:
+                return DestAddrType::EXTERNL_ADDR;
+            case IPv4Range::CGNAT:
+            case IPv4Range::LOOPBACK:
+                return DestAddrType::INTERNL_ADDR;
         }
-        return DestAddrType::INTERNL_ADDR;
     }
     if (IsValidDomainName(addr)) {
         return DestAddrType::EXTERNL_ADDR;
@@ -106,20 +122,64 @@ bool Networking::IsValidPort(const int port)
 }
 
 
+/// <summary>Parses a dotted decimal ipv4 address in a single pass.</summary>
+/// <remarks>Accepts exactly four octets of 0 to 255 without leading zeros.</remarks>
+/// <param name="ipAddr">IP to parse</param>
+/// <returns>The packed address and its range, or nothing if the IP is not a valid ipv4 address</returns>
+std::optional<Networking::ParsedIPv4> Networking::ParseIPv4(const std::string_view ipAddr)
+{
+    uint32_t address = 0;
+    size_t octets = 0;
+    size_t i = 0;
+    while (octets < 4) {
+        if (octets > 0) {
+            if (i >= ipAddr.size() || ipAddr[i] != '.') {
+                return std::nullopt;
+            }
+            i++;
+        }
+        const size_t octetStart = i;
+        uint32_t octet = 0;
+        while (i < ipAddr.size() && i - octetStart < 3 && ipAddr[i] >= '0' && ipAddr[i] <= '9') {
+            octet = octet * 10 + static_cast<uint32_t>(ipAddr[i] - '0');
+            i++;
+        }
+        const size_t digits = i - octetStart;
+        if (digits == 0 || octet > 255 || (digits > 1 && ipAddr[octetStart] == '0')) {
+            return std::nullopt;
+        }
+        address = address << 8 | octet;
+        octets++;
+    }
+    if (i != ipAddr.size()) {
+        return std::nullopt;
+    }
+
+    return ParsedIPv4{ address, GetIPv4Range(address) };
+}
+
+
+/// <summary>Gets the range the given ipv4 address belongs to.</summary>
+/// <param name="ipAddr">IP in host byte order</param>
+/// <returns>The range of the IP, <see cref="IPv4Range::PUBLIC"/> if it is in none of the reserved ranges</returns>
+Networking::IPv4Range Networking::GetIPv4Range(const uint32_t ipAddr)
+{
+    for (const auto& [prefix, prefixLength, range] : IPV4_RANGES) {
+        if ((ipAddr ^ prefix) >> (32 - prefixLength) == 0) {
+            return range;
+        }
+    }
+
+    return IPv4Range::PUBLIC;
+}
+
+
 /// <summary>Checks whether the given IP is a valid ipv4.</summary>
 /// <param name="ipAddr">IP to validate</param>
 /// <returns>Bool with is the IP is a valid ipv4 address</returns>
 bool Networking::IsValidIPv4(const std::string& ipAddr)
 {
-    static const std::regex ipv4Regex(
-        "^(([0-9]|[1-9][0-9]|1[0-9]{2}|2[0-4][0-9]|25[0-5])\\.){3}([0-9]|[1-9][0-9]|1[0-9]{2}|2[0-4][0-9]|25[0-5])$");
-    std::smatch match;
-
-    if (std::regex_match(ipAddr, match, ipv4Regex)) {
-        return true;
-    }
-
-    return false;
+    return ParseIPv4(ipAddr).has_value();
 }
 
 
@@ -128,52 +188,19 @@ bool Networking::IsValidIPv4(const std::string& ipAddr)
 /// <returns>Bool with is the IP is an private ipv4 address</returns>
 bool Networking::IsPrivateIPv4(const std::string& ipAddr)
 {
-    if (!IsValidIPv4(ipAddr)) {
-        return false;
-    }
-
-    // 10.0.0.0     -   10.255.255.255  (10/8 prefix)       - private networks
-    if (std::strncmp(ipAddr.c_str(), "10.", 3) == 0) {
-        return true;
-    }
-    // 172.16.0.0   -   172.31.255.255  (172.16/12 prefix)  - private networks
-    if (std::strncmp(ipAddr.c_str(), "172.", 4) == 0) {
-        const long i = strtol(ipAddr.data() + 4, nullptr, 10);
-        if (16 <= i && i <= 31) {
-            return true;
-        }
-    }
-    // 192.168.0.0  -   192.168.255.255 (192.168/16 prefix) - private networks
-    if (std::strncmp(ipAddr.c_str(), "192.168.", 8) == 0) {
-        return true;
-    }
-
-    return false;
+    const std::optional<ParsedIPv4> parsed = ParseIPv4(ipAddr);
+    return parsed && parsed->Range == IPv4Range::PRIVATE;
 }
 
 
 /// <summary>Checks whether the given IP is an external ipv4 address.</summary>
+/// <remarks>Hamachi addresses count as external.</remarks>
 /// <param name="ipAddr">IP to validate</param>
 /// <returns>Bool with is the IP is an external ipv4 address</returns>
 bool Networking::IsExternalIPv4(const std::string& ipAddr)
 {
-    if (IsPrivateIPv4(ipAddr)) {
-        return false;
-    }
-
-    // 100.64.0.0   -   100.127.255.255  (100.64/10 prefix) - carrier-grade NAT deployment
-    if (std::strncmp(ipAddr.c_str(), "100.", 4) == 0) {
-        const long i = strtol(ipAddr.data() + 4, nullptr, 10);
-        if (64 <= i && i <= 127) {
-            return false;
-        }
-    }
-    // 127.0.0.0    -   127.255.255.255 (127/8 prefix)      - localhost
-    if (std::strncmp(ipAddr.c_str(), "127.", 4) == 0) {
-        return false;
-    }
-
-    return true;
+    const std::optional<ParsedIPv4> parsed = ParseIPv4(ipAddr);
+    return parsed && (parsed->Range == IPv4Range::PUBLIC || parsed->Range == IPv4Range::HAMACHI);
 }
 
 
@@ -182,38 +209,50 @@ bool Networking::IsExternalIPv4(const std::string& ipAddr)
 /// <returns>Bool with is the IP is in the Hamachi ipv4 address space</returns>
 bool Networking::IsHamachiIPv4(const std::string& ipAddr)
 {
-    if (!IsValidIPv4(ipAddr)) {
-        return false;
-    }
-
-    // 25.0.0.0        -   25.255.255.255  (10/8 prefix)
-    if (std::strncmp(ipAddr.c_str(), "25.", 3) == 0) {
-        return true;
-    }
-
-    return false;
+    const std::optional<ParsedIPv4> parsed = ParseIPv4(ipAddr);
+    return parsed && parsed->Range == IPv4Range::HAMACHI;
 }
 
 
 /// <summary>Checks whether the given address is a valid domain name.</summary>
-/// <remarks>From https://stackoverflow.com/a/30007882 </remarks>
+/// <remarks>
+/// Same rules as the regex from https://stackoverflow.com/a/30007882, at least two lowercase labels of up to 63
+/// characters that do not start or end with a hyphen, where the last label has at least two characters.
+/// </remarks>
 /// <param name="addr">address to validate</param>
 /// <returns>Bool with is the address is a valid domain name</returns>
 bool Networking::IsValidDomainName(const std::string& addr)
 {
-    static const std::regex domainNameRegex(
-        "^(?:[a-z0-9](?:[a-z0-9-]{0,61}[a-z0-9])?\\.)+[a-z0-9][a-z0-9-]{0,61}[a-z0-9]$");
-    std::smatch match;
-
-    if (std::regex_match(addr, match, domainNameRegex)) {
-        return true;
+    const auto isAlnum = [](const char c) { return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'); };
+
+    size_t labels = 0;
+    size_t labelStart = 0;
+    size_t labelLength = 0;
+    for (size_t i = 0; i <= addr.size(); i++) {
+        if (i < addr.size() && addr[i] != '.') {
+            if (!isAlnum(addr[i]) && addr[i] != '-') {
+                return false;
+            }
+            continue;
+        }
+        labelLength = i - labelStart;
+        if (labelLength == 0 || labelLength > 63 || !isAlnum(addr[labelStart]) || !isAlnum(addr[i - 1])) {
+            return false;
+        }
+        labels++;
+        labelStart = i + 1;
     }
 
-    return false;
+    // The last label is at least two characters.
+    return labels >= 2 && labelLength >= 2;
 }
 
 
 /// <summary>Send data through a websocket.</summary>
+/// <remarks>
+/// Hosts are resolved through the DNS cache of the <see cref="NetworkContext"/>, and UDP requests reuse its sockets,
+/// so polling a host does not set up the socket library and a new socket every time.
+/// </remarks>
 /// <param name="host">Host to send the request to</param>
 /// <param name="port">Port to send the request to</param>
 /// <param name="protocol">Protocol to send the request over</param>
@@ -225,13 +264,6 @@ bool Networking::IsValidDomainName(const std::string& addr)
 std::error_code Networking::NetworkRequest(const std::string& host, const unsigned short port, const int protocol,
     const char* sendBuf, const size_t sendBufSize, char* recvBuf, const size_t recvBufSize)
 {
-    // Initialize WinSock.
-    WSADATA wsaData;
-    int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (iResult != 0) {
-        return make_win32_error_code(iResult);
-    }
-
     // Determine socket type.
     int sockType;
     switch (protocol) {
@@ -242,86 +274,73 @@ std::error_code Networking::NetworkRequest(const std::string& host, const unsign
             sockType = SOCK_DGRAM;
             break;
         default:
-            WSACleanup();
             return make_win32_error_code(WSAEINVAL);
     }
 
-    // Set up the addrDest structure with the IP address and port of the receiver.
-    addrinfo hints{};
-    ZeroMemory(&hints, sizeof hints);
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = sockType;
-    hints.ai_protocol = protocol;
-    addrinfo* result = nullptr;
-    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
-        const std::error_code error = make_winsock_error_code();
-        WSACleanup();
+    NetworkContext& context = NetworkContext::Get();
+    SocketAddress destAddr;
+    std::error_code error = context.Resolve(host, port, sockType, protocol, destAddr);
+    if (error) {
         return error;
     }
-    sockaddr destAddr = *result->ai_addr;
 
-    // Create a socket for sending data.
-    const SOCKET sendSocket = socket(AF_INET, sockType, protocol);
-    if (sendSocket == INVALID_SOCKET) {
-        const std::error_code error = make_winsock_error_code();
-        WSACleanup();
-        return error;
+    // Create a socket for sending data, TCP connections are closed by the requests so only UDP sockets are reused.
+    Socket sendSocket;
+    if (protocol == IPPROTO_UDP) {
+        sendSocket = context.AcquireUdpSocket(destAddr.Family, error);
     }
-
-    if (protocol == IPPROTO_TCP) {
-        if (connect(sendSocket, &destAddr, sizeof destAddr) == SOCKET_ERROR) {
-            const std::error_code error = make_winsock_error_code();
-            closesocket(sendSocket);
-            WSACleanup();
-            return error;
+    else {
+        error = sendSocket.Open(destAddr.Family, sockType, protocol);
+        if (!error) {
+            error = sendSocket.Connect(destAddr);
         }
     }
-
-    // Send a data to the receiver.
-    if (sendto(sendSocket, sendBuf, static_cast<int>(sendBufSize), NULL, &destAddr, sizeof destAddr) == SOCKET_ERROR) {
-        const std::error_code error = make_winsock_error_code();
-        closesocket(sendSocket);
-        WSACleanup();
+    if (error) {
         return error;
     }
 
+    // Send a data to the receiver.
+    const std::string_view data(sendBuf, sendBufSize);
+    error = protocol == IPPROTO_UDP ? sendSocket.SendTo(data, destAddr) : sendSocket.Send(data);
+
     // Wait until data received or timeout.
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(sendSocket, &fds);
-    iResult = select(NULL, &fds, nullptr, nullptr, &NETWORK_TIMEOUT);
-    if (iResult == SOCKET_ERROR) {
-        const std::error_code error = make_winsock_error_code();
-        closesocket(sendSocket);
-        WSACleanup();
-        return error;
-    }
-    // Connection timed out.
-    if (iResult == 0) {
-        closesocket(sendSocket);
-        WSACleanup();
-        return make_win32_error_code(WSAETIMEDOUT);
+    if (!error && protocol == IPPROTO_TCP) {
+        error = sendSocket.WaitReadable(NETWORK_TIMEOUT);
+        if (!error && recvBuf != nullptr) {
+            error = sendSocket.Receive(recvBuf, recvBufSize);
+        }
     }
 
-    if (recvBuf != nullptr) {
-        // Set up the addrRetDest structure for the IP address and port from the receiver.
-        sockaddr_in addrRetDest{};
-        int addrRetDestSize = sizeof addrRetDest;
-        // Receive a datagram from the receiver.
-        if (recvfrom(
-                sendSocket, recvBuf, static_cast<int>(recvBufSize), NULL, reinterpret_cast<sockaddr*>(&addrRetDest),
-                &addrRetDestSize) == SOCKET_ERROR) {
-            const std::error_code error = make_winsock_error_code();
-            closesocket(sendSocket);
-            WSACleanup();
-            return error;
+    // Pooled UDP sockets can still get late replies to earlier requests to other hosts, only a datagram from the
+    // receiver counts as its reply.
+    const auto deadline = std::chrono::steady_clock::now() + NETWORK_TIMEOUT;
+    char discardBuf[2048];
+    while (!error && protocol == IPPROTO_UDP) {
+        const auto timeout = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (timeout <= std::chrono::milliseconds::zero()) {
+            error = make_socket_timeout_error_code();
+            break;
+        }
+        error = sendSocket.WaitReadable(timeout);
+        if (error) {
+            break;
+        }
+
+        SocketAddress from;
+        error = recvBuf != nullptr ? sendSocket.Receive(recvBuf, recvBufSize, nullptr, &from) :
+            sendSocket.Receive(discardBuf, sizeof discardBuf, nullptr, &from);
+        if (!error && !(from == destAddr)) {
+            BM_TRACE_LOG("ignoring datagram from {:s} while waiting on {:s}", from.ToString(), destAddr.ToString());
+            continue;
         }
+        break;
     }
 
-    closesocket(sendSocket);
-    WSACleanup();
+    if (protocol == IPPROTO_UDP) {
+        context.ReleaseUdpSocket(std::move(sendSocket));
+    }
 
-    return make_winsock_error_code();
+    return error;
 }
 
 
@@ -445,7 +464,7 @@ std::future<bool> Networking::PingHost(const std::string& host, unsigned short p
         constexpr char sendBuf[] = "Hey host guy are you alive?";
         const std::error_code error = NetworkRequest(host, port, IPPROTO_UDP, sendBuf, sizeof sendBuf);
         if (error) {
-            if (error == make_win32_error_code(WSAETIMEDOUT)) {
+            if (error == make_socket_timeout_error_code()) {
                 if (result != nullptr) {
                     *result = HostStatus::HOST_TIMEOUT;
                 }
@@ -462,3 +481,170 @@ std::future<bool> Networking::PingHost(const std::string& host, unsigned short p
         return true;
     });
 }
+
+
+/// <summary>Probes all hosts at once from a single thread and measures their round trip time and loss.</summary>
+/// <remarks>Replies are matched to hosts by their address, so hosts that answer from another address count as lost.</remarks>
+/// <param name="hosts">Host and port pairs to probe</param>
+/// <param name="probes">Number of probes to send to every host</param>
+/// <param name="threaded">Whether the probing should happen on another thread</param>
+/// <returns>The results, online hosts first sorted by round trip time followed by the others in the given order</returns>
+std::future<std::vector<Networking::HostProbeResult>> Networking::ProbeHosts(
+    const std::vector<std::pair<std::string, unsigned short>>& hosts, const size_t probes, const bool threaded)
+{
+    std::launch policy = std::launch::deferred;
+    if (threaded) {
+        policy |= std::launch::async;
+    }
+
+    return std::async(policy, [hosts, probes]() -> std::vector<HostProbeResult> {
+        using clock = std::chrono::steady_clock;
+
+        struct ProbeTarget
+        {
+            SocketAddress Address;
+            size_t SocketIndex = 0;
+            std::vector<clock::time_point> SentAt;
+            size_t Answered = 0;
+            clock::duration TotalRTT = clock::duration::zero();
+        };
+
+        NetworkContext& context = NetworkContext::Get();
+        std::vector<HostProbeResult> results(hosts.size());
+        std::vector<ProbeTarget> targets(hosts.size());
+        // One socket per address family, shared by all hosts of that family.
+        std::vector<Socket> sockets;
+        for (size_t i = 0; i < hosts.size(); i++) {
+            results[i].Host = hosts[i].first;
+            results[i].Port = hosts[i].second;
+            results[i].Status = HostStatus::HOST_BUSY;
+            std::error_code error = context.Resolve(hosts[i].first, hosts[i].second, SOCK_DGRAM, IPPROTO_UDP, targets[i].Address);
+            if (error) {
+                BM_ERROR_LOG("could not resolve {}, {}", quote(hosts[i].first), quote(error.message()));
+                results[i].Status = HostStatus::HOST_ERROR;
+                continue;
+            }
+            const auto socketIt = std::ranges::find_if(sockets, [&](const Socket& socket) {
+                return socket.GetFamily() == targets[i].Address.Family;
+            });
+            if (socketIt != sockets.end()) {
+                targets[i].SocketIndex = static_cast<size_t>(socketIt - sockets.begin());
+                continue;
+            }
+            Socket socket = context.AcquireUdpSocket(targets[i].Address.Family, error);
+            if (error) {
+                BM_ERROR_LOG("could not open socket, {}", quote(error.message()));
+                results[i].Status = HostStatus::HOST_ERROR;
+                continue;
+            }
+            targets[i].SocketIndex = sockets.size();
+            sockets.push_back(std::move(socket));
+        }
+        std::vector<Socket*> socketPtrs;
+        for (Socket& socket : sockets) {
+            socketPtrs.push_back(&socket);
+        }
+
+        constexpr char sendBuf[] = "Hey host guy are you alive?";
+        const clock::time_point start = clock::now();
+        const clock::time_point deadline = start + NETWORK_TIMEOUT;
+        size_t rounds = 0;
+        clock::time_point nextRound = start;
+        while (!socketPtrs.empty()) {
+            clock::time_point now = clock::now();
+            if (rounds < probes && now >= nextRound) {
+                for (size_t i = 0; i < targets.size(); i++) {
+                    if (results[i].Status != HostStatus::HOST_BUSY) {
+                        continue;
+                    }
+                    const std::error_code error = sockets[targets[i].SocketIndex].SendTo(
+                        std::string_view(sendBuf, sizeof sendBuf), targets[i].Address);
+                    if (error) {
+                        BM_ERROR_LOG("could not probe {}, {}", quote(results[i].Host), quote(error.message()));
+                        results[i].Status = HostStatus::HOST_ERROR;
+                        continue;
+                    }
+                    targets[i].SentAt.push_back(clock::now());
+                }
+                rounds++;
+                // Skip the rounds that were missed when the thread was held up, instead of sending them in a burst.
+                while (nextRound <= now) {
+                    nextRound += HOST_PROBE_INTERVAL;
+                }
+            }
+
+            bool outstanding = rounds < probes;
+            for (size_t i = 0; i < targets.size() && !outstanding; i++) {
+                outstanding = results[i].Status == HostStatus::HOST_BUSY && targets[i].Answered < targets[i].SentAt.size();
+            }
+            now = clock::now();
+            if (!outstanding || now >= deadline) {
+                break;
+            }
+
+            clock::time_point wakeup = deadline;
+            if (rounds < probes) {
+                wakeup = std::min(wakeup, nextRound);
+            }
+            // A negative timeout waits forever, so a round that is already due only polls.
+            const std::chrono::milliseconds timeout = std::max(std::chrono::milliseconds::zero(),
+                std::chrono::ceil<std::chrono::milliseconds>(wakeup - now));
+            size_t readable = 0;
+            std::error_code error = Socket::WaitAnyReadable(socketPtrs, timeout, readable);
+            if (error) {
+                if (error == make_socket_timeout_error_code()) {
+                    continue;
+                }
+                BM_ERROR_LOG("could not wait on probes, {}", quote(error.message()));
+                break;
+            }
+
+            char recvBuf[512];
+            SocketAddress from;
+            error = sockets[readable].Receive(recvBuf, sizeof recvBuf, nullptr, &from);
+            const clock::time_point received = clock::now();
+            if (error) {
+                // Port unreachable and the likes, it says nothing about which host answered.
+                continue;
+            }
+            for (size_t i = 0; i < targets.size(); i++) {
+                ProbeTarget& target = targets[i];
+                if (results[i].Status == HostStatus::HOST_BUSY && target.Answered < target.SentAt.size() &&
+                    target.Address == from) {
+                    target.TotalRTT += received - target.SentAt[target.Answered];
+                    target.Answered++;
+                    break;
+                }
+            }
+        }
+
+        for (Socket& socket : sockets) {
+            context.ReleaseUdpSocket(std::move(socket));
+        }
+
+        for (size_t i = 0; i < targets.size(); i++) {
+            const ProbeTarget& target = targets[i];
+            if (results[i].Status != HostStatus::HOST_BUSY) {
+                continue;
+            }
+            if (target.Answered == 0) {
+                results[i].Status = HostStatus::HOST_TIMEOUT;
+                continue;
+            }
+            results[i].Status = HostStatus::HOST_ONLINE;
+            results[i].RTT = std::chrono::duration_cast<std::chrono::microseconds>(
+                target.TotalRTT / static_cast<clock::rep>(target.Answered));
+            results[i].Loss = 1 - static_cast<float>(target.Answered) / static_cast<float>(target.SentAt.size());
+        }
+        std::ranges::stable_sort(results, [](const HostProbeResult& lhs, const HostProbeResult& rhs) {
+            const bool lhsOnline = lhs.Status == HostStatus::HOST_ONLINE;
+            const bool rhsOnline = rhs.Status == HostStatus::HOST_ONLINE;
+            if (lhsOnline != rhsOnline) {
+                return lhsOnline;
+            }
+            return lhsOnline && lhs.RTT < rhs.RTT;
+        });
+
+        return results;
+    });
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+// Number of probes that are send to every host by ProbeHosts.
+constexpr size_t HOST_PROBE_COUNT = 3;
+// Time between the rounds of probes send by ProbeHosts.
+constexpr std::chrono::milliseconds HOST_PROBE_INTERVAL = std::chrono::milliseconds(250);
 
 class Networking
 {
@@ -22,12 +26,41 @@ public:
         HOST_ONLINE,
     };
 
+    enum class IPv4Range
+    {
+        PUBLIC,
+        PRIVATE,
+        CGNAT,
+        LOOPBACK,
+        HAMACHI
+    };
+
+    struct ParsedIPv4
+    {
+        // In host byte order, the first octet in the most significant byte.
+        uint32_t Address = 0;
+        IPv4Range Range = IPv4Range::PUBLIC;
+    };
+
+    struct HostProbeResult
+    {
+        std::string Host;
+        unsigned short Port = 0;
+        HostStatus Status = HostStatus::HOST_UNKNOWN;
+        // Average round trip time of the answered probes.
+        std::chrono::microseconds RTT = std::chrono::microseconds::zero();
+        // Fraction of the probes that went unanswered.
+        float Loss = 1;
+    };
+
     static DestAddrType GetDestAddrType(const std::string& addr);
     static std::string GetHostStatusHint(DestAddrType addrType, HostStatus hostStatus);
 
     static std::string IPv4ToString(const void* addr);
 
     static bool IsValidPort(int port);
+    static std::optional<ParsedIPv4> ParseIPv4(std::string_view ipAddr);
+    static IPv4Range GetIPv4Range(uint32_t ipAddr);
     static bool IsValidIPv4(const std::string& ipAddr);
     static bool IsPrivateIPv4(const std::string& ipAddr);
     static bool IsExternalIPv4(const std::string& ipAddr);
@@ -40,6 +73,8 @@ public:
     static std::future<std::error_code> GetExternalIPAddress(const std::string& host, std::string& outIpAddr, bool threaded = false);
 
     static std::future<bool> PingHost(const std::string& host, unsigned short port, HostStatus* result = nullptr, bool threaded = false);
+    static std::future<std::vector<HostProbeResult>> ProbeHosts(const std::vector<std::pair<std::string, unsigned short>>& hosts,
+        size_t probes = HOST_PROBE_COUNT, bool threaded = false);
 };
 
 
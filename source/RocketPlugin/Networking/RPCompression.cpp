@@ -0,0 +1,340 @@
+#include "RPCompression.h"
+#include "RPNetCode.h"
+
+/*
+ *  LZ77 codec in the style of LZ4, the payload is a varint with the decompressed size followed by sequences of
+ *  [token: literal length 4 bits | match length 4 bits] [extra literal length] [literals] [offset: 2 bytes]
+ *  [extra match length]. Lengths of 15 are continued in bytes of 255 and a closing byte, the last sequence only has
+ *  literals. Both sides act as if the static dictionary came right before the payload, so even small messages find
+ *  matches on the first occurrence of common names.
+ *  Block streams are a sequence of [varint: block size << 1 | compressed] [block], where compressed blocks are
+ *  payloads as above and blocks that do not compress are stored as is.
+ */
+
+constexpr size_t LZ_MIN_MATCH = 4;
+// The last sequence always has some literals, so matches never read past the end of the input.
+constexpr size_t LZ_LAST_LITERALS = 5;
+constexpr size_t LZ_HASH_BITS = 12;
+constexpr uint8_t LZ_LENGTH_MASK = 0x0F;
+
+// Common strings in networked messages, the most common ones are last so their offsets stay small.
+constexpr std::string_view LZ_DICTIONARY =
+    "rp_crazy_rumble_rp_ghost_cars_rp_boost_mod_rp_zombies_rp_tag_rp_juggernaut_rp_keep_away_rp_boost_steal_"
+    "rp_sacred_ground_rp_drainage_rp_boost_share_rp_small_cars_rp_hide_and_seek_"
+    "rp mutator \"MatchLength\" \"MaxScore\" \"OvertimeRules\" \"MaxTimeLimit\" \"SeriesLength\" \"GameSpeed\" "
+    "\"BallMaxSpeed\" \"BallType\" \"BallPhysics\" \"BallWeight\" \"BallScale\" \"BallBounciness\" \"BallGravity\" "
+    "\"Boosters\" \"BoosterStrengths\" \"Items\" \"Gravity\" \"Demolish\" \"RespawnTime\" \"AudioRules\" "
+    "\"GameEventRules\" \"CarType\" \"Ball_Puck\" \"Ball_CubeBall\" \"Ball_BeachBall\" \"Ball_Haunted\" "
+    "\"HighBounciness\" \"LowBounciness\" \"HighGravity\" \"LowGravity\" \"SuperGravity\" \"ReverseGravity\" "
+    "\"UnlimitedBooster\" \"RapidRecharge\" \"SlowRecharge\" \"NoBooster\" \"BoostMultiplier1_5x\" "
+    "\"LightBall\" \"HeavyBall\" \"FastBall\" \"SlowBall\" \"SmallBall\" \"BigBall\" \"Default\" "
+    "CarScale CarHasCollision CarIsFrozen TorqueRate MaxCarVelocity GroundStickyForce WallStickyForce "
+    "ForceMultiplier Range Duration MaxTimeTillItem "
+    "Activate true Activate false Update false true ";
+
+constexpr std::array<char, 16> LZ_DICTIONARY_FLOATS = {
+    // 0.0f, 1.0f, 0.5f and 2.0f, common in replicated snapshots.
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, static_cast<char>(0x80), 0x3F,
+    0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x40
+};
+
+
+/// <summary>Gets the static dictionary that comes before every payload.</summary>
+/// <returns>The static dictionary</returns>
+const std::string& lz_dictionary()
+{
+    static const std::string dictionary =
+        std::string(LZ_DICTIONARY) + std::string(LZ_DICTIONARY_FLOATS.data(), LZ_DICTIONARY_FLOATS.size());
+
+    return dictionary;
+}
+
+
+/// <summary>Hashes the next 4 bytes.</summary>
+/// <param name="data">Data to hash</param>
+/// <returns>Hash of the next 4 bytes</returns>
+uint32_t lz_hash(const char* data)
+{
+    return read_le<uint32_t>(data) * 2654435761u >> (32 - LZ_HASH_BITS);
+}
+
+
+/// <summary>Gets the match table with the positions in the static dictionary.</summary>
+/// <returns>The match table of the static dictionary</returns>
+const std::array<uint32_t, 1 << LZ_HASH_BITS>& lz_dictionary_table()
+{
+    static const std::array<uint32_t, 1 << LZ_HASH_BITS> dictionaryTable = []() {
+        const std::string& dictionary = lz_dictionary();
+        std::array<uint32_t, 1 << LZ_HASH_BITS> table;
+        table.fill(UINT32_MAX);
+        for (size_t i = 0; i + LZ_MIN_MATCH <= dictionary.size(); i++) {
+            table[lz_hash(dictionary.data() + i)] = static_cast<uint32_t>(i);
+        }
+        return table;
+    }();
+
+    return dictionaryTable;
+}
+
+
+/// <summary>Writes the part of a length that does not fit in its token.</summary>
+/// <param name="output">Buffer to write to</param>
+/// <param name="length">Remaining length</param>
+void lz_write_length(std::string& output, size_t length)
+{
+    while (length >= 0xFF) {
+        output += static_cast<char>(0xFF);
+        length -= 0xFF;
+    }
+    output += static_cast<char>(length);
+}
+
+
+/// <summary>Reads the part of a length that did not fit in its token.</summary>
+/// <param name="input">Buffer to read from</param>
+/// <param name="offset">Read position, gets advanced</param>
+/// <returns>Remaining length</returns>
+size_t lz_read_length(const std::string_view input, size_t& offset)
+{
+    size_t length = 0;
+    uint8_t byte;
+    do {
+        if (offset >= input.size() || length > RP_COMPRESSION_MAX_SIZE) {
+            throw std::range_error("invalid compressed length");
+        }
+        byte = static_cast<uint8_t>(input[offset++]);
+        length += byte;
+    } while (byte == 0xFF);
+
+    return length;
+}
+
+
+/// <summary>Writes a sequence of literals followed by a match.</summary>
+/// <param name="output">Buffer to write to</param>
+/// <param name="literals">Literals to copy as is</param>
+/// <param name="matchOffset">Distance back to the start of the match</param>
+/// <param name="matchLength">Length of the match, 0 for the last sequence</param>
+void lz_write_sequence(std::string& output, const std::string_view literals, const size_t matchOffset, const size_t matchLength)
+{
+    const size_t extraMatchLength = matchLength == 0 ? 0 : matchLength - LZ_MIN_MATCH;
+    const uint8_t token = static_cast<uint8_t>(std::min<size_t>(literals.size(), LZ_LENGTH_MASK) << 4 |
+        std::min<size_t>(extraMatchLength, LZ_LENGTH_MASK));
+    output += static_cast<char>(token);
+    if (literals.size() >= LZ_LENGTH_MASK) {
+        lz_write_length(output, literals.size() - LZ_LENGTH_MASK);
+    }
+    output += literals;
+    if (matchLength == 0) {
+        return;
+    }
+
+    const size_t offset = output.size();
+    output.resize(offset + 2);
+    write_le(output.data() + offset, static_cast<uint16_t>(matchOffset));
+    if (extraMatchLength >= LZ_LENGTH_MASK) {
+        lz_write_length(output, extraMatchLength - LZ_LENGTH_MASK);
+    }
+}
+
+
+/// <summary>Compresses the input.</summary>
+/// <param name="input">Data to compress</param>
+/// <param name="output">Buffer to write the compressed data into</param>
+/// <returns>Size of the compressed data</returns>
+size_t lz_compress(const std::string_view input, std::string& output)
+{
+    const std::string& dictionary = lz_dictionary();
+    thread_local std::string window;
+    window.assign(dictionary);
+    window.append(input);
+
+    output.resize(varint_size(input.size()));
+    write_varint(output.data(), input.size());
+
+    std::array<uint32_t, 1 << LZ_HASH_BITS> table = lz_dictionary_table();
+
+    const char* data = window.data();
+    const size_t end = window.size();
+    const size_t matchLimit = end > LZ_LAST_LITERALS ? end - LZ_LAST_LITERALS : 0;
+    size_t anchor = dictionary.size();
+    size_t position = anchor;
+    while (position + LZ_MIN_MATCH <= matchLimit) {
+        const uint32_t hash = lz_hash(data + position);
+        const size_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(position);
+        if (candidate == UINT32_MAX || position - candidate > RP_COMPRESSION_MAX_OFFSET ||
+            std::memcmp(data + candidate, data + position, LZ_MIN_MATCH) != 0) {
+            ++position;
+            continue;
+        }
+
+        size_t matchLength = LZ_MIN_MATCH;
+        while (position + matchLength < matchLimit && data[candidate + matchLength] == data[position + matchLength]) {
+            ++matchLength;
+        }
+
+        lz_write_sequence(output, std::string_view(data + anchor, position - anchor), position - candidate, matchLength);
+        position += matchLength;
+        anchor = position;
+    }
+    lz_write_sequence(output, std::string_view(data + anchor, end - anchor), 0, 0);
+
+    return output.size();
+}
+
+
+/// <summary>Decompresses the input.</summary>
+/// <param name="input">Data compressed with lz_compress</param>
+/// <param name="output">Buffer to write the decompressed data into</param>
+void lz_decompress(const std::string_view input, std::string& output)
+{
+    size_t size = 0;
+    size_t offset = read_varint(input.data(), input.size(), size);
+    if (offset == 0 || size > RP_COMPRESSION_MAX_SIZE) {
+        throw std::range_error("invalid compressed size");
+    }
+
+    const std::string& dictionary = lz_dictionary();
+    output.assign(dictionary);
+    output.reserve(dictionary.size() + size);
+    while (offset < input.size()) {
+        const uint8_t token = static_cast<uint8_t>(input[offset++]);
+        size_t literalLength = token >> 4;
+        if (literalLength == LZ_LENGTH_MASK) {
+            literalLength += lz_read_length(input, offset);
+        }
+        if (input.size() - offset < literalLength || output.size() - dictionary.size() + literalLength > size) {
+            throw std::range_error("invalid compressed literals");
+        }
+        output.append(input, offset, literalLength);
+        offset += literalLength;
+        if (offset == input.size()) {
+            break;
+        }
+
+        if (input.size() - offset < 2) {
+            throw std::range_error("invalid compressed offset");
+        }
+        const size_t matchOffset = read_le<uint16_t>(input.data() + offset);
+        offset += 2;
+        size_t matchLength = token & LZ_LENGTH_MASK;
+        if (matchLength == LZ_LENGTH_MASK) {
+            matchLength += lz_read_length(input, offset);
+        }
+        matchLength += LZ_MIN_MATCH;
+        if (matchOffset == 0 || matchOffset > output.size() || output.size() - dictionary.size() + matchLength > size) {
+            throw std::range_error("invalid compressed match");
+        }
+        // Matches can overlap the bytes they produce, so copy byte by byte.
+        const size_t matchStart = output.size() - matchOffset;
+        for (size_t i = 0; i < matchLength; i++) {
+            output += output[matchStart + i];
+        }
+    }
+
+    if (output.size() - dictionary.size() != size) {
+        throw std::range_error("invalid compressed size");
+    }
+    output.erase(0, dictionary.size());
+}
+
+
+/// <summary>Compresses the input as a single block of a block stream.</summary>
+/// <remarks>Blocks do not depend on each other, so a block stream can be compressed one block at a time.</remarks>
+/// <param name="input">Data of the block, at most <see cref="RP_COMPRESSION_BLOCK_SIZE"/> bytes</param>
+/// <param name="output">Buffer to append the block to</param>
+/// <returns>Size of the block, including its header</returns>
+size_t lz_compress_block(const std::string_view input, std::string& output)
+{
+    std::string block;
+    const bool compressed = lz_compress(input, block) < input.size();
+    const size_t blockSize = compressed ? block.size() : input.size();
+    std::array<char, RP_MESSAGE_MAX_LENGTH_SIZE> header{};
+    const size_t headerSize = write_varint(header.data(), blockSize << 1 | static_cast<size_t>(compressed));
+    output.append(header.data(), headerSize);
+    output.append(compressed ? std::string_view(block) : input);
+
+    return headerSize + blockSize;
+}
+
+
+/// <summary>Compresses the input as a block stream.</summary>
+/// <param name="input">Data to compress</param>
+/// <param name="output">Buffer to write the block stream into</param>
+/// <returns>Size of the block stream</returns>
+size_t lz_compress_stream(const std::string_view input, std::string& output)
+{
+    output.clear();
+    for (size_t offset = 0; offset < input.size(); offset += RP_COMPRESSION_BLOCK_SIZE) {
+        lz_compress_block(input.substr(offset, RP_COMPRESSION_BLOCK_SIZE), output);
+    }
+
+    return output.size();
+}
+
+
+/// <summary>Creates a decoder that continues at the given position in the block stream.</summary>
+/// <param name="consumed">Number of block stream bytes that were already decoded, on a block boundary</param>
+/// <param name="decoded">Number of bytes those blocks decoded to</param>
+LZStreamDecoder::LZStreamDecoder(const size_t consumed, const size_t decoded) : consumed(consumed), decoded(decoded) {}
+
+
+/// <summary>Decodes the blocks that are complete after adding the given data.</summary>
+/// <param name="data">Next part of the block stream</param>
+/// <param name="write">Gets called with the decoded data of every complete block</param>
+void LZStreamDecoder::Update(const std::string_view data, const std::function<void(std::string_view)>& write)
+{
+    pending.append(data);
+    size_t offset = 0;
+    while (offset < pending.size()) {
+        size_t header = 0;
+        const size_t headerSize = read_varint(pending.data() + offset, pending.size() - offset, header);
+        if (headerSize == 0) {
+            if (pending.size() - offset >= RP_MESSAGE_MAX_LENGTH_SIZE) {
+                throw std::range_error("invalid block header");
+            }
+            break;
+        }
+        const size_t blockSize = header >> 1;
+        if (blockSize > RP_COMPRESSION_BLOCK_SIZE + RP_COMPRESSION_BLOCK_SIZE / 8) {
+            throw std::range_error("invalid block size");
+        }
+        if (pending.size() - offset - headerSize < blockSize) {
+            break;
+        }
+
+        const std::string_view blockData(pending.data() + offset + headerSize, blockSize);
+        if (header & 1) {
+            lz_decompress(blockData, block);
+            if (block.size() > RP_COMPRESSION_BLOCK_SIZE) {
+                throw std::range_error("invalid block size");
+            }
+            write(block);
+            decoded += block.size();
+        }
+        else {
+            write(blockData);
+            decoded += blockData.size();
+        }
+        offset += headerSize + blockSize;
+        consumed += headerSize + blockSize;
+    }
+    pending.erase(0, offset);
+}
+
+
+/// <summary>Gets the number of block stream bytes of the complete blocks.</summary>
+/// <returns>Number of block stream bytes that were decoded</returns>
+size_t LZStreamDecoder::GetConsumed() const
+{
+    return consumed;
+}
+
+
+/// <summary>Gets the number of bytes the complete blocks decoded to.</summary>
+/// <returns>Number of decoded bytes</returns>
+size_t LZStreamDecoder::GetDecoded() const
+{
+    return decoded;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+
+// Payloads smaller than this are send as is, the savings would not be worth the time.
+constexpr size_t RP_COMPRESSION_THRESHOLD = 128;
+// Matches can reach back this far, including into the static dictionary.
+constexpr size_t RP_COMPRESSION_MAX_OFFSET = 0xFFFF;
+// Decompressed payloads larger than this are rejected.
+constexpr size_t RP_COMPRESSION_MAX_SIZE = 16 * 1024 * 1024;
+
+size_t lz_compress(std::string_view input, std::string& output);
+void lz_decompress(std::string_view input, std::string& output);
+// Block streams are split in independent blocks of this size, so they can be decompressed while they are received.
+constexpr size_t RP_COMPRESSION_BLOCK_SIZE = 1024 * 1024;
+
+size_t lz_compress_block(std::string_view input, std::string& output);
+size_t lz_compress_stream(std::string_view input, std::string& output);
+
+
+/// <summary>Decompresses a block stream from <see cref="lz_compress_stream"/> while it is received.</summary>
+class LZStreamDecoder
+{
+public:
+    explicit LZStreamDecoder(size_t consumed = 0, size_t decoded = 0);
+
+    void Update(std::string_view data, const std::function<void(std::string_view)>& write);
+    size_t GetConsumed() const;
+    size_t GetDecoded() const;
+
+private:
+    std::string pending;
+    std::string block;
+    size_t consumed = 0;
+    size_t decoded = 0;
+};
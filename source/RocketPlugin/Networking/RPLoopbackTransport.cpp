@@ -0,0 +1,159 @@
+#include "RPLoopbackTransport.h"
+
+#ifdef DEBUG
+
+
+/// <summary>Transport of a single simulated player.</summary>
+class RPLoopbackNetwork::Transport final : public RPTransport
+{
+public:
+    Transport(RPLoopbackNetwork& network, const size_t player) : network(network), player(player) {}
+
+    std::chrono::steady_clock::time_point Now() const override
+    {
+        return network.now;
+    }
+
+    uintptr_t GetMatch() override
+    {
+        return 1;
+    }
+
+    bool IsHost() override
+    {
+        return player == 0;
+    }
+
+    int IndexPlayers(std::unordered_map<int, RPPlayerIndexEntry>& playerIndex) override
+    {
+        for (size_t i = 0; i < network.GetPlayerCount(); i++) {
+            // Only the host can send messages directly to the clients, the owner is the simulated player + 1.
+            const uintptr_t owner = IsHost() || i == player ? i + 1 : 0;
+            playerIndex.insert_or_assign(network.GetPlayerId(i), RPPlayerIndexEntry{ 0, owner });
+        }
+
+        return network.GetPlayerId(player);
+    }
+
+    bool SendClient(const RPPlayerIndexEntry& receiver, const std::string& serializedMessage) override
+    {
+        network.send(receiver.Owner - 1, serializedMessage);
+
+        return true;
+    }
+
+    bool SendServer(const std::string& serializedMessage) override
+    {
+        network.send(0, serializedMessage);
+
+        return true;
+    }
+
+private:
+    RPLoopbackNetwork& network;
+    const size_t player;
+};
+
+
+/// <summary>Creates a network with the given amount of players.</summary>
+/// <param name="players">Amount of players, including the host</param>
+/// <param name="settings">Network conditions to simulate</param>
+RPLoopbackNetwork::RPLoopbackNetwork(const size_t players, const Settings& settings)
+    : settings(settings), random(settings.Seed)
+{
+    for (size_t i = 0; i < players; i++) {
+        netCodes.push_back(std::make_unique<RPNetCode>(std::make_unique<Transport>(*this, i)));
+    }
+}
+
+
+/// <summary>Gets the amount of players, including the host.</summary>
+/// <returns>The amount of players</returns>
+size_t RPLoopbackNetwork::GetPlayerCount() const
+{
+    return netCodes.size();
+}
+
+
+/// <summary>Gets the player id of the given simulated player.</summary>
+/// <param name="player">Index of the simulated player</param>
+/// <returns>Player id of the simulated player</returns>
+int RPLoopbackNetwork::GetPlayerId(const size_t player) const
+{
+    return static_cast<int>(player) + 1;
+}
+
+
+/// <summary>Gets the net code of the given simulated player.</summary>
+/// <param name="player">Index of the simulated player</param>
+/// <returns>Net code of the simulated player</returns>
+RPNetCode& RPLoopbackNetwork::GetNetCode(const size_t player) const
+{
+    return *netCodes.at(player);
+}
+
+
+/// <summary>Gets the simulated time.</summary>
+/// <returns>The simulated time</returns>
+std::chrono::steady_clock::time_point RPLoopbackNetwork::Now() const
+{
+    return now;
+}
+
+
+/// <summary>Gets if there are no messages in flight.</summary>
+/// <returns>Bool with if there are no messages in flight</returns>
+bool RPLoopbackNetwork::IsIdle() const
+{
+    return inFlight.empty();
+}
+
+
+/// <summary>Changes the simulated network conditions, packets already in flight keep their delivery time.</summary>
+/// <param name="newSettings">Network conditions to simulate from now on</param>
+void RPLoopbackNetwork::SetSettings(const Settings& newSettings)
+{
+    settings = newSettings;
+}
+
+
+/// <summary>Advances the simulated time, delivers the messages that arrived and flushes every player.</summary>
+/// <param name="duration">Time to advance</param>
+void RPLoopbackNetwork::Tick(const std::chrono::microseconds duration)
+{
+    now += duration;
+    while (!inFlight.empty() && inFlight.begin()->first <= now) {
+        const Packet packet = std::move(inFlight.extract(inFlight.begin()).mapped());
+        ++MessagesDelivered;
+        netCodes[packet.Receiver]->receive(packet.Data);
+    }
+
+    for (const std::unique_ptr<RPNetCode>& netCode : netCodes) {
+        netCode->Flush();
+    }
+}
+
+
+/// <summary>Puts the message in flight to the given player.</summary>
+/// <param name="receiver">Index of the simulated player to send the message to</param>
+/// <param name="serializedMessage">Message to send</param>
+void RPLoopbackNetwork::send(const size_t receiver, const std::string& serializedMessage)
+{
+    ++MessagesSend;
+    std::uniform_real_distribution<double> chance(0, 1);
+    if (chance(random) < settings.Loss) {
+        ++MessagesLost;
+        return;
+    }
+
+    auto delay = settings.Latency;
+    if (settings.Jitter.count() > 0) {
+        delay += std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, settings.Jitter.count())(random));
+    }
+    if (chance(random) < settings.Reorder) {
+        delay += std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, settings.Latency.count())(random));
+    }
+
+    inFlight.emplace(now + delay, Packet{ receiver, RP_MESSAGE_SIGNATURE + serializedMessage });
+}
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+#include "RPNetCode.h"
+
+// Only used by the debug notifiers, so it is left out of release builds like them.
+#ifdef DEBUG
+
+
+/// <summary>In process network of simulated players, to exercise the net code outside of the game.</summary>
+/// <remarks>
+/// Player 0 is the host, like in the game clients can only send messages to the host, which forwards them.
+/// Time is simulated, so a run with the same settings and seed always behaves the same.
+/// </remarks>
+class RPLoopbackNetwork
+{
+public:
+    struct Settings
+    {
+        std::chrono::microseconds Latency = std::chrono::milliseconds(50);
+        std::chrono::microseconds Jitter = std::chrono::milliseconds(0);
+        // Chance between 0 and 1 that a message gets lost.
+        double Loss = 0;
+        // Chance between 0 and 1 that a message gets delayed past the messages send after it.
+        double Reorder = 0;
+        uint32_t Seed = 0;
+    };
+
+    RPLoopbackNetwork(size_t players, const Settings& settings);
+
+    size_t GetPlayerCount() const;
+    int GetPlayerId(size_t player) const;
+    RPNetCode& GetNetCode(size_t player) const;
+    std::chrono::steady_clock::time_point Now() const;
+    bool IsIdle() const;
+    void SetSettings(const Settings& newSettings);
+
+    void Tick(std::chrono::microseconds duration);
+
+    size_t MessagesSend = 0;
+    size_t MessagesLost = 0;
+    size_t MessagesDelivered = 0;
+
+private:
+    class Transport;
+
+    struct Packet
+    {
+        size_t Receiver = 0;
+        std::string Data;
+    };
+
+    void send(size_t receiver, const std::string& serializedMessage);
+
+    Settings settings;
+    std::mt19937 random;
+    std::chrono::steady_clock::time_point now;
+    // Packets with the same delivery time are delivered in the order they were send.
+    std::multimap<std::chrono::steady_clock::time_point, Packet> inFlight;
+    std::vector<std::unique_ptr<RPNetCode>> netCodes;
+};
+#endif
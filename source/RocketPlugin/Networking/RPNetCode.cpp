@@ -1,129 +1,328 @@
 #include "RPNetCode.h"
+#include "ReplicatedState.h"
+#include "RPCompression.h"
 
 #include "RocketPlugin.h"
 
 
-const std::string base64array = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+/// <summary>Gets the number of bytes needed to varint encode the given value.</summary>
+/// <param name="value">Value to encode</param>
+/// <returns>Size of the encoded value</returns>
+size_t varint_size(size_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+
+    return size;
+}
+
+
+/// <summary>Varint encodes the given value.</summary>
+/// <param name="buffer">Buffer to write to</param>
+/// <param name="value">Value to encode</param>
+/// <returns>Number of bytes written</returns>
+size_t write_varint(char* buffer, size_t value)
+{
+    size_t i = 0;
+    while (value >= 0x80) {
+        buffer[i++] = static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    buffer[i++] = static_cast<char>(value);
+
+    return i;
+}
 
-/// <summary>Encodes a single value to base64.</summary>
-/// <param name="value">Value to convert</param>
-/// <returns>Base64 character</returns>
-char encode_base64(const uint6_t value)
+
+/// <summary>Decodes a varint from the given buffer.</summary>
+/// <param name="buffer">Buffer to read from</param>
+/// <param name="bufferSize">Size of the buffer</param>
+/// <param name="value">Decoded value</param>
+/// <returns>Number of bytes read, or 0 if the varint is invalid</returns>
+size_t read_varint(const char* buffer, const size_t bufferSize, size_t& value)
+{
+    value = 0;
+    for (size_t i = 0; i < bufferSize && i < RP_MESSAGE_MAX_LENGTH_SIZE; i++) {
+        const unsigned char byte = static_cast<unsigned char>(buffer[i]);
+        value |= static_cast<size_t>(byte & 0x7F) << (i * 7);
+        if ((byte & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/// <summary>Checks if the sequence number is newer than the other, handles wrapping around.</summary>
+/// <param name="sequence">Sequence number to check</param>
+/// <param name="other">Sequence number to compare against</param>
+/// <returns>Bool with if the sequence number is newer</returns>
+bool sequence_newer(const uint16_t sequence, const uint16_t other)
 {
-    return base64array[value & 0x3F];
+    return static_cast<int16_t>(static_cast<uint16_t>(sequence - other)) > 0;
 }
 
 
-/// <summary>Decodes a single value from base64.</summary>
-/// <param name="value">Base64 character</param>
-/// <returns>Decoded value</returns>
-uint6_t decode_base64(const char value)
+/// <summary>Gets the nanoseconds since the given time point.</summary>
+/// <param name="start">Time point to measure from</param>
+/// <returns>Elapsed nanoseconds</returns>
+uint64_t elapsed_ns(const std::chrono::steady_clock::time_point start)
 {
-    return static_cast<uint6_t>(base64array.find(value));
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+
+/// <summary>Adds a value to the histogram.</summary>
+/// <param name="value">Value to add</param>
+void RPHistogram::Add(const uint64_t value)
+{
+    ++Buckets[std::bit_width(value)];
+    ++Count;
+    Sum += value;
+}
+
+
+/// <summary>Gets an upper bound of the given percentile.</summary>
+/// <param name="percentile">Percentile to get, between 0 and 1</param>
+/// <returns>Upper bound of the bucket the percentile falls in</returns>
+uint64_t RPHistogram::Percentile(const double percentile) const
+{
+    const uint64_t target = static_cast<uint64_t>(std::ceil(percentile * static_cast<double>(Count)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < Buckets.size(); i++) {
+        seen += Buckets[i];
+        if (seen >= target && seen > 0) {
+            return i == 0 ? 0 : (i >= 64 ? UINT64_MAX : (uint64_t(1) << i) - 1);
+        }
+    }
+
+    return 0;
 }
 
 
 /// <summary>Serializes the message header.</summary>
-/// <returns>Serialized message header</returns>
-std::string RPMessageHeader::Serialize() const
+/// <param name="buffer">Buffer to serialize the header into</param>
+/// <param name="bufferSize">Size of the buffer</param>
+/// <returns>Number of bytes written</returns>
+size_t RPMessageHeader::Serialize(char* buffer, const size_t bufferSize) const
 {
-    BitBinaryWriter<unsigned char> bbw(RP_MESSAGE_HEADER_SIZE);
-    bbw.WriteBits(Version);
-    bbw.WriteBits(ModuleId);
-    bbw.WriteBits(SenderId);
-    bbw.WriteBits(ReceiverId);
+    if (bufferSize < RP_MESSAGE_HEADER_SIZE) {
+        throw std::range_error("buffer too small for message header");
+    }
 
-    const std::string serializedHeader = bbw.ToHex();
-    return encode_base64(static_cast<uint6_t>(serializedHeader.length() + 1)) + serializedHeader;
+    const uint16_t packed = static_cast<uint16_t>((Version & 0x1F) | (ModuleId & 0x3F) << 5 | (Flags & 0x07) << 11 |
+        (static_cast<uint8_t>(Channel) & 0x03) << 14);
+    write_le(buffer, packed);
+    write_le(buffer + 2, Sequence);
+    write_le(buffer + 4, static_cast<int32_t>(SenderId));
+    write_le(buffer + 8, static_cast<int32_t>(ReceiverId));
+
+    return RP_MESSAGE_HEADER_SIZE;
 }
 
 
 /// <summary>Deserializes the message header.</summary>
-void RPMessageHeader::Deserialize(const std::string& message)
+/// <param name="buffer">Buffer to deserialize the header from</param>
+/// <param name="bufferSize">Size of the buffer</param>
+/// <returns>Number of bytes read</returns>
+size_t RPMessageHeader::Deserialize(const char* buffer, const size_t bufferSize)
 {
-    headerSize = decode_base64(message.front());
-    if (message.length() < headerSize) {
+    if (bufferSize < RP_MESSAGE_HEADER_SIZE) {
         throw std::range_error("invalid message size");
     }
 
-    BitBinaryReader<unsigned char> bbr(message.substr(1));
-    Version = bbr.ReadBits<uint6_t>();
-    ModuleId = bbr.ReadBits<NetId>();
-    SenderId = bbr.ReadBits<int>();
-    ReceiverId = bbr.ReadBits<int>();
+    const uint16_t packed = read_le<uint16_t>(buffer);
+    Version = static_cast<uint6_t>(packed & 0x1F);
+    ModuleId = static_cast<NetId>((packed >> 5) & 0x3F);
+    Flags = static_cast<uint8_t>((packed >> 11) & 0x07);
+    Channel = static_cast<RPChannel>((packed >> 14) & 0x03);
+    Sequence = read_le<uint16_t>(buffer + 2);
+    SenderId = read_le<int32_t>(buffer + 4);
+    ReceiverId = read_le<int32_t>(buffer + 8);
+
+    return RP_MESSAGE_HEADER_SIZE;
 }
 
 
-/// <summary>Deserializes the message.</summary>
+/// <summary>Gets the size of the serialized message.</summary>
+/// <returns>Size of the serialized message</returns>
+size_t RPMessage::SerializedSize() const
+{
+    return RP_MESSAGE_HEADER_SIZE + varint_size(Message.size()) + Message.size();
+}
+
+
+/// <summary>Serializes the message into the given buffer.</summary>
+/// <param name="buffer">Buffer to serialize the message into</param>
+/// <param name="bufferSize">Size of the buffer</param>
+/// <returns>Number of bytes written</returns>
+size_t RPMessage::Serialize(char* buffer, const size_t bufferSize) const
+{
+    if (bufferSize < SerializedSize()) {
+        throw std::range_error("buffer too small for message");
+    }
+
+    size_t offset = RPMessageHeader::Serialize(buffer, bufferSize);
+    offset += write_varint(buffer + offset, Message.size());
+    std::memcpy(buffer + offset, Message.data(), Message.size());
+
+    return offset + Message.size();
+}
+
+
+/// <summary>Serializes the message.</summary>
 /// <returns>Serialized message</returns>
 std::string RPMessage::Serialize() const
 {
-    return RPMessageHeader::Serialize() + Message;
+    std::string serializedMessage(SerializedSize(), '\0');
+    Serialize(serializedMessage.data(), serializedMessage.size());
+
+    return serializedMessage;
 }
 
 
 /// <summary>Deserializes the message.</summary>
-void RPMessage::Deserialize(const std::string& message)
+/// <remarks>Copies the payload, use <see cref="RPMessageView"/> to avoid the copy.</remarks>
+/// <param name="message">Serialized message</param>
+void RPMessage::Deserialize(const std::string_view message)
+{
+    RPMessageView messageView;
+    messageView.Deserialize(message);
+
+    static_cast<RPMessageHeader&>(*this) = messageView;
+    Message.assign(messageView.Message);
+}
+
+
+/// <summary>Deserializes the message without copying the payload.</summary>
+/// <remarks>Stops after the header if the message version does not match.</remarks>
+/// <param name="message">Serialized message, has to outlive the view</param>
+/// <returns>Number of bytes read</returns>
+size_t RPMessageView::Deserialize(const std::string_view message)
 {
-    RPMessageHeader::Deserialize(message);
-    Message = message.substr(headerSize);
+    size_t offset = RPMessageHeader::Deserialize(message.data(), message.size());
+    if (Version != RP_MESSAGE_VERSION) {
+        Message = {};
+        return offset;
+    }
+
+    size_t messageSize = 0;
+    const size_t lengthSize = read_varint(message.data() + offset, message.size() - offset, messageSize);
+    offset += lengthSize;
+    if (lengthSize == 0 || message.size() - offset < messageSize) {
+        throw std::range_error("invalid message size");
+    }
+
+    Message = message.substr(offset, messageSize);
+
+    return offset + messageSize;
 }
 
 
 /// <summary>Initializes the networked module.</summary>
-NetworkedModule::NetworkedModule()
-    : netId(RocketPluginModule::Outer()->netCode.Register(this))
+/// <param name="netId">NetId of the networked module, from net_id_of</param>
+NetworkedModule::NetworkedModule(const NetId netId)
+    : NetworkedModule(netId, RocketPluginModule::Outer()->netCode)
 {}
 
 
-/// <summary>Sends a message to the given pri.</summary>
+/// <summary>Initializes the networked module on the given net code.</summary>
+/// <param name="netId">NetId of the networked module, from net_id_of</param>
+/// <param name="netCode">Net code to send and receive messages with</param>
+NetworkedModule::NetworkedModule(const NetId netId, RPNetCode& netCode)
+    : netCode(netCode), netId(netId)
+{
+    netCode.Register(this);
+}
+
+
+/// <summary>Stops receiving messages for the networked module.</summary>
+NetworkedModule::~NetworkedModule()
+{
+    netCode.Deregister(this);
+}
+
+
+/// <summary>Queues a message to the given pri, it gets send on the next game tick.</summary>
 /// <param name="pri">Pri to send the message to</param>
 /// <param name="message">Message to send</param>
-/// <returns>Bool with if the message was send successfully</returns>
-bool NetworkedModule::SendMessageTo(PriWrapper pri, const std::string& message) const
+/// <param name="channel">Channel to send the message over</param>
+/// <param name="coalesceKey">Optional key, replaces queued messages with the same key</param>
+/// <returns>Bool with if the message was queued successfully</returns>
+bool NetworkedModule::SendMessageTo(PriWrapper pri, const std::string& message, const RPChannel channel, const uint16_t coalesceKey) const
 {
-    ServerWrapper game = RocketPluginModule::Outer()->GetGame(true);
-    BMCHECK(game, false);
+    BMCHECK(pri, false);
 
-    ControllerWrapper localPlayerController = game.GetLocalPrimaryPlayer().memory_address;
-    BMCHECK(localPlayerController, false);
+    return SendMessageToPlayer(pri.GetPlayerID(), message, channel, coalesceKey);
+}
 
-    PlayerReplicationInfoWrapper localPri = localPlayerController.GetPlayerReplicationInfo();
-    BMCHECK(localPri, false);
 
-    const RPMessageHeader header(netId, localPri.GetPlayerID(), pri.GetPlayerID());
-    return RocketPluginModule::Outer()->netCode.send(RPMessage(header, message));
+/// <summary>Queues a message to the player with the given player id, it gets send on the next game tick.</summary>
+/// <param name="playerId">Player id of the player to send the message to</param>
+/// <param name="message">Message to send</param>
+/// <param name="channel">Channel to send the message over</param>
+/// <param name="coalesceKey">Optional key, replaces queued messages with the same key</param>
+/// <returns>Bool with if the message was queued successfully</returns>
+bool NetworkedModule::SendMessageToPlayer(const int playerId, const std::string& message, const RPChannel channel,
+    const uint16_t coalesceKey) const
+{
+    const int localPlayerId = netCode.GetLocalPlayerId();
+    if (localPlayerId == INVALID_PLAYER_ID) {
+        BM_ERROR_LOG("could not find the local player");
+        return false;
+    }
+
+    RPMessageHeader header(netId, localPlayerId, playerId);
+    header.Channel = channel;
+    return netCode.queue(RPMessage(header, message), coalesceKey);
 }
 
 
-/// <summary>Broadcast a message to all players.</summary>
+/// <summary>Queues a message to all players, it gets send on the next game tick.</summary>
 /// <param name="message">Message to broadcast</param>
-/// <returns>Bool with if the message was broadcasted successfully</returns>
-bool NetworkedModule::BroadcastMessage(const std::string& message) const
+/// <param name="channel">Channel to send the message over</param>
+/// <param name="coalesceKey">Optional key, replaces queued messages with the same key</param>
+/// <returns>Bool with if the message was queued successfully</returns>
+bool NetworkedModule::BroadcastMessage(const std::string& message, const RPChannel channel, const uint16_t coalesceKey) const
 {
-    ServerWrapper game = RocketPluginModule::Outer()->GetGame(true);
-    BMCHECK(game, false);
-
-    ControllerWrapper localPlayerController = game.GetLocalPrimaryPlayer().memory_address;
-    BMCHECK(localPlayerController, false);
-
-    PlayerReplicationInfoWrapper localPri = localPlayerController.GetPlayerReplicationInfo();
-    BMCHECK(localPri, false);
+    const int localPlayerId = netCode.GetLocalPlayerId();
+    if (localPlayerId == INVALID_PLAYER_ID) {
+        BM_ERROR_LOG("could not find the local player");
+        return false;
+    }
 
-    bool sendSuccessful = true;
-    for (PriWrapper pri : game.GetPRIs()) {
-        BMCHECK_LOOP(pri);
-        if (localPri.GetPlayerID() == pri.GetPlayerID()) {
+    bool queueSuccessful = true;
+    for (const auto& [playerId, entry] : netCode.playerIndex) {
+        if (playerId == localPlayerId) {
             continue;
         }
-        const RPMessageHeader header(netId, localPri.GetPlayerID(), pri.GetPlayerID());
-        sendSuccessful &= RocketPluginModule::Outer()->netCode.send(RPMessage(header, message));
+        RPMessageHeader header(netId, localPlayerId, playerId);
+        header.Channel = channel;
+        queueSuccessful &= netCode.queue(RPMessage(header, message), coalesceKey);
     }
 
-    return sendSuccessful;
+    return queueSuccessful;
 }
 
 
+/// <summary>Initializes the net code, sending messages through the game.</summary>
+RPNetCode::RPNetCode()
+    : RPNetCode(std::make_unique<RPGameTransport>())
+{}
+
+
+/// <summary>Initializes the net code, sending messages through the given transport.</summary>
+/// <param name="transport">Transport to send messages with</param>
+RPNetCode::RPNetCode(std::unique_ptr<RPTransport> transport)
+    : transport(std::move(transport))
+{}
+
+
 /// <summary></summary>
 void RPNetCode::Init()
 {
@@ -133,183 +332,804 @@ void RPNetCode::Init()
 
 /// <summary>Register a networked module</summary>
 /// <param name="networkedModule">Networked module to register</param>
-/// <returns>NetId for the registered networked module</returns>
-NetId RPNetCode::Register(NetworkedModule* networkedModule)
+void RPNetCode::Register(NetworkedModule* networkedModule)
 {
-    for (auto& [netModule, enabled] : registeredModules) {
-        if (netModule == networkedModule) {
-            enabled = true;
-            return netModule->netId;
-        }
+    const NetId netId = networkedModule->netId;
+    if (netId == INVALID_NET_ID || netId > RP_MAX_NET_ID) {
+        throw std::range_error("invalid net id " + std::to_string(netId));
     }
 
-    registeredModules.push_back(std::make_pair(networkedModule, true));
-
-    return static_cast<uint8_t>(registeredModules.size());
+    NetworkedModule*& registeredModule = registeredModules[netId];
+    if (registeredModule != nullptr && registeredModule != networkedModule) {
+        BM_WARNING_LOG("replacing networked module {:d}", netId);
+    }
+    registeredModule = networkedModule;
 }
 
 
 /// <summary>Deregister a networked module</summary>
-/// <param name="netId">NetId of the networked module to deregister</param>
-void RPNetCode::Deregister(const NetId netId)
+/// <param name="networkedModule">Networked module to deregister</param>
+void RPNetCode::Deregister(const NetworkedModule* networkedModule)
+{
+    NetworkedModule*& registeredModule = registeredModules[networkedModule->netId & RP_MAX_NET_ID];
+    if (registeredModule == networkedModule) {
+        registeredModule = nullptr;
+    }
+}
+
+
+/// <summary>Marks the player index as outdated, so it gets rebuild on the next lookup.</summary>
+/// <remarks>Gets called when players join or leave the match.</remarks>
+void RPNetCode::InvalidatePlayerIndex()
 {
-    registeredModules.at(netId).second = false;
+    playerIndexDirty = true;
 }
 
 
-/// <summary>Gets the owner of the given pri.</summary>
-/// <param name="pri">Pri to get the owner from</param>
-/// <returns>The owner of the pri</returns>
-PlayerControllerWrapper get_owner(PriWrapper& pri)
+/// <summary>Rebuilds the player index if it is outdated or belongs to another match.</summary>
+/// <returns>Bool with if there is a match to index</returns>
+bool RPNetCode::updatePlayerIndex()
 {
-    BMCHECK(pri, NULL);
+    const uintptr_t match = transport->GetMatch();
+    if (match == 0) {
+        playerIndex.clear();
+        playerIndexGame = 0;
+        localPlayerId = INVALID_PLAYER_ID;
+        channelsNeedPruning = !channels.empty();
+        return false;
+    }
 
-    return PlayerControllerWrapper(pri.GetOwner().memory_address);
+    if (!playerIndexDirty && playerIndexGame == match) {
+        return true;
+    }
+
+    playerIndex.clear();
+    playerIndexGame = match;
+    localPlayerId = transport->IndexPlayers(playerIndex);
+
+    // Keep rebuilding until our own player has been replicated.
+    playerIndexDirty = localPlayerId == INVALID_PLAYER_ID;
+    channelsNeedPruning = !channels.empty();
+
+    return true;
+}
+
+
+/// <summary>Gets the pri of the player with the given player id.</summary>
+/// <param name="playerId">Player id of the player to get the pri from</param>
+/// <returns>The pri of the player with the given player id</returns>
+PriWrapper RPNetCode::GetPri(const int playerId)
+{
+    if (!updatePlayerIndex()) {
+        return NULL;
+    }
+
+    const auto it = playerIndex.find(playerId);
+    if (it == playerIndex.end()) {
+        return NULL;
+    }
+
+    return PriWrapper(it->second.Pri);
 }
 
 
 /// <summary>Gets the owner of the player with the given player id.</summary>
 /// <param name="playerId">Player id of the player to get the owner from</param>
 /// <returns>The owner of the player with the given player id</returns>
-PlayerControllerWrapper get_owner(const int playerId)
+PlayerControllerWrapper RPNetCode::GetOwner(const int playerId)
 {
-    ServerWrapper game = RocketPluginModule::Outer()->GetGame(true);
-    BMCHECK(game, NULL);
+    if (!updatePlayerIndex()) {
+        return NULL;
+    }
+
+    const auto it = playerIndex.find(playerId);
+    if (it == playerIndex.end()) {
+        return NULL;
+    }
+
+    return PlayerControllerWrapper(it->second.Owner);
+}
 
-    for (PriWrapper pri : game.GetPRIs()) {
-        BMCHECK_LOOP(pri);
 
-        if (pri.GetPlayerID() == playerId) {
-            return get_owner(pri);
+/// <summary>Gets the player id of the local player.</summary>
+/// <returns>The player id of the local player</returns>
+int RPNetCode::GetLocalPlayerId()
+{
+    if (!updatePlayerIndex()) {
+        return INVALID_PLAYER_ID;
+    }
+
+    return localPlayerId;
+}
+
+
+/// <summary>Queues the given message to be send on the next flush.</summary>
+/// <remarks>Queued messages with the same module and coalesce key are superseded by the new message.</remarks>
+/// <param name="message">Message to queue</param>
+/// <param name="coalesceKey">Key to coalesce messages with</param>
+/// <returns>Bool with if the message was queued successfully</returns>
+bool RPNetCode::queue(RPMessage message, const uint16_t coalesceKey)
+{
+    // Compress once when queuing, so retransmits of reliable messages reuse the compressed payload.
+    if (message.Message.size() >= RP_COMPRESSION_THRESHOLD && lz_compress(message.Message, compressionBuffer) < message.Message.size()) {
+        ++metrics.MessagesCompressed;
+        metrics.BytesSavedByCompression += message.Message.size() - compressionBuffer.size();
+        message.Message.swap(compressionBuffer);
+        message.Flags |= RP_MESSAGE_FLAG_COMPRESSED;
+    }
+
+    std::vector<QueuedMessage>& messages = outgoingMessages[message.ReceiverId];
+    if (coalesceKey != RP_NO_COALESCE_KEY) {
+        const auto it = std::ranges::find_if(messages, [&](const QueuedMessage& queuedMessage) {
+            return queuedMessage.CoalesceKey == coalesceKey && queuedMessage.Message.ModuleId == message.ModuleId;
+        });
+        if (it != messages.end()) {
+            // Drop the superseded message, but keep the order of the newer message.
+            messages.erase(it);
+            --queuedMessages;
         }
     }
 
-    return NULL;
+    messages.push_back({ std::move(message), coalesceKey });
+    ++queuedMessages;
+
+    return true;
 }
 
 
-/// <summary>Gets the pri of the player with the given player id.</summary>
-/// <param name="playerId">Player id of the player to get the pri from</param>
-/// <returns>The pri of the player with the given player id</returns>
-PriWrapper get_pri(const int playerId)
+/// <summary>Gets the networked message metrics.</summary>
+/// <returns>The networked message metrics</returns>
+const RPNetMetrics& RPNetCode::GetMetrics() const
+{
+    return metrics;
+}
+
+
+/// <summary>Resets the networked message metrics.</summary>
+void RPNetCode::ResetMetrics()
 {
-    ServerWrapper game = RocketPluginModule::Outer()->GetGame(true);
-    BMCHECK(game, NULL);
+    metrics = RPNetMetrics();
+}
 
-    for (PriWrapper pri : game.GetPRIs()) {
-        BMCHECK_LOOP(pri);
 
-        if (pri.GetPlayerID() == playerId) {
-            return pri;
+/// <summary>Formats the networked message metrics.</summary>
+/// <returns>Human readable metrics, one line per entry</returns>
+std::string RPNetCode::GetMetricsReport() const
+{
+    constexpr std::array dropReasons = { "version mismatch", "unknown module", "own message", "outdated", "duplicate", "malformed" };
+    static_assert(dropReasons.size() == static_cast<size_t>(RPDropReason::COUNT));
+
+    std::string report = fmt::format("send {:d} messages ({:d} bytes), received {:d} messages ({:d} bytes), forwarded {:d} messages ({:d} bytes)\n",
+        metrics.MessagesSend, metrics.BytesSend, metrics.MessagesReceived, metrics.BytesReceived,
+        metrics.MessagesForwarded, metrics.BytesForwarded);
+    report += fmt::format("compressed {:d} messages, saving {:d} bytes\n", metrics.MessagesCompressed, metrics.BytesSavedByCompression);
+    for (const auto& [name, histogram] : { std::pair("encode", &metrics.EncodeNs), std::pair("decode", &metrics.DecodeNs) }) {
+        report += fmt::format("{:s}: {:d} samples, avg {:d}ns, p50 <{:d}ns, p99 <{:d}ns\n", name, histogram->Count,
+            histogram->Count == 0 ? 0 : histogram->Sum / histogram->Count, histogram->Percentile(0.5), histogram->Percentile(0.99));
+    }
+    for (size_t i = 0; i < dropReasons.size(); i++) {
+        report += fmt::format("dropped ({:s}): {:d}\n", dropReasons[i], metrics.Dropped[i]);
+    }
+    for (size_t netId = 0; netId < metrics.Modules.size(); netId++) {
+        const RPModuleMetrics& moduleMetrics = metrics.Modules[netId];
+        if (moduleMetrics.MessagesIn == 0 && moduleMetrics.MessagesOut == 0) {
+            continue;
+        }
+        std::string moduleName = "unknown";
+        if (netId == INVALID_NET_ID) {
+            moduleName = "RPNetCode";
+        }
+        else if (registeredModules[netId] != nullptr) {
+            moduleName = typeid(*registeredModules[netId]).name();
         }
+        report += fmt::format("module {:d} {:s}: in {:d} messages ({:d} bytes), out {:d} messages ({:d} bytes)\n",
+            netId, moduleName, moduleMetrics.MessagesIn, moduleMetrics.BytesIn, moduleMetrics.MessagesOut, moduleMetrics.BytesOut);
     }
 
-    return NULL;
+    return report;
 }
 
 
-/// <summary>Sends the given message.</summary>
-/// <param name="message">Message to send</param>
-/// <returns>Bool with if the message was send successfully</returns>
-bool RPNetCode::send(const RPMessage& message)
+/// <summary>Sends all queued messages, batching messages to the same receiver.</summary>
+/// <remarks>Gets called every game tick.</remarks>
+void RPNetCode::Flush()
 {
-    ServerWrapper game = Outer()->GetGame(true);
-    BMCHECK(game, false);
+    if (channelsNeedPruning) {
+        pruneChannels();
+    }
+    replicate();
+    if (queuedMessages == 0 && reliableMessagesPending == 0) {
+        return;
+    }
 
-    PlayerControllerWrapper localPlayerController = game.GetLocalPrimaryPlayer();
-    BMCHECK(localPlayerController, false);
+    const int localId = GetLocalPlayerId();
+    if (localId == INVALID_PLAYER_ID) {
+        for (auto& [receiverId, messages] : outgoingMessages) {
+            messages.clear();
+        }
+        queuedMessages = 0;
+        return;
+    }
 
-    PlayerControllerWrapper receiversController = get_owner(message.ReceiverId);
-    // If we know the owner, we can send them a direct message.
-    if (!receiversController.IsNull()) {
-        return sendClient(receiversController, message.Serialize());
+    // Resend and unblock older reliable messages first, so they keep the lower sequence numbers.
+    retransmit();
+    for (auto& [receiverId, messages] : outgoingMessages) {
+        for (QueuedMessage& queuedMessage : messages) {
+            sequenceMessage(std::move(queuedMessage.Message));
+        }
+        messages.clear();
     }
+    queuedMessages = 0;
 
-    // Otherwise we ask the server to redirect our message.
-    return sendServer(localPlayerController, message.Serialize());
+    for (auto& [receiverId, messages] : sequencedMessages) {
+        for (const RPMessage& message : messages) {
+            RPModuleMetrics& moduleMetrics = metrics.Modules[message.ModuleId & 0x3F];
+            ++moduleMetrics.MessagesOut;
+            moduleMetrics.BytesOut += message.SerializedSize();
+        }
+
+        size_t begin = 0;
+        while (begin < messages.size()) {
+            // Collect as many messages as fit in a single batch.
+            size_t end = begin + 1;
+            size_t batchSize = messages[begin].SerializedSize();
+            while (end < messages.size() && batchSize + messages[end].SerializedSize() <= RP_MESSAGE_MAX_BATCH_SIZE) {
+                batchSize += messages[end].SerializedSize();
+                ++end;
+            }
+
+            if (end - begin == 1) {
+                send(messages[begin]);
+            }
+            else {
+                batchMessage.ModuleId = INVALID_NET_ID;
+                batchMessage.Flags = RP_MESSAGE_FLAG_BATCH;
+                batchMessage.SenderId = localId;
+                batchMessage.ReceiverId = receiverId;
+                batchMessage.Message.resize(batchSize);
+                size_t offset = 0;
+                for (size_t i = begin; i < end; i++) {
+                    offset += messages[i].Serialize(batchMessage.Message.data() + offset, batchSize - offset);
+                }
+                send(batchMessage);
+            }
+
+            begin = end;
+        }
+
+        // Clear instead of erase to keep the allocated capacity for the next tick.
+        messages.clear();
+    }
 }
 
 
-/// <summary>Sends the given message to a other client.</summary>
-/// <param name="player">Player to send the message to</param>
-/// <param name="serializedMessage">Message to send</param>
-/// <returns>Bool with if the message was send successfully</returns>
-bool RPNetCode::sendClient(const PlayerControllerWrapper& player, const std::string& serializedMessage)
+/// <summary>Gets the state of the channel between us and the given player.</summary>
+/// <param name="playerId">Player id of the other side of the channel</param>
+/// <param name="moduleId">NetId of the networked module that uses the channel</param>
+/// <param name="channel">Channel type</param>
+/// <returns>The state of the channel</returns>
+RPNetCode::ChannelState& RPNetCode::getChannel(const int playerId, const NetId moduleId, const RPChannel channel)
 {
-    BM_WARNING_LOG("redacted function");
+    const uint64_t key = static_cast<uint64_t>(static_cast<uint32_t>(playerId)) << 32 |
+        static_cast<uint64_t>(moduleId) << 8 | static_cast<uint8_t>(channel);
+    const auto [it, inserted] = channels.try_emplace(key);
+    if (inserted) {
+        it->second.PlayerId = playerId;
+        it->second.ModuleId = moduleId;
+        it->second.Channel = channel;
+    }
+
+    return it->second;
+}
+
+
+/// <summary>Removes the channels and replication history of players that left the match.</summary>
+void RPNetCode::pruneChannels()
+{
+    std::erase_if(channels, [this](const auto& channel) {
+        return !playerIndex.contains(channel.second.PlayerId);
+    });
+    for (NetworkedModule* netModule : registeredModules) {
+        if (netModule == nullptr) {
+            continue;
+        }
+        if (ReplicatedState* replicatedState = netModule->GetReplicatedState()) {
+            std::erase_if(replicatedState->peers, [this](const auto& peer) {
+                return !playerIndex.contains(peer.first);
+            });
+        }
+    }
 
-    return false;
+    reliableMessagesPending = 0;
+    for (const auto& [key, channel] : channels) {
+        reliableMessagesPending += channel.Unacked.size() + channel.Backlog.size() + (channel.ResetPending ? 1 : 0);
+    }
+    channelsNeedPruning = false;
 }
 
 
-/// <summary>Sends the given message to a other client through the server.</summary>
-/// <param name="player">Player to send the message to</param>
-/// <param name="serializedMessage">Message to send</param>
+/// <summary>Queues the changed fields of the replicated states for every player.</summary>
+/// <remarks>Only the host replicates its state.</remarks>
+void RPNetCode::replicate()
+{
+    int localId = INVALID_PLAYER_ID;
+    for (NetworkedModule* netModule : registeredModules) {
+        ReplicatedState* replicatedState = netModule != nullptr ? netModule->GetReplicatedState() : nullptr;
+        if (replicatedState == nullptr || !replicatedState->Enabled) {
+            continue;
+        }
+        if (localId == INVALID_PLAYER_ID) {
+            if (!transport->IsHost()) {
+                return;
+            }
+            localId = GetLocalPlayerId();
+            if (localId == INVALID_PLAYER_ID) {
+                return;
+            }
+        }
+
+        replicatedState->capture();
+        for (const auto& [playerId, entry] : playerIndex) {
+            if (playerId == localId || !replicatedState->writeDelta(playerId, transport->Now(), replicationBuffer)) {
+                continue;
+            }
+            RPMessageHeader header(netModule->netId, localId, playerId);
+            header.Channel = RPChannel::REPLICATION;
+            queue(RPMessage(header, replicationBuffer), RP_NO_COALESCE_KEY);
+        }
+    }
+}
+
+
+/// <summary>Gets if the next reliable message would be too far ahead of the oldest unacknowledged one.</summary>
+/// <remarks>
+/// Acks are selective, so the window spans sequence numbers rather than counting unacked messages.
+/// The window stays closed until the receiver acknowledged a pending reset.
+/// </remarks>
+/// <param name="channel">Channel to check</param>
+/// <returns>Bool with if the window is full</returns>
+bool RPNetCode::windowFull(const ChannelState& channel)
+{
+    return channel.ResetPending || (!channel.Unacked.empty() &&
+        static_cast<uint16_t>(channel.NextSequence - channel.Unacked.front().Message.Sequence) >= RP_RELIABLE_WINDOW_SIZE);
+}
+
+
+/// <summary>Gives the message a sequence number on its channel and readies it to be send.</summary>
+/// <remarks>Reliable messages are held back while their window is full.</remarks>
+/// <param name="message">Message to sequence</param>
+void RPNetCode::sequenceMessage(RPMessage message)
+{
+    if (message.Flags & RP_MESSAGE_FLAG_ACK) {
+        sequencedMessages[message.ReceiverId].push_back(std::move(message));
+        return;
+    }
+
+    ChannelState& channel = getChannel(message.ReceiverId, message.ModuleId, message.Channel);
+    // Replicated states acknowledge their own snapshots.
+    if (message.Channel == RPChannel::UNRELIABLE || message.Channel == RPChannel::REPLICATION) {
+        message.Sequence = channel.NextSequence++;
+        sequencedMessages[message.ReceiverId].push_back(std::move(message));
+        return;
+    }
+
+    ++reliableMessagesPending;
+    if (!channel.Backlog.empty() || windowFull(channel)) {
+        channel.Backlog.push_back(std::move(message));
+        return;
+    }
+
+    message.Sequence = channel.NextSequence++;
+    channel.Unacked.push_back({ message, transport->Now() });
+    sequencedMessages[message.ReceiverId].push_back(std::move(message));
+}
+
+
+/// <summary>Resends unacknowledged reliable messages and moves backlogged messages into their window.</summary>
+void RPNetCode::retransmit()
+{
+    const auto now = transport->Now();
+    for (auto& [key, channel] : channels) {
+        if (channel.ResetPending && now - channel.LastReset >= RP_RETRANSMIT_TIMEOUT) {
+            sendReset(channel, now);
+        }
+        for (UnackedMessage& unackedMessage : channel.Unacked) {
+            if (now - unackedMessage.LastSend < RP_RETRANSMIT_TIMEOUT) {
+                continue;
+            }
+            if (unackedMessage.Retransmits >= RP_MAX_RETRANSMITS) {
+                BM_WARNING_LOG("player {:d} stopped acknowledging messages, dropping {:d} reliable messages",
+                    channel.PlayerId, channel.Unacked.size() + channel.Backlog.size());
+                reliableMessagesPending -= channel.Unacked.size() + channel.Backlog.size();
+                channel.Unacked.clear();
+                channel.Backlog.clear();
+                // The receiver still waits on the dropped sequence numbers, so tell it where the channel continues.
+                channel.ResetPending = true;
+                channel.ResetSequence = channel.NextSequence++;
+                ++reliableMessagesPending;
+                sendReset(channel, now);
+                break;
+            }
+
+            unackedMessage.LastSend = now;
+            ++unackedMessage.Retransmits;
+            sequencedMessages[channel.PlayerId].push_back(unackedMessage.Message);
+        }
+
+        while (!channel.Backlog.empty() && !windowFull(channel)) {
+            RPMessage message = std::move(channel.Backlog.front());
+            channel.Backlog.pop_front();
+            message.Sequence = channel.NextSequence++;
+            channel.Unacked.push_back({ message, now });
+            sequencedMessages[channel.PlayerId].push_back(std::move(message));
+        }
+    }
+}
+
+
+/// <summary>Sends the given message.</summary>
+/// <param name="message">Message to send</param>
 /// <returns>Bool with if the message was send successfully</returns>
-bool RPNetCode::sendServer(const PlayerControllerWrapper& player, const std::string& serializedMessage)
+bool RPNetCode::send(const RPMessage& message)
 {
-    BM_WARNING_LOG("redacted function");
+    if (!updatePlayerIndex()) {
+        BM_ERROR_LOG("could not find the game");
+        return false;
+    }
+
+    // Reuse the send buffer, so we only allocate when a message is bigger than any before.
+    const auto encodeStart = std::chrono::steady_clock::now();
+    sendBuffer.resize(message.SerializedSize());
+    message.Serialize(sendBuffer.data(), sendBuffer.size());
+    metrics.EncodeNs.Add(elapsed_ns(encodeStart));
+    ++metrics.MessagesSend;
+    metrics.BytesSend += sendBuffer.size();
+
+    const auto it = playerIndex.find(message.ReceiverId);
+    // If we know the owner, we can send them a direct message.
+    if (it != playerIndex.end() && it->second.Owner != 0) {
+        return transport->SendClient(it->second, sendBuffer);
+    }
 
-    return false;
+    // Otherwise we ask the server to redirect our message.
+    return transport->SendServer(sendBuffer);
 }
 
 
 /// <summary>Gets called when a new message is received.</summary>
 /// <param name="serializedMessage">Message that was received.</param>
-void RPNetCode::receive(const std::string& serializedMessage)
+void RPNetCode::receive(const std::string_view serializedMessage)
 {
     if (!serializedMessage.starts_with(RP_MESSAGE_SIGNATURE)) {
-        BM_TRACE_LOG("Received non Rocket Plugin message {}.", quote(serializedMessage));
+        BM_TRACE_LOG("Received non Rocket Plugin message {}.", quote(std::string(serializedMessage)));
         return;
     }
 
-    ++messagesReceived;
-
-    ServerWrapper game = Outer()->GetGame(true);
-    BMCHECK(game);
+    ++metrics.MessagesReceived;
+    metrics.BytesReceived += serializedMessage.size();
 
-    PlayerControllerWrapper localController = game.GetLocalPrimaryPlayer();
-    BMCHECK(localController);
-
-    PriWrapper localPri = localController.GetPRI();
-    BMCHECK(localPri);
+    const int localId = GetLocalPlayerId();
+    if (localId == INVALID_PLAYER_ID) {
+        BM_ERROR_LOG("could not find the local player");
+        return;
+    }
 
-    RPMessage message;
-    message.Deserialize(serializedMessage.substr(RP_MESSAGE_SIGNATURE_SIZE));
+    // The message view points into the received buffer, so no copies are made until a module needs one.
+    const auto decodeStart = std::chrono::steady_clock::now();
+    RPMessageView message;
+    try {
+        message.Deserialize(serializedMessage.substr(RP_MESSAGE_SIGNATURE_SIZE));
+    }
+    catch (const std::range_error& e) {
+        BM_ERROR_LOG("dropping malformed message: {:s}", e.what());
+        ++metrics.Dropped[static_cast<size_t>(RPDropReason::MALFORMED)];
+        return;
+    }
+    metrics.DecodeNs.Add(elapsed_ns(decodeStart));
 
     if (message.Version != RP_MESSAGE_VERSION) {
         BM_CRITICAL_LOG("RPMessage version mismatch {:d} != {:d}", message.Version, RP_MESSAGE_VERSION);
+        ++metrics.Dropped[static_cast<size_t>(RPDropReason::VERSION_MISMATCH)];
         return;
     }
 
-    if (message.SenderId == localPri.GetPlayerID()) {
+    if (message.SenderId == localId) {
         BM_TRACE_LOG("received own message, skipping");
+        ++metrics.Dropped[static_cast<size_t>(RPDropReason::OWN_MESSAGE)];
         return;
     }
 
     BM_TRACE_LOG("Received {:d}->{:d}, {:d}: {:d}", message.SenderId, message.ReceiverId, message.ModuleId, message.Version);
 
     // If the message was not meant for us send it forward.
-    if (message.ReceiverId != localPri.GetPlayerID()) {
-        PlayerControllerWrapper receiversController = NULL;
-        for (PriWrapper pri : game.GetPRIs()) {
-            BMCHECK_LOOP(pri);
+    if (message.ReceiverId != localId) {
+        const auto it = playerIndex.find(message.ReceiverId);
+        if (it == playerIndex.end() || it->second.Owner == 0) {
+            BM_ERROR_LOG("could not forward message to {:d}", message.ReceiverId);
+            return;
+        }
+        ++metrics.MessagesForwarded;
+        metrics.BytesForwarded += serializedMessage.size();
+        transport->SendClient(it->second, std::string(serializedMessage.substr(RP_MESSAGE_SIGNATURE_SIZE)));
+        return;
+    }
+
+    // Resets carry the batch flag as well, but are never batches themselves.
+    if ((message.Flags & RP_MESSAGE_FLAG_RESET) == RP_MESSAGE_FLAG_BATCH) {
+        std::string_view batch = message.Message;
+        while (!batch.empty()) {
+            const auto batchDecodeStart = std::chrono::steady_clock::now();
+            RPMessageView batchedMessage;
+            try {
+                batch.remove_prefix(batchedMessage.Deserialize(batch));
+            }
+            catch (const std::range_error& e) {
+                // The rest of the batch can not be found without the size of this message.
+                BM_ERROR_LOG("dropping malformed batch from {:d}: {:s}", message.SenderId, e.what());
+                ++metrics.Dropped[static_cast<size_t>(RPDropReason::MALFORMED)];
+                return;
+            }
+            metrics.DecodeNs.Add(elapsed_ns(batchDecodeStart));
+            if (batchedMessage.Version != RP_MESSAGE_VERSION) {
+                BM_CRITICAL_LOG("RPMessage version mismatch {:d} != {:d}", batchedMessage.Version, RP_MESSAGE_VERSION);
+                ++metrics.Dropped[static_cast<size_t>(RPDropReason::VERSION_MISMATCH)];
+                return;
+            }
+            dispatch(batchedMessage);
+        }
+        return;
+    }
+
+    dispatch(message);
+}
+
+
+/// <summary>Passes the received message through its channel.</summary>
+/// <param name="message">Message to dispatch</param>
+void RPNetCode::dispatch(const RPMessageView& message)
+{
+    RPModuleMetrics& moduleMetrics = metrics.Modules[message.ModuleId & 0x3F];
+    ++moduleMetrics.MessagesIn;
+    moduleMetrics.BytesIn += RP_MESSAGE_HEADER_SIZE + varint_size(message.Message.size()) + message.Message.size();
 
-            if (pri.GetPlayerID() == message.ReceiverId) {
-                receiversController = get_owner(pri);
+    if ((message.Flags & RP_MESSAGE_FLAG_RESET) == RP_MESSAGE_FLAG_RESET) {
+        receiveReset(message);
+        return;
+    }
+    if (message.Flags & RP_MESSAGE_FLAG_ACK) {
+        receiveAck(message);
+        return;
+    }
+    if (message.Channel == RPChannel::REPLICATION) {
+        receiveReplication(message);
+        return;
+    }
+
+    ChannelState& channel = getChannel(message.SenderId, message.ModuleId, message.Channel);
+    switch (message.Channel) {
+        case RPChannel::UNRELIABLE:
+            // Latest wins, drop messages that arrive after a newer one.
+            if (channel.HasReceived && !sequence_newer(message.Sequence, channel.LastReceived)) {
+                BM_TRACE_LOG("dropping outdated message {:d} from {:d}", message.Sequence, message.SenderId);
+                ++metrics.Dropped[static_cast<size_t>(RPDropReason::OUTDATED)];
+                return;
+            }
+            channel.HasReceived = true;
+            channel.LastReceived = message.Sequence;
+            deliver(message, message.Message);
+            return;
+        case RPChannel::RELIABLE_UNORDERED:
+            // Always acknowledge, the previous ack might have been lost.
+            sendAck(message);
+            if (!channel.HasReceived || sequence_newer(message.Sequence, channel.LastReceived)) {
+                const uint16_t shift = static_cast<uint16_t>(message.Sequence - channel.LastReceived);
+                channel.ReceivedMask = channel.HasReceived && shift < 32 ? channel.ReceivedMask << shift : 0;
+                channel.ReceivedMask |= 1;
+                channel.HasReceived = true;
+                channel.LastReceived = message.Sequence;
+            }
+            else {
+                // Bit n marks that the message n sequence numbers before the last received one has arrived.
+                const uint16_t age = static_cast<uint16_t>(channel.LastReceived - message.Sequence);
+                if (age >= 32 || channel.ReceivedMask & 1u << age) {
+                    BM_TRACE_LOG("dropping duplicate message {:d} from {:d}", message.Sequence, message.SenderId);
+                    ++metrics.Dropped[static_cast<size_t>(RPDropReason::DUPLICATE)];
+                    return;
+                }
+                channel.ReceivedMask |= 1u << age;
+            }
+            deliver(message, message.Message);
+            return;
+        case RPChannel::RELIABLE_ORDERED:
+            // Messages past the window are not acknowledged, so they get send again once there is room.
+            if (sequence_newer(message.Sequence, channel.NextExpected) &&
+                static_cast<uint16_t>(message.Sequence - channel.NextExpected) >= RP_RELIABLE_WINDOW_SIZE) {
+                BM_TRACE_LOG("dropping message {:d} from {:d} outside the window", message.Sequence, message.SenderId);
+                return;
             }
+            sendAck(message);
+            if (message.Sequence == channel.NextExpected) {
+                deliver(message, message.Message);
+                ++channel.NextExpected;
+                // Deliver the buffered messages that were waiting on this one.
+                for (auto it = channel.OutOfOrder.find(channel.NextExpected); it != channel.OutOfOrder.end();
+                     it = channel.OutOfOrder.find(channel.NextExpected)) {
+                    deliver(it->second, it->second.Message);
+                    channel.OutOfOrder.erase(it);
+                    ++channel.NextExpected;
+                }
+            }
+            else if (sequence_newer(message.Sequence, channel.NextExpected)) {
+                channel.OutOfOrder.try_emplace(message.Sequence, message, std::string(message.Message));
+            }
+            else {
+                ++metrics.Dropped[static_cast<size_t>(RPDropReason::DUPLICATE)];
+            }
+            return;
+        case RPChannel::REPLICATION:
+            break;
+    }
+
+    BM_ERROR_LOG("unknown channel {:d}", static_cast<uint8_t>(message.Channel));
+}
+
+
+/// <summary>Acknowledges the given reliable message.</summary>
+/// <param name="message">Message to acknowledge</param>
+void RPNetCode::sendAck(const RPMessageHeader& message)
+{
+    RPMessageHeader ack(message.ModuleId, message.ReceiverId, message.SenderId);
+    ack.Flags = RP_MESSAGE_FLAG_ACK;
+    ack.Channel = message.Channel;
+    ack.Sequence = message.Sequence;
+
+    queue(RPMessage(ack, std::string()), RP_NO_COALESCE_KEY);
+}
+
+
+/// <summary>Stops retransmitting the acknowledged message.</summary>
+/// <param name="ack">Received acknowledgement</param>
+void RPNetCode::receiveAck(const RPMessageHeader& ack)
+{
+    ChannelState& channel = getChannel(ack.SenderId, ack.ModuleId, ack.Channel);
+    // Nothing is send on the channel while the reset is pending, so the ack can only be for the reset.
+    if (channel.ResetPending) {
+        if (ack.Sequence == channel.ResetSequence) {
+            channel.ResetPending = false;
+            --reliableMessagesPending;
         }
-        sendClient(receiversController, serializedMessage);
         return;
     }
+    const auto it = std::ranges::find_if(channel.Unacked, [&](const UnackedMessage& unackedMessage) {
+        return unackedMessage.Message.Sequence == ack.Sequence;
+    });
+    // Acks for messages that were retransmitted can arrive multiple times.
+    if (it != channel.Unacked.end()) {
+        channel.Unacked.erase(it);
+        --reliableMessagesPending;
+    }
+}
+
+
+/// <summary>Tells the receiver of the channel to skip the reliable messages we gave up on.</summary>
+/// <remarks>Gets send again every retransmit timeout until the receiver acknowledges it.</remarks>
+/// <param name="channel">Channel to reset</param>
+/// <param name="now">Current time</param>
+void RPNetCode::sendReset(ChannelState& channel, const std::chrono::steady_clock::time_point now)
+{
+    RPMessageHeader reset(channel.ModuleId, localPlayerId, channel.PlayerId);
+    reset.Flags = RP_MESSAGE_FLAG_RESET;
+    reset.Channel = channel.Channel;
+    reset.Sequence = channel.ResetSequence;
+    channel.LastReset = now;
 
-    if (registeredModules.size() > message.ModuleId) {
-        BM_ERROR_LOG("Could not find module {:d}", message.ModuleId);
+    sequencedMessages[channel.PlayerId].emplace_back(reset, std::string());
+}
+
+
+/// <summary>Continues the channel after the sequence of the reset, skipping the messages the sender gave up on.</summary>
+/// <param name="reset">Received reset</param>
+void RPNetCode::receiveReset(const RPMessageHeader& reset)
+{
+    ChannelState& channel = getChannel(reset.SenderId, reset.ModuleId, reset.Channel);
+    const uint16_t nextExpected = static_cast<uint16_t>(reset.Sequence + 1);
+    // Resets that were send again can arrive after the channel continued.
+    if (sequence_newer(nextExpected, channel.NextExpected)) {
+        BM_WARNING_LOG("player {:d} gave up on messages {:d} to {:d}, skipping them", reset.SenderId,
+            channel.NextExpected, static_cast<uint16_t>(reset.Sequence - 1));
+        channel.NextExpected = nextExpected;
+        channel.OutOfOrder.clear();
+    }
+    sendAck(reset);
+}
+
+
+/// <summary>Passes the received snapshot or acknowledgement to the replicated state of its networked module.</summary>
+/// <param name="message">Message to pass on</param>
+void RPNetCode::receiveReplication(const RPMessageView& message)
+{
+    NetworkedModule* netModule = getModule(message.ModuleId);
+    if (netModule == nullptr) {
+        return;
+    }
+
+    ReplicatedState* replicatedState = netModule->GetReplicatedState();
+    if (replicatedState == nullptr) {
+        BM_ERROR_LOG("module {:d} has no replicated state", message.ModuleId);
+        return;
+    }
+
+    bool updated = false;
+    try {
+        updated = replicatedState->receive(message.SenderId, decompress(message, message.Message), replicationBuffer);
+    }
+    catch (const std::range_error& e) {
+        BM_ERROR_LOG("dropping malformed replication message from {:d}: {:s}", message.SenderId, e.what());
+        ++metrics.Dropped[static_cast<size_t>(RPDropReason::MALFORMED)];
+        // Ask for the full state again, the sender stops delta compressing against snapshots we never applied.
+        ReplicatedState::writeReset(0, replicationBuffer);
+    }
+    if (!replicationBuffer.empty()) {
+        RPMessageHeader header(message.ModuleId, message.ReceiverId, message.SenderId);
+        header.Channel = RPChannel::REPLICATION;
+        queue(RPMessage(header, replicationBuffer), RP_NO_COALESCE_KEY);
+    }
+    if (updated) {
+        netModule->OnReplicated(GetPri(message.SenderId));
+    }
+}
+
+
+/// <summary>Passes the received message to its networked module.</summary>
+/// <param name="header">Header of the message</param>
+/// <param name="message">Payload of the message</param>
+void RPNetCode::deliver(const RPMessageHeader& header, const std::string_view message)
+{
+    NetworkedModule* netModule = getModule(header.ModuleId);
+    if (netModule == nullptr) {
         return;
     }
 
-    const auto& [netModule, enabled] = registeredModules.at(message.ModuleId - 1);
-    if (enabled) {
-        netModule->Receive(get_pri(message.SenderId), message.Message);
+    std::string_view payload;
+    try {
+        payload = decompress(header, message);
+    }
+    catch (const std::range_error& e) {
+        BM_ERROR_LOG("dropping malformed message from {:d}: {:s}", header.SenderId, e.what());
+        ++metrics.Dropped[static_cast<size_t>(RPDropReason::MALFORMED)];
+        return;
     }
+    netModule->Receive(GetPri(header.SenderId), payload);
+}
+
+
+/// <summary>Gets the payload of the message, decompressed if it was compressed.</summary>
+/// <remarks>The decompressed payload is valid until the next call.</remarks>
+/// <param name="header">Header of the message</param>
+/// <param name="message">Payload of the message</param>
+/// <returns>The decompressed payload</returns>
+std::string_view RPNetCode::decompress(const RPMessageHeader& header, const std::string_view message)
+{
+    if (!(header.Flags & RP_MESSAGE_FLAG_COMPRESSED)) {
+        return message;
+    }
+
+    lz_decompress(message, decompressionBuffer);
+
+    return decompressionBuffer;
+}
+
+
+/// <summary>Gets the registered networked module with the given NetId.</summary>
+/// <param name="moduleId">NetId of the networked module</param>
+/// <returns>The networked module, or nullptr if it is not registered</returns>
+NetworkedModule* RPNetCode::getModule(const NetId moduleId)
+{
+    NetworkedModule* netModule = registeredModules[moduleId & RP_MAX_NET_ID];
+    if (netModule == nullptr) {
+        BM_ERROR_LOG("Could not find module {:d}", moduleId);
+        ++metrics.Dropped[static_cast<size_t>(RPDropReason::UNKNOWN_MODULE)];
+    }
+
+    return netModule;
 }
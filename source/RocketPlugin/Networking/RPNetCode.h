@@ -1,5 +1,5 @@
 #pragma once
-#include "Modules/RocketPluginModule.h"
+#include "RPTransport.h"
 
 
 typedef uint8_t uint6_t;
@@ -7,10 +7,85 @@ typedef uint6_t NetId;
 
 constexpr int INVALID_PLAYER_ID = -1;
 constexpr NetId INVALID_NET_ID = 0;
-constexpr uint6_t RP_MESSAGE_VERSION = 1;
+// NetIds are 6 bits in the message header.
+constexpr NetId RP_MAX_NET_ID = 63;
+// Reserved for modules under test in the loopback simulator, never handed out to networked modules.
+constexpr NetId RP_TEST_NET_ID = RP_MAX_NET_ID;
+constexpr uint6_t RP_MESSAGE_VERSION = 5;
 constexpr const char* RP_MESSAGE_SIGNATURE = "RP";
 constexpr size_t RP_MESSAGE_SIGNATURE_SIZE = std::string_view(RP_MESSAGE_SIGNATURE).length();
-constexpr size_t RP_MESSAGE_HEADER_SIZE = 10;
+// Packed header: [version:5|module id:6|flags:3|channel:2] [sequence:16] [sender id:32] [receiver id:32], little endian.
+constexpr size_t RP_MESSAGE_HEADER_SIZE = 12;
+// Maximum size of the varint encoded payload length.
+constexpr size_t RP_MESSAGE_MAX_LENGTH_SIZE = 5;
+// The payload contains multiple serialized messages.
+constexpr uint8_t RP_MESSAGE_FLAG_BATCH = 1 << 0;
+// The message acknowledges the reliable message with the same module, channel and sequence.
+constexpr uint8_t RP_MESSAGE_FLAG_ACK = 1 << 1;
+// The payload is compressed with lz_compress.
+constexpr uint8_t RP_MESSAGE_FLAG_COMPRESSED = 1 << 2;
+// Acks are never batched, so both flags together mark that the sender gave up on its unacknowledged reliable messages.
+// The reset takes up its own sequence number and the channel continues after it.
+constexpr uint8_t RP_MESSAGE_FLAG_RESET = RP_MESSAGE_FLAG_BATCH | RP_MESSAGE_FLAG_ACK;
+// Batches are split when they would grow larger than this.
+constexpr size_t RP_MESSAGE_MAX_BATCH_SIZE = 1024;
+// Queued messages without a coalesce key are never dropped.
+constexpr uint16_t RP_NO_COALESCE_KEY = 0;
+// Maximum number of unacknowledged reliable messages per module and channel.
+constexpr size_t RP_RELIABLE_WINDOW_SIZE = 32;
+// Time before an unacknowledged reliable message gets send again.
+constexpr std::chrono::milliseconds RP_RETRANSMIT_TIMEOUT = std::chrono::milliseconds(200);
+// Reliable messages are given up on after this many retransmits, after which the channel gets reset.
+constexpr size_t RP_MAX_RETRANSMITS = 25;
+
+
+enum class RPChannel : uint8_t
+{
+    // Best effort, older messages than the last received one are dropped.
+    UNRELIABLE = 0,
+    // Acknowledged and retransmitted, received in the order they were send.
+    RELIABLE_ORDERED = 1,
+    // Acknowledged and retransmitted, received as soon as they arrive.
+    RELIABLE_UNORDERED = 2,
+    // Snapshots of the modules replicated state, see ReplicatedState.
+    REPLICATION = 3
+};
+
+
+/// <summary>Writes a little endian value to the buffer.</summary>
+/// <param name="buffer">Buffer to write to</param>
+/// <param name="value">Value to write</param>
+template<typename T>
+void write_le(char* buffer, const T value)
+{
+    using U = std::make_unsigned_t<T>;
+    const U unsignedValue = static_cast<U>(value);
+    for (size_t i = 0; i < sizeof(T); i++) {
+        buffer[i] = static_cast<char>((unsignedValue >> (i * 8)) & 0xFF);
+    }
+}
+
+
+/// <summary>Reads a little endian value from the buffer.</summary>
+/// <param name="buffer">Buffer to read from</param>
+/// <returns>Read value</returns>
+template<typename T>
+T read_le(const char* buffer)
+{
+    using U = std::make_unsigned_t<T>;
+    U unsignedValue = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        unsignedValue = static_cast<U>(unsignedValue | static_cast<U>(static_cast<unsigned char>(buffer[i])) << (i * 8));
+    }
+
+    return static_cast<T>(unsignedValue);
+}
+
+
+size_t varint_size(size_t value);
+size_t write_varint(char* buffer, size_t value);
+size_t read_varint(const char* buffer, size_t bufferSize, size_t& value);
+bool sequence_newer(uint16_t sequence, uint16_t other);
 
 
 struct RPMessageHeader
@@ -19,16 +94,16 @@ struct RPMessageHeader
     RPMessageHeader(const NetId moduleId, const int senderId, const int receiverId)
         : ModuleId(moduleId), SenderId(senderId), ReceiverId(receiverId) {}
 
-    std::string Serialize() const;
-    void Deserialize(const std::string& message);
+    size_t Serialize(char* buffer, size_t bufferSize) const;
+    size_t Deserialize(const char* buffer, size_t bufferSize);
 
     uint6_t Version = RP_MESSAGE_VERSION;
     NetId ModuleId = INVALID_NET_ID;
+    uint8_t Flags = 0;
+    RPChannel Channel = RPChannel::UNRELIABLE;
+    uint16_t Sequence = 0;
     int SenderId = INVALID_PLAYER_ID;
     int ReceiverId = INVALID_PLAYER_ID;
-
-protected:
-    size_t headerSize = 0;
 };
 
 
@@ -38,28 +113,145 @@ struct RPMessage : RPMessageHeader
     RPMessage(const RPMessageHeader& header, std::string message)
         : RPMessageHeader(header), Message(std::move(message)) {}
 
+    size_t SerializedSize() const;
+    size_t Serialize(char* buffer, size_t bufferSize) const;
     std::string Serialize() const;
-    void Deserialize(const std::string& message);
+    void Deserialize(std::string_view message);
 
     std::string Message;
 };
 
 
+/// <summary>Non owning message, the payload points into the buffer it was deserialized from.</summary>
+struct RPMessageView : RPMessageHeader
+{
+    RPMessageView() = default;
+
+    size_t Deserialize(std::string_view message);
+
+    std::string_view Message;
+};
+
+
+/// <summary>Histogram with power of two buckets.</summary>
+struct RPHistogram
+{
+    void Add(uint64_t value);
+    uint64_t Percentile(double percentile) const;
+
+    // Bucket n counts the values in [2^(n-1), 2^n).
+    std::array<uint64_t, 65> Buckets = {};
+    uint64_t Count = 0;
+    uint64_t Sum = 0;
+};
+
+
+enum class RPDropReason : uint8_t
+{
+    VERSION_MISMATCH,
+    UNKNOWN_MODULE,
+    OWN_MESSAGE,
+    OUTDATED,
+    DUPLICATE,
+    // Truncated, corrupted or not matching our replicated state.
+    MALFORMED,
+    COUNT
+};
+
+
+struct RPModuleMetrics
+{
+    size_t MessagesIn = 0;
+    size_t MessagesOut = 0;
+    size_t BytesIn = 0;
+    size_t BytesOut = 0;
+};
+
+
+struct RPNetMetrics
+{
+    // Indexed by NetId.
+    std::array<RPModuleMetrics, 64> Modules = {};
+    RPHistogram EncodeNs;
+    RPHistogram DecodeNs;
+    size_t MessagesSend = 0;
+    size_t MessagesReceived = 0;
+    size_t BytesSend = 0;
+    size_t BytesReceived = 0;
+    size_t MessagesForwarded = 0;
+    size_t BytesForwarded = 0;
+    size_t MessagesCompressed = 0;
+    size_t BytesSavedByCompression = 0;
+    std::array<size_t, static_cast<size_t>(RPDropReason::COUNT)> Dropped = {};
+};
+
+
 class RPNetCode;
+class ReplicatedState;
+class CrazyRumble;
+class GhostCars;
+
+
+/// <summary>Compile time list of networked modules, a modules NetId is its position in the list plus one.</summary>
+/// <remarks>
+/// NetIds are part of the wire format, so host and clients agree on them regardless of construction order.
+/// Only append new modules to keep the NetIds of the existing ones.
+/// </remarks>
+template<typename... Modules>
+struct RPNetIdList
+{
+    static_assert(sizeof...(Modules) < RP_TEST_NET_ID, "too many networked modules");
+
+    template<typename T>
+    static constexpr NetId Get()
+    {
+        constexpr std::array<bool, sizeof...(Modules)> matches = { std::is_same_v<T, Modules>... };
+        for (size_t i = 0; i < matches.size(); i++) {
+            if (matches[i]) {
+                return static_cast<NetId>(i + 1);
+            }
+        }
+
+        return INVALID_NET_ID;
+    }
+};
+
+using RPNetworkedModules = RPNetIdList<CrazyRumble, GhostCars>;
+
+
+/// <summary>Gets the NetId of the given networked module type.</summary>
+/// <returns>NetId of the networked module type</returns>
+template<typename T>
+constexpr NetId net_id_of()
+{
+    constexpr NetId netId = RPNetworkedModules::Get<T>();
+    static_assert(netId != INVALID_NET_ID, "networked modules have to be added to RPNetworkedModules");
+
+    return netId;
+}
+
 
 class NetworkedModule
 {
     friend RPNetCode;
 public:
-    NetworkedModule();
-    virtual ~NetworkedModule() = default;
+    explicit NetworkedModule(NetId netId);
+    NetworkedModule(NetId netId, RPNetCode& netCode);
+    virtual ~NetworkedModule();
 
-    bool SendMessageTo(PriWrapper pri, const std::string& message) const;
-    bool BroadcastMessage(const std::string& message) const;
-    virtual void Receive(PriWrapper sender, const std::string& message) = 0;
+    bool SendMessageTo(PriWrapper pri, const std::string& message, RPChannel channel = RPChannel::UNRELIABLE,
+        uint16_t coalesceKey = RP_NO_COALESCE_KEY) const;
+    bool SendMessageToPlayer(int playerId, const std::string& message, RPChannel channel = RPChannel::UNRELIABLE,
+        uint16_t coalesceKey = RP_NO_COALESCE_KEY) const;
+    bool BroadcastMessage(const std::string& message, RPChannel channel = RPChannel::UNRELIABLE,
+        uint16_t coalesceKey = RP_NO_COALESCE_KEY) const;
+    virtual void Receive(PriWrapper sender, std::string_view message) = 0;
+    virtual ReplicatedState* GetReplicatedState() { return nullptr; }
+    virtual void OnReplicated(PriWrapper sender) {}
 
     bool networked = false;
 protected:
+    RPNetCode& netCode;
     const NetId netId = INVALID_NET_ID;
 };
 
@@ -67,20 +259,111 @@ protected:
 class RPNetCode final : RocketPluginModule
 {
     friend NetworkedModule;
+    friend class RPLoopbackNetwork;
 public:
+    RPNetCode();
+    explicit RPNetCode(std::unique_ptr<RPTransport> transport);
+
     void Init();
-    NetId Register(NetworkedModule* networkedModule);
-    void Deregister(NetId netId);
+    void Register(NetworkedModule* networkedModule);
+    void Deregister(const NetworkedModule* networkedModule);
+
+    void InvalidatePlayerIndex();
+    PriWrapper GetPri(int playerId);
+    PlayerControllerWrapper GetOwner(int playerId);
+    int GetLocalPlayerId();
+
+    void Flush();
+
+    const RPNetMetrics& GetMetrics() const;
+    void ResetMetrics();
+    std::string GetMetricsReport() const;
 
 protected:
+    bool queue(RPMessage message, uint16_t coalesceKey);
     bool send(const RPMessage& message);
 
 private:
-    bool sendClient(const PlayerControllerWrapper& player, const std::string& serializedMessage);
-    bool sendServer(const PlayerControllerWrapper& player, const std::string& serializedMessage);
-    void receive(const std::string& serializedMessage);
+    struct QueuedMessage
+    {
+        RPMessage Message;
+        uint16_t CoalesceKey = RP_NO_COALESCE_KEY;
+    };
+
+    struct UnackedMessage
+    {
+        RPMessage Message;
+        std::chrono::steady_clock::time_point LastSend;
+        size_t Retransmits = 0;
+    };
+
+    // State of a single channel of a networked module, between us and another player.
+    struct ChannelState
+    {
+        int PlayerId = INVALID_PLAYER_ID;
+        NetId ModuleId = INVALID_NET_ID;
+        RPChannel Channel = RPChannel::UNRELIABLE;
+        // Sending side.
+        uint16_t NextSequence = 0;
+        std::deque<UnackedMessage> Unacked;
+        std::deque<RPMessage> Backlog;
+        // Set while the reset after giving up is not acknowledged, holds back new reliable messages.
+        bool ResetPending = false;
+        uint16_t ResetSequence = 0;
+        std::chrono::steady_clock::time_point LastReset;
+        // Receiving side.
+        bool HasReceived = false;
+        uint16_t LastReceived = 0;
+        uint32_t ReceivedMask = 0;
+        uint16_t NextExpected = 0;
+        std::map<uint16_t, RPMessage> OutOfOrder;
+    };
+
+    bool updatePlayerIndex();
+
+    void receive(std::string_view serializedMessage);
+    void dispatch(const RPMessageView& message);
+    void deliver(const RPMessageHeader& header, std::string_view message);
+    std::string_view decompress(const RPMessageHeader& header, std::string_view message);
+    NetworkedModule* getModule(NetId moduleId);
+    void replicate();
+    void receiveReplication(const RPMessageView& message);
+
+    ChannelState& getChannel(int playerId, NetId moduleId, RPChannel channel);
+    static bool windowFull(const ChannelState& channel);
+    void sequenceMessage(RPMessage message);
+    void sendAck(const RPMessageHeader& message);
+    void receiveAck(const RPMessageHeader& ack);
+    void sendReset(ChannelState& channel, std::chrono::steady_clock::time_point now);
+    void receiveReset(const RPMessageHeader& reset);
+    void retransmit();
+    void pruneChannels();
+
+    std::unique_ptr<RPTransport> transport;
+
+    // Maps player id to their pri and controller, rebuild when players join or leave.
+    std::unordered_map<int, RPPlayerIndexEntry> playerIndex;
+    uintptr_t playerIndexGame = 0;
+    int localPlayerId = INVALID_PLAYER_ID;
+    bool playerIndexDirty = true;
+
+    // Maps receiver id to the messages that will be send on the next flush.
+    std::unordered_map<int, std::vector<QueuedMessage>> outgoingMessages;
+    size_t queuedMessages = 0;
+    RPMessage batchMessage;
+
+    // Maps player, module and channel to their channel state, cleared when the match changes.
+    std::unordered_map<uint64_t, ChannelState> channels;
+    // Messages that passed through their channel and will be send on the next flush.
+    std::unordered_map<int, std::vector<RPMessage>> sequencedMessages;
+    size_t reliableMessagesPending = 0;
+    bool channelsNeedPruning = false;
+    std::string replicationBuffer;
 
-    size_t messagesSend = 0;
-    size_t messagesReceived = 0;
-    std::vector<std::pair<NetworkedModule*, bool>> registeredModules;
+    std::string sendBuffer;
+    std::string compressionBuffer;
+    std::string decompressionBuffer;
+    RPNetMetrics metrics;
+    // Indexed by NetId, so dispatching a message is a single lookup.
+    std::array<NetworkedModule*, RP_MAX_NET_ID + 1> registeredModules = {};
 };
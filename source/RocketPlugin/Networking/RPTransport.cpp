@@ -0,0 +1,88 @@
+#include "RPTransport.h"
+
+#include "RocketPlugin.h"
+
+
+/// <summary>Gets the current time.</summary>
+/// <returns>The current time</returns>
+std::chrono::steady_clock::time_point RPGameTransport::Now() const
+{
+    return std::chrono::steady_clock::now();
+}
+
+
+/// <summary>Gets the current match.</summary>
+/// <returns>Address of the current game, or 0 if there is none</returns>
+uintptr_t RPGameTransport::GetMatch()
+{
+    ServerWrapper game = Outer()->GetGame(true);
+    if (game.IsNull()) {
+        localPlayerController = 0;
+        return 0;
+    }
+
+    return game.memory_address;
+}
+
+
+/// <summary>Gets if we are hosting the current match.</summary>
+/// <returns>Bool with if we are hosting the current match</returns>
+bool RPGameTransport::IsHost()
+{
+    return Outer()->IsHostingLocalGame();
+}
+
+
+/// <summary>Indexes the players in the current match.</summary>
+/// <param name="playerIndex">Index to add the players to</param>
+/// <returns>Player id of the local player</returns>
+int RPGameTransport::IndexPlayers(std::unordered_map<int, RPPlayerIndexEntry>& playerIndex)
+{
+    localPlayerController = 0;
+    ServerWrapper game = Outer()->GetGame(true);
+    BMCHECK(game, INVALID_PLAYER_ID);
+
+    int localPlayerId = INVALID_PLAYER_ID;
+    PlayerControllerWrapper localController = game.GetLocalPrimaryPlayer();
+    if (!localController.IsNull()) {
+        localPlayerController = localController.memory_address;
+        PriWrapper localPri = localController.GetPRI();
+        if (!localPri.IsNull()) {
+            localPlayerId = localPri.GetPlayerID();
+        }
+    }
+
+    for (PriWrapper pri : game.GetPRIs()) {
+        BMCHECK_LOOP(pri);
+
+        playerIndex.insert_or_assign(pri.GetPlayerID(), RPPlayerIndexEntry{ pri.memory_address, pri.GetOwner().memory_address });
+    }
+
+    return localPlayerId;
+}
+
+
+/// <summary>Sends the given message to a other client.</summary>
+/// <param name="player">Player to send the message to</param>
+/// <param name="serializedMessage">Message to send</param>
+/// <returns>Bool with if the message was send successfully</returns>
+bool RPGameTransport::SendClient(const RPPlayerIndexEntry& player, const std::string& serializedMessage)
+{
+    BM_WARNING_LOG("redacted function");
+
+    return false;
+}
+
+
+/// <summary>Sends the given message to a other client through the server.</summary>
+/// <param name="serializedMessage">Message to send</param>
+/// <returns>Bool with if the message was send successfully</returns>
+bool RPGameTransport::SendServer(const std::string& serializedMessage)
+{
+    PlayerControllerWrapper localController(localPlayerController);
+    BMCHECK(localController, false);
+
+    BM_WARNING_LOG("redacted function");
+
+    return false;
+}
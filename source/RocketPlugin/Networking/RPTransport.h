@@ -0,0 +1,42 @@
+#pragma once
+#include "Modules/RocketPluginModule.h"
+
+
+struct RPPlayerIndexEntry
+{
+    uintptr_t Pri = 0;
+    // Only known for players we can send messages to directly.
+    uintptr_t Owner = 0;
+};
+
+
+/// <summary>Moves serialized messages between the players of a match.</summary>
+/// <remarks>Messages are handed over without signature, the receiving net code expects it in front of the message.</remarks>
+class RPTransport
+{
+public:
+    virtual ~RPTransport() = default;
+
+    virtual std::chrono::steady_clock::time_point Now() const = 0;
+    virtual uintptr_t GetMatch() = 0;
+    virtual bool IsHost() = 0;
+    virtual int IndexPlayers(std::unordered_map<int, RPPlayerIndexEntry>& playerIndex) = 0;
+    virtual bool SendClient(const RPPlayerIndexEntry& player, const std::string& serializedMessage) = 0;
+    virtual bool SendServer(const std::string& serializedMessage) = 0;
+};
+
+
+/// <summary>Sends messages through the game its remote procedure calls.</summary>
+class RPGameTransport final : public RPTransport, RocketPluginModule
+{
+public:
+    std::chrono::steady_clock::time_point Now() const override;
+    uintptr_t GetMatch() override;
+    bool IsHost() override;
+    int IndexPlayers(std::unordered_map<int, RPPlayerIndexEntry>& playerIndex) override;
+    bool SendClient(const RPPlayerIndexEntry& player, const std::string& serializedMessage) override;
+    bool SendServer(const std::string& serializedMessage) override;
+
+private:
+    uintptr_t localPlayerController = 0;
+};
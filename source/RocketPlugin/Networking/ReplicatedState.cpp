@@ -0,0 +1,215 @@
+#include "ReplicatedState.h"
+
+
+/// <summary>Forgets all snapshots, so every player gets send the full state again.</summary>
+void ReplicatedState::Reset()
+{
+    peers.clear();
+}
+
+
+/// <summary>Copies the current field values into the current snapshot.</summary>
+void ReplicatedState::capture()
+{
+    currentSnapshot.resize(snapshotSize);
+    for (const Field& field : fields) {
+        std::memcpy(currentSnapshot.data() + field.Offset, field.Value, field.Size);
+    }
+}
+
+
+/// <summary>Writes the fields that changed since the last snapshot the player acknowledged.</summary>
+/// <remarks>Expects the current snapshot to be captured.</remarks>
+/// <param name="playerId">Player id of the player to write the delta for</param>
+/// <param name="now">Current time</param>
+/// <param name="message">Buffer to write the delta into</param>
+/// <returns>Bool with if there is something to send</returns>
+bool ReplicatedState::writeDelta(const int playerId, const std::chrono::steady_clock::time_point now, std::string& message)
+{
+    Peer& peer = peers[playerId];
+    if (peer.HasBaseline && peer.Baseline.Data == currentSnapshot) {
+        return false;
+    }
+
+    // Give the player time to acknowledge the last snapshot before sending it again.
+    if (!peer.Sent.empty() && peer.Sent.back().Data == currentSnapshot && now - peer.LastSend < RP_RETRANSMIT_TIMEOUT) {
+        return false;
+    }
+
+    const uint16_t sequence = nextSequence++;
+    if (!peer.HasBaseline) {
+        message.resize(3);
+        message[0] = static_cast<char>(MessageType::FULL);
+        write_le(message.data() + 1, sequence);
+        message += currentSnapshot;
+    }
+    else {
+        // Bit n of the mask marks that field n changed, trailing zero bytes are not send.
+        std::string mask((fields.size() + 7) / 8, '\0');
+        size_t maskSize = 0;
+        for (size_t i = 0; i < fields.size(); i++) {
+            const Field& field = fields[i];
+            if (std::memcmp(currentSnapshot.data() + field.Offset, peer.Baseline.Data.data() + field.Offset, field.Size) != 0) {
+                mask[i / 8] = static_cast<char>(mask[i / 8] | 1 << (i % 8));
+                maskSize = i / 8 + 1;
+            }
+        }
+
+        message.resize(5 + varint_size(maskSize));
+        message[0] = static_cast<char>(MessageType::DELTA);
+        write_le(message.data() + 1, sequence);
+        write_le(message.data() + 3, peer.Baseline.Sequence);
+        write_varint(message.data() + 5, maskSize);
+        message.append(mask, 0, maskSize);
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (mask[i / 8] & 1 << (i % 8)) {
+                message.append(currentSnapshot, fields[i].Offset, fields[i].Size);
+            }
+        }
+    }
+
+    peer.Sent.push_back({ sequence, currentSnapshot });
+    if (peer.Sent.size() > RP_REPLICATION_SNAPSHOT_HISTORY) {
+        peer.Sent.pop_front();
+    }
+    peer.LastSend = now;
+
+    return true;
+}
+
+
+/// <summary>Reads a snapshot or acknowledgement from the given player.</summary>
+/// <param name="playerId">Player id of the player that send the message</param>
+/// <param name="message">Received message</param>
+/// <param name="reply">Buffer to write the reply into, empty if there is nothing to reply</param>
+/// <returns>Bool with if the fields were updated</returns>
+bool ReplicatedState::receive(const int playerId, const std::string_view message, std::string& reply)
+{
+    reply.clear();
+    if (message.size() < 3) {
+        throw std::range_error("invalid replication message size");
+    }
+
+    Peer& peer = peers[playerId];
+    const MessageType type = static_cast<MessageType>(message[0]);
+    const uint16_t sequence = read_le<uint16_t>(message.data() + 1);
+    Snapshot snapshot = { sequence, {} };
+    switch (type) {
+        case MessageType::ACK:
+            receiveAck(peer, sequence);
+            return false;
+        case MessageType::RESET:
+            peer.HasBaseline = false;
+            peer.Sent.clear();
+            return false;
+        case MessageType::FULL:
+            if (message.size() - 3 != snapshotSize) {
+                throw std::range_error("replicated state does not match");
+            }
+            snapshot.Data = message.substr(3);
+            break;
+        case MessageType::DELTA: {
+            if (message.size() < 6) {
+                throw std::range_error("invalid replication message size");
+            }
+            const uint16_t baselineSequence = read_le<uint16_t>(message.data() + 3);
+            const auto baseline = std::ranges::find_if(peer.Received, [&](const Snapshot& receivedSnapshot) {
+                return receivedSnapshot.Sequence == baselineSequence;
+            });
+            if (baseline == peer.Received.end()) {
+                // We no longer have the baseline, ask for the full state.
+                BM_TRACE_LOG("missing baseline {:d} from {:d}", baselineSequence, playerId);
+                writeReset(sequence, reply);
+                return false;
+            }
+
+            size_t maskSize = 0;
+            size_t offset = 5;
+            const size_t lengthSize = read_varint(message.data() + offset, message.size() - offset, maskSize);
+            offset += lengthSize;
+            if (lengthSize == 0 || maskSize > (fields.size() + 7) / 8 || message.size() - offset < maskSize) {
+                throw std::range_error("invalid replication mask size");
+            }
+            const std::string_view mask = message.substr(offset, maskSize);
+            offset += maskSize;
+
+            snapshot.Data = baseline->Data;
+            for (size_t i = 0; i < maskSize * 8 && i < fields.size(); i++) {
+                if (mask[i / 8] & 1 << (i % 8)) {
+                    const Field& field = fields[i];
+                    if (message.size() - offset < field.Size) {
+                        throw std::range_error("invalid replication message size");
+                    }
+                    std::memcpy(snapshot.Data.data() + field.Offset, message.data() + offset, field.Size);
+                    offset += field.Size;
+                }
+            }
+            break;
+        }
+        default:
+            throw std::range_error("unknown replication message type");
+    }
+
+    reply.resize(3);
+    reply[0] = static_cast<char>(MessageType::ACK);
+    write_le(reply.data() + 1, sequence);
+
+    // Keep older snapshots that arrive late as well, the host can use any acknowledged snapshot as baseline.
+    const bool newer = !peer.HasApplied || sequence_newer(sequence, peer.Applied);
+    if (newer) {
+        apply(snapshot.Data);
+        peer.HasApplied = true;
+        peer.Applied = sequence;
+    }
+    const bool duplicate = std::ranges::any_of(peer.Received, [&](const Snapshot& receivedSnapshot) {
+        return receivedSnapshot.Sequence == sequence;
+    });
+    if (!duplicate) {
+        peer.Received.push_back(std::move(snapshot));
+        if (peer.Received.size() > RP_REPLICATION_SNAPSHOT_HISTORY) {
+            peer.Received.pop_front();
+        }
+    }
+
+    return newer;
+}
+
+
+/// <summary>Makes the acknowledged snapshot the new baseline.</summary>
+/// <param name="peer">Player that acknowledged the snapshot</param>
+/// <param name="sequence">Sequence number of the acknowledged snapshot</param>
+void ReplicatedState::receiveAck(Peer& peer, const uint16_t sequence) const
+{
+    const auto it = std::ranges::find_if(peer.Sent, [&](const Snapshot& sentSnapshot) {
+        return sentSnapshot.Sequence == sequence;
+    });
+    // Acks for snapshots older than the baseline are no longer in the history.
+    if (it == peer.Sent.end()) {
+        return;
+    }
+
+    peer.Baseline = std::move(*it);
+    peer.HasBaseline = true;
+    peer.Sent.erase(peer.Sent.begin(), it + 1);
+}
+
+
+/// <summary>Writes a request for the full state.</summary>
+/// <param name="sequence">Sequence number of the snapshot that could not be applied, only informational</param>
+/// <param name="message">Buffer to write the request into</param>
+void ReplicatedState::writeReset(const uint16_t sequence, std::string& message)
+{
+    message.resize(3);
+    message[0] = static_cast<char>(MessageType::RESET);
+    write_le(message.data() + 1, sequence);
+}
+
+
+/// <summary>Copies the snapshot into the fields.</summary>
+/// <param name="snapshot">Snapshot to apply</param>
+void ReplicatedState::apply(const std::string& snapshot) const
+{
+    for (const Field& field : fields) {
+        std::memcpy(field.Value, snapshot.data() + field.Offset, field.Size);
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "RPNetCode.h"
+
+
+// Number of snapshots that are kept to delta against.
+constexpr size_t RP_REPLICATION_SNAPSHOT_HISTORY = 32;
+
+
+/// <summary>Table of fields that get replicated from the host to the clients.</summary>
+/// <remarks>
+/// Only fields that changed since the last snapshot the client acknowledged are send, as a bitmask plus their values.
+/// Fields are copied as is, so host and clients have to register the same fields in the same order.
+/// </remarks>
+class ReplicatedState
+{
+    friend RPNetCode;
+public:
+    template<typename T>
+    void AddField(T* value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "replicated fields have to be trivially copyable");
+        fields.push_back({ value, sizeof(T), snapshotSize });
+        snapshotSize += sizeof(T);
+    }
+
+    void Reset();
+
+    // Only enabled states are send to the clients.
+    bool Enabled = false;
+
+private:
+    enum class MessageType : uint8_t
+    {
+        FULL,
+        DELTA,
+        ACK,
+        RESET
+    };
+
+    struct Field
+    {
+        void* Value;
+        size_t Size;
+        size_t Offset;
+    };
+
+    struct Snapshot
+    {
+        uint16_t Sequence = 0;
+        std::string Data;
+    };
+
+    struct Peer
+    {
+        // Sending side.
+        bool HasBaseline = false;
+        Snapshot Baseline;
+        std::deque<Snapshot> Sent;
+        std::chrono::steady_clock::time_point LastSend;
+        // Receiving side.
+        std::deque<Snapshot> Received;
+        bool HasApplied = false;
+        uint16_t Applied = 0;
+    };
+
+    void capture();
+    bool writeDelta(int playerId, std::chrono::steady_clock::time_point now, std::string& message);
+    bool receive(int playerId, std::string_view message, std::string& reply);
+    void receiveAck(Peer& peer, uint16_t sequence) const;
+    static void writeReset(uint16_t sequence, std::string& message);
+    void apply(const std::string& snapshot) const;
+
+    std::vector<Field> fields;
+    size_t snapshotSize = 0;
+    std::string currentSnapshot;
+    uint16_t nextSequence = 0;
+    std::unordered_map<int, Peer> peers;
+};
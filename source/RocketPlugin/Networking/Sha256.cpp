@@ -0,0 +1,126 @@
+#include "Sha256.h"
+#include "MappedFile.h"
+
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+
+// Number of bytes hashed per update when hashing a file.
+constexpr size_t SHA256_FILE_CHUNK_SIZE = 1024 * 1024;
+
+
+/// <summary>Gets the shared SHA-256 algorithm provider.</summary>
+/// <returns>Handle to the algorithm provider, or nullptr if it could not be opened</returns>
+BCRYPT_ALG_HANDLE get_sha256_algorithm()
+{
+    static const BCRYPT_ALG_HANDLE algorithm = []() -> BCRYPT_ALG_HANDLE {
+        BCRYPT_ALG_HANDLE handle = nullptr;
+        const NTSTATUS status = BCryptOpenAlgorithmProvider(&handle, BCRYPT_SHA256_ALGORITHM, nullptr, 0);
+        if (!BCRYPT_SUCCESS(status)) {
+            BM_ERROR_LOG("BCryptOpenAlgorithmProvider: {:X}", static_cast<uint32_t>(status));
+            return nullptr;
+        }
+        return handle;
+    }();
+
+    return algorithm;
+}
+
+
+/// <summary>Starts a new hash.</summary>
+Sha256::Sha256()
+{
+    BCRYPT_HASH_HANDLE handle = nullptr;
+    const NTSTATUS status = BCryptCreateHash(get_sha256_algorithm(), &handle, nullptr, 0, nullptr, 0, 0);
+    if (!BCRYPT_SUCCESS(status)) {
+        BM_ERROR_LOG("BCryptCreateHash: {:X}", static_cast<uint32_t>(status));
+        return;
+    }
+    hash = handle;
+}
+
+
+/// <summary>Releases the hash.</summary>
+Sha256::~Sha256()
+{
+    if (hash != nullptr) {
+        BCryptDestroyHash(hash);
+    }
+}
+
+
+/// <summary>Adds data to the hash.</summary>
+/// <param name="data">Data to hash</param>
+void Sha256::Update(std::string_view data)
+{
+    if (hash == nullptr) {
+        throw std::runtime_error("sha256 hash is not available");
+    }
+
+    // BCryptHashData takes the length as ULONG.
+    while (!data.empty()) {
+        const ULONG length = static_cast<ULONG>(std::min<size_t>(data.size(), ULONG_MAX));
+        const NTSTATUS status = BCryptHashData(hash,
+            reinterpret_cast<PUCHAR>(const_cast<char*>(data.data())), length, 0);
+        if (!BCRYPT_SUCCESS(status)) {
+            throw std::runtime_error(fmt::format("BCryptHashData: {:X}", static_cast<uint32_t>(status)));
+        }
+        data.remove_prefix(length);
+    }
+}
+
+
+/// <summary>Finishes the hash, no more data can be added after this.</summary>
+/// <returns>The digest as lowercase hex string</returns>
+std::string Sha256::Finish()
+{
+    if (hash == nullptr) {
+        throw std::runtime_error("sha256 hash is not available");
+    }
+
+    std::array<UCHAR, 32> digest{};
+    const NTSTATUS status = BCryptFinishHash(hash, digest.data(), static_cast<ULONG>(digest.size()), 0);
+    BCryptDestroyHash(hash);
+    hash = nullptr;
+    if (!BCRYPT_SUCCESS(status)) {
+        throw std::runtime_error(fmt::format("BCryptFinishHash: {:X}", static_cast<uint32_t>(status)));
+    }
+
+    std::string hex;
+    hex.reserve(digest.size() * 2);
+    for (const UCHAR byte : digest) {
+        hex += fmt::format("{:02x}", byte);
+    }
+
+    return hex;
+}
+
+
+/// <summary>Hashes the given data.</summary>
+/// <param name="data">Data to hash</param>
+/// <returns>The digest as lowercase hex string</returns>
+std::string Sha256::Hash(const std::string_view data)
+{
+    Sha256 sha256;
+    sha256.Update(data);
+
+    return sha256.Finish();
+}
+
+
+/// <summary>Hashes the contents of the given file.</summary>
+/// <param name="filePath">Path to the file to hash</param>
+/// <returns>The digest as lowercase hex string, or an empty string if the file could not be read</returns>
+std::string Sha256::HashFile(const std::filesystem::path& filePath)
+{
+    const MappedFile mappedFile(filePath);
+    if (!mappedFile.IsOpen()) {
+        return {};
+    }
+
+    Sha256 sha256;
+    for (size_t offset = 0; offset < mappedFile.GetSize(); offset += SHA256_FILE_CHUNK_SIZE) {
+        sha256.Update(mappedFile.GetData(offset, SHA256_FILE_CHUNK_SIZE));
+    }
+
+    return sha256.Finish();
+}
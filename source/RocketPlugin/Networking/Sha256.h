@@ -0,0 +1,25 @@
+#pragma once
+
+
+/// <summary>Incremental SHA-256 hash, backed by Windows CNG.</summary>
+/// <remarks>CNG picks the SHA extensions of the cpu when available, so hashing keeps up with disk and network.</remarks>
+class Sha256
+{
+public:
+    Sha256();
+    ~Sha256();
+
+    Sha256(Sha256&&) = delete;
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(Sha256&&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+
+    void Update(std::string_view data);
+    std::string Finish();
+
+    static std::string Hash(std::string_view data);
+    static std::string HashFile(const std::filesystem::path& filePath);
+
+private:
+    void* hash = nullptr;
+};
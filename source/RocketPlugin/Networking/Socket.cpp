@@ -0,0 +1,505 @@
+// Socket.cpp
+// Portable sockets and shared networking state for Rocket Plugin.
+//
+// Author:       Stanbroek
+// Version:      0.6.9 10/10/21
+
+#include "Socket.h"
+
+#ifdef _WIN32
+#pragma comment(lib,"Ws2_32.lib")
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#include "utils/winsock_error_category.h"
+
+using socklen_t = int;
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+/// <summary>Creates an error_code from the last socket error.</summary>
+/// <returns>Error code</returns>
+std::error_code make_socket_error_code()
+{
+#ifdef _WIN32
+    return make_winsock_error_code();
+#else
+    return { errno, std::generic_category() };
+#endif
+}
+
+
+/// <summary>Creates the error_code that socket operations return when they time out.</summary>
+/// <returns>Error code</returns>
+std::error_code make_socket_timeout_error_code()
+{
+#ifdef _WIN32
+    return make_win32_error_code(WSAETIMEDOUT);
+#else
+    return std::make_error_code(std::errc::timed_out);
+#endif
+}
+
+
+/// <summary>Gets the port of the address.</summary>
+/// <returns>The port, or 0 for unknown address families</returns>
+unsigned short SocketAddress::GetPort() const
+{
+    if (Family == AF_INET) {
+        return ntohs(reinterpret_cast<const sockaddr_in*>(Storage.data())->sin_port);
+    }
+    if (Family == AF_INET6) {
+        return ntohs(reinterpret_cast<const sockaddr_in6*>(Storage.data())->sin6_port);
+    }
+
+    return 0;
+}
+
+
+/// <summary>Gets the ip of the address.</summary>
+/// <returns>The ip as string</returns>
+std::string SocketAddress::GetHost() const
+{
+    char ip[INET6_ADDRSTRLEN] = "";
+    if (Family == AF_INET) {
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(Storage.data())->sin_addr, ip, sizeof ip);
+    }
+    else if (Family == AF_INET6) {
+        inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(Storage.data())->sin6_addr, ip, sizeof ip);
+    }
+
+    return ip;
+}
+
+
+/// <summary>Formats the address as ip:port.</summary>
+/// <returns>The address as string</returns>
+std::string SocketAddress::ToString() const
+{
+    return fmt::format("{:s}:{:d}", GetHost(), GetPort());
+}
+
+
+/// <summary>Checks if both addresses point to the same ip and port.</summary>
+/// <param name="other">Address to compare with</param>
+/// <returns>Bool with if the addresses are the same</returns>
+bool SocketAddress::operator==(const SocketAddress& other) const
+{
+    if (Family != other.Family || GetPort() != other.GetPort()) {
+        return false;
+    }
+    if (Family == AF_INET) {
+        return std::memcmp(&reinterpret_cast<const sockaddr_in*>(Storage.data())->sin_addr,
+            &reinterpret_cast<const sockaddr_in*>(other.Storage.data())->sin_addr, sizeof(in_addr)) == 0;
+    }
+    if (Family == AF_INET6) {
+        return std::memcmp(&reinterpret_cast<const sockaddr_in6*>(Storage.data())->sin6_addr,
+            &reinterpret_cast<const sockaddr_in6*>(other.Storage.data())->sin6_addr, sizeof(in6_addr)) == 0;
+    }
+
+    return Length == other.Length && std::memcmp(Storage.data(), other.Storage.data(), static_cast<size_t>(Length)) == 0;
+}
+
+
+Socket::~Socket()
+{
+    Close();
+}
+
+
+Socket::Socket(Socket&& other) noexcept
+    : handle(std::exchange(other.handle, INVALID_SOCKET_HANDLE)), family(other.family)
+{}
+
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+    if (this != &other) {
+        Close();
+        handle = std::exchange(other.handle, INVALID_SOCKET_HANDLE);
+        family = other.family;
+    }
+
+    return *this;
+}
+
+
+/// <summary>Creates the socket, an already open socket is closed first.</summary>
+/// <param name="family">Address family</param>
+/// <param name="type">Socket type</param>
+/// <param name="protocol">Protocol</param>
+/// <returns>Error code</returns>
+std::error_code Socket::Open(const int family, const int type, const int protocol)
+{
+    Close();
+    handle = static_cast<SocketHandle>(socket(family, type, protocol));
+    if (handle == INVALID_SOCKET_HANDLE) {
+        return make_socket_error_code();
+    }
+    this->family = family;
+
+    return {};
+}
+
+
+/// <summary>Sets an integer socket option, like SO_BROADCAST or SO_REUSEADDR.</summary>
+/// <param name="level">Level of the option</param>
+/// <param name="option">Option to set</param>
+/// <param name="value">Value of the option</param>
+/// <returns>Error code</returns>
+std::error_code Socket::SetOption(const int level, const int option, const int value)
+{
+#ifdef _WIN32
+    const BOOL optionValue = value;
+    if (setsockopt(handle, level, option, reinterpret_cast<const char*>(&optionValue), sizeof optionValue) != 0) {
+#else
+    if (setsockopt(handle, level, option, &value, sizeof value) != 0) {
+#endif
+        return make_socket_error_code();
+    }
+
+    return {};
+}
+
+
+/// <summary>Binds the socket to the given local address.</summary>
+/// <param name="address">Local address</param>
+/// <returns>Error code</returns>
+std::error_code Socket::Bind(const SocketAddress& address)
+{
+    if (bind(handle, reinterpret_cast<const sockaddr*>(address.Storage.data()), address.Length) != 0) {
+        return make_socket_error_code();
+    }
+
+    return {};
+}
+
+
+/// <summary>Connects the socket to the given address.</summary>
+/// <param name="address">Address to connect to</param>
+/// <returns>Error code</returns>
+std::error_code Socket::Connect(const SocketAddress& address)
+{
+    if (connect(handle, reinterpret_cast<const sockaddr*>(address.Storage.data()), address.Length) != 0) {
+        return make_socket_error_code();
+    }
+
+    return {};
+}
+
+
+/// <summary>Sends all data over the connected socket.</summary>
+/// <param name="data">Data to send</param>
+/// <returns>Error code</returns>
+std::error_code Socket::Send(std::string_view data)
+{
+    while (!data.empty()) {
+        const int length = static_cast<int>(std::min<size_t>(data.size(), INT_MAX));
+#ifdef _WIN32
+        const int sent = send(handle, data.data(), length, 0);
+#else
+        const int sent = static_cast<int>(send(handle, data.data(), length, MSG_NOSIGNAL));
+#endif
+        if (sent < 0) {
+            return make_socket_error_code();
+        }
+        data.remove_prefix(static_cast<size_t>(sent));
+    }
+
+    return {};
+}
+
+
+/// <summary>Sends a datagram to the given address.</summary>
+/// <param name="data">Data to send</param>
+/// <param name="address">Address to send the data to</param>
+/// <returns>Error code</returns>
+std::error_code Socket::SendTo(const std::string_view data, const SocketAddress& address)
+{
+    if (sendto(handle, data.data(), static_cast<int>(data.size()), 0,
+            reinterpret_cast<const sockaddr*>(address.Storage.data()), address.Length) < 0) {
+        return make_socket_error_code();
+    }
+
+    return {};
+}
+
+
+/// <summary>Waits until data can be read from the socket.</summary>
+/// <param name="timeout">Maximum time to wait</param>
+/// <returns>Error code, <see cref="make_socket_timeout_error_code"/> when nothing arrived in time</returns>
+std::error_code Socket::WaitReadable(const std::chrono::milliseconds timeout)
+{
+#ifdef _WIN32
+    WSAPOLLFD fd = { static_cast<SOCKET>(handle), POLLRDNORM, 0 };
+    const int result = WSAPoll(&fd, 1, static_cast<INT>(timeout.count()));
+#else
+    pollfd fd = { handle, POLLIN, 0 };
+    const int result = poll(&fd, 1, static_cast<int>(timeout.count()));
+#endif
+    if (result < 0) {
+        return make_socket_error_code();
+    }
+    if (result == 0) {
+        return make_socket_timeout_error_code();
+    }
+
+    return {};
+}
+
+
+/// <summary>Waits until data can be read from any of the given sockets.</summary>
+/// <param name="sockets">Sockets to wait on</param>
+/// <param name="timeout">Maximum time to wait</param>
+/// <param name="readable">Index of the first socket that can be read from</param>
+/// <returns>Error code, <see cref="make_socket_timeout_error_code"/> when nothing arrived in time</returns>
+std::error_code Socket::WaitAnyReadable(const std::vector<Socket*>& sockets, const std::chrono::milliseconds timeout,
+    size_t& readable)
+{
+#ifdef _WIN32
+    std::vector<WSAPOLLFD> fds;
+    for (const Socket* socket : sockets) {
+        fds.push_back({ static_cast<SOCKET>(socket->handle), POLLRDNORM, 0 });
+    }
+    const int result = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), static_cast<INT>(timeout.count()));
+#else
+    std::vector<pollfd> fds;
+    for (const Socket* socket : sockets) {
+        fds.push_back({ socket->handle, POLLIN, 0 });
+    }
+    const int result = poll(fds.data(), static_cast<nfds_t>(fds.size()), static_cast<int>(timeout.count()));
+#endif
+    if (result < 0) {
+        return make_socket_error_code();
+    }
+    if (result == 0) {
+        return make_socket_timeout_error_code();
+    }
+
+    readable = static_cast<size_t>(std::ranges::find_if(fds, [](const auto& fd) { return fd.revents != 0; }) - fds.begin());
+    return {};
+}
+
+
+/// <summary>Receives data from the socket, blocks until there is data.</summary>
+/// <param name="buffer">Buffer to receive in</param>
+/// <param name="size">Size of the buffer</param>
+/// <param name="received">Optional number of bytes received</param>
+/// <param name="from">Optional address the data came from</param>
+/// <returns>Error code</returns>
+std::error_code Socket::Receive(char* buffer, const size_t size, size_t* received, SocketAddress* from)
+{
+    SocketAddress address;
+    socklen_t addressLength = static_cast<socklen_t>(address.Storage.size());
+    const int result = static_cast<int>(recvfrom(handle, buffer, static_cast<int>(size), 0,
+        reinterpret_cast<sockaddr*>(address.Storage.data()), &addressLength));
+    if (result < 0) {
+        return make_socket_error_code();
+    }
+    if (received != nullptr) {
+        *received = static_cast<size_t>(result);
+    }
+    if (from != nullptr) {
+        address.Length = static_cast<int>(addressLength);
+        address.Family = reinterpret_cast<const sockaddr*>(address.Storage.data())->sa_family;
+        *from = address;
+    }
+
+    return {};
+}
+
+
+/// <summary>Gets the local address the socket is bound to.</summary>
+/// <param name="address">Local address</param>
+/// <returns>Error code</returns>
+std::error_code Socket::GetLocalAddress(SocketAddress& address) const
+{
+    socklen_t addressLength = static_cast<socklen_t>(address.Storage.size());
+    if (getsockname(handle, reinterpret_cast<sockaddr*>(address.Storage.data()), &addressLength) != 0) {
+        return make_socket_error_code();
+    }
+    address.Length = static_cast<int>(addressLength);
+    address.Family = family;
+
+    return {};
+}
+
+
+/// <summary>Discards everything that is waiting to be read, like late replies and errors of earlier datagrams.</summary>
+void Socket::Drain()
+{
+    char buffer[512];
+    while (!WaitReadable(std::chrono::milliseconds::zero())) {
+        if (recv(handle, buffer, sizeof buffer, 0) < 0) {
+#ifdef _WIN32
+            // Port unreachable errors are reported once per datagram, everything else ends the drain.
+            if (WSAGetLastError() != WSAECONNRESET) {
+                break;
+            }
+#else
+            if (errno != ECONNREFUSED) {
+                break;
+            }
+#endif
+        }
+    }
+}
+
+
+/// <summary>Closes the socket.</summary>
+void Socket::Close()
+{
+    if (handle == INVALID_SOCKET_HANDLE) {
+        return;
+    }
+
+#ifdef _WIN32
+    closesocket(handle);
+#else
+    close(handle);
+#endif
+    handle = INVALID_SOCKET_HANDLE;
+}
+
+
+/// <summary>Gets the networking context, which initializes the socket library the first time.</summary>
+/// <returns>The networking context</returns>
+NetworkContext& NetworkContext::Get()
+{
+    static NetworkContext context;
+
+    return context;
+}
+
+
+/// <summary>Initializes the socket library for the lifetime of the process.</summary>
+NetworkContext::NetworkContext()
+{
+#ifdef _WIN32
+    WSADATA wsaData;
+    const int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (result != 0) {
+        startupError = make_win32_error_code(result);
+    }
+#endif
+}
+
+
+/// <summary>Closes the pooled sockets.</summary>
+/// <remarks>The socket library stays initialized, WSACleanup must not be called while the plugin is being unloaded.</remarks>
+NetworkContext::~NetworkContext()
+{
+    udpSockets.clear();
+}
+
+
+/// <summary>Resolves the given host, results are cached for <see cref="DNS_CACHE_TTL"/>.</summary>
+/// <param name="host">Host name or address to resolve</param>
+/// <param name="port">Port of the address</param>
+/// <param name="type">Socket type the address is used for</param>
+/// <param name="protocol">Protocol the address is used for</param>
+/// <param name="address">The resolved address</param>
+/// <returns>Error code</returns>
+std::error_code NetworkContext::Resolve(const std::string& host, const unsigned short port, const int type,
+    const int protocol, SocketAddress& address)
+{
+    if (startupError) {
+        return startupError;
+    }
+
+    const std::string key = fmt::format("{:s}:{:d}/{:d}/{:d}", host, port, type, protocol);
+    const auto now = std::chrono::steady_clock::now();
+    {
+        const std::scoped_lock lock(dnsMutex);
+        const auto entry = dnsCache.find(key);
+        if (entry != dnsCache.end() && entry->second.Expires > now) {
+            address = entry->second.Address;
+            return {};
+        }
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = type;
+    hints.ai_protocol = protocol;
+    addrinfo* result = nullptr;
+    const int error = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+    if (error != 0) {
+#ifdef _WIN32
+        return make_win32_error_code(error);
+#else
+        return { error == EAI_SYSTEM ? errno : EHOSTUNREACH, std::generic_category() };
+#endif
+    }
+
+    SocketAddress resolved;
+    resolved.Length = static_cast<int>(std::min<size_t>(result->ai_addrlen, resolved.Storage.size()));
+    resolved.Family = result->ai_family;
+    std::memcpy(resolved.Storage.data(), result->ai_addr, static_cast<size_t>(resolved.Length));
+    freeaddrinfo(result);
+
+    const std::scoped_lock lock(dnsMutex);
+    dnsCache[key] = { resolved, now + DNS_CACHE_TTL };
+    address = resolved;
+
+    return {};
+}
+
+
+/// <summary>Forgets all resolved addresses.</summary>
+void NetworkContext::ClearDnsCache()
+{
+    const std::scoped_lock lock(dnsMutex);
+    dnsCache.clear();
+}
+
+
+/// <summary>Gets an idle UDP socket of the given family, or opens a new one.</summary>
+/// <param name="family">Address family</param>
+/// <param name="error">Error code</param>
+/// <returns>The socket, give it back with <see cref="NetworkContext::ReleaseUdpSocket"/></returns>
+Socket NetworkContext::AcquireUdpSocket(const int family, std::error_code& error)
+{
+    if (startupError) {
+        error = startupError;
+        return {};
+    }
+
+    {
+        const std::scoped_lock lock(socketMutex);
+        const auto udpSocket = std::ranges::find(udpSockets, family, &Socket::GetFamily);
+        if (udpSocket != udpSockets.end()) {
+            Socket socket = std::move(*udpSocket);
+            udpSockets.erase(udpSocket);
+            error.clear();
+            return socket;
+        }
+    }
+
+    Socket socket;
+    error = socket.Open(family, SOCK_DGRAM, IPPROTO_UDP);
+
+    return socket;
+}
+
+
+/// <summary>Gives a UDP socket back to be reused, anything that is still waiting to be read is discarded.</summary>
+/// <param name="socket">Socket from <see cref="NetworkContext::AcquireUdpSocket"/></param>
+void NetworkContext::ReleaseUdpSocket(Socket&& socket)
+{
+    if (!socket.IsOpen()) {
+        return;
+    }
+    socket.Drain();
+
+    const std::scoped_lock lock(socketMutex);
+    if (udpSockets.size() < MAX_POOLED_UDP_SOCKETS) {
+        udpSockets.push_back(std::move(socket));
+    }
+}
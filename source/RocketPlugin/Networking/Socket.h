@@ -0,0 +1,97 @@
+#pragma once
+
+#ifdef _WIN32
+using SocketHandle = uintptr_t;
+constexpr SocketHandle INVALID_SOCKET_HANDLE = ~static_cast<SocketHandle>(0);
+#else
+using SocketHandle = int;
+constexpr SocketHandle INVALID_SOCKET_HANDLE = -1;
+#endif
+
+// Resolved addresses are reused for this long before they are looked up again.
+constexpr std::chrono::seconds DNS_CACHE_TTL = std::chrono::seconds(60);
+// Maximum number of idle UDP sockets that are kept to be reused.
+constexpr size_t MAX_POOLED_UDP_SOCKETS = 8;
+
+
+std::error_code make_socket_error_code();
+std::error_code make_socket_timeout_error_code();
+
+
+/// <summary>Socket address of any family, the storage fits a sockaddr_storage.</summary>
+struct SocketAddress
+{
+    alignas(8) std::array<char, 128> Storage{};
+    int Length = 0;
+    int Family = 0;
+
+    unsigned short GetPort() const;
+    std::string GetHost() const;
+    std::string ToString() const;
+
+    bool operator==(const SocketAddress& other) const;
+};
+
+
+/// <summary>Portable wrapper around a Winsock or BSD socket, closed when it goes out of scope.</summary>
+class Socket
+{
+public:
+    Socket() = default;
+    ~Socket();
+
+    Socket(Socket&& other) noexcept;
+    Socket& operator=(Socket&& other) noexcept;
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    std::error_code Open(int family, int type, int protocol);
+    std::error_code SetOption(int level, int option, int value);
+    std::error_code Bind(const SocketAddress& address);
+    std::error_code Connect(const SocketAddress& address);
+    std::error_code Send(std::string_view data);
+    std::error_code SendTo(std::string_view data, const SocketAddress& address);
+    std::error_code WaitReadable(std::chrono::milliseconds timeout);
+    static std::error_code WaitAnyReadable(const std::vector<Socket*>& sockets, std::chrono::milliseconds timeout,
+        size_t& readable);
+    std::error_code Receive(char* buffer, size_t size, size_t* received = nullptr, SocketAddress* from = nullptr);
+    std::error_code GetLocalAddress(SocketAddress& address) const;
+    void Drain();
+    void Close();
+
+    bool IsOpen() const { return handle != INVALID_SOCKET_HANDLE; }
+    int GetFamily() const { return family; }
+
+private:
+    SocketHandle handle = INVALID_SOCKET_HANDLE;
+    int family = 0;
+};
+
+
+/// <summary>Process wide networking state, so requests do not set up the socket library and resolve hosts every time.</summary>
+class NetworkContext
+{
+public:
+    static NetworkContext& Get();
+
+    std::error_code Resolve(const std::string& host, unsigned short port, int type, int protocol, SocketAddress& address);
+    void ClearDnsCache();
+    Socket AcquireUdpSocket(int family, std::error_code& error);
+    void ReleaseUdpSocket(Socket&& socket);
+
+private:
+    NetworkContext();
+    ~NetworkContext();
+
+    struct DnsEntry
+    {
+        SocketAddress Address;
+        std::chrono::steady_clock::time_point Expires;
+    };
+
+    std::error_code startupError;
+    std::mutex dnsMutex;
+    std::unordered_map<std::string, DnsEntry> dnsCache;
+    std::mutex socketMutex;
+    std::vector<Socket> udpSockets;
+};
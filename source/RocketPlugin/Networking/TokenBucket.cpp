@@ -0,0 +1,63 @@
+#include "TokenBucket.h"
+
+
+/// <summary>Creates a full token bucket.</summary>
+/// <param name="rate">Bytes per second, 0 for no limit</param>
+/// <param name="burst">Bytes that can be reserved at once without waiting, defaults to a second worth of bytes</param>
+TokenBucket::TokenBucket(const size_t rate, const size_t burst)
+{
+    SetRate(rate, burst);
+    tokens = static_cast<double>(this->burst);
+}
+
+
+/// <summary>Changes the rate of the bucket, tokens that are already in the bucket are kept.</summary>
+/// <param name="rate">Bytes per second, 0 for no limit</param>
+/// <param name="burst">Bytes that can be reserved at once without waiting, defaults to a second worth of bytes</param>
+void TokenBucket::SetRate(const size_t rate, const size_t burst)
+{
+    const std::scoped_lock lock(bucketMutex);
+    refill(std::chrono::steady_clock::now());
+    this->rate = rate;
+    this->burst = burst > 0 ? burst : rate;
+    tokens = std::min(tokens, static_cast<double>(this->burst));
+}
+
+
+/// <summary>Gets the rate of the bucket.</summary>
+/// <returns>Bytes per second, 0 for no limit</returns>
+size_t TokenBucket::GetRate()
+{
+    const std::scoped_lock lock(bucketMutex);
+    return rate;
+}
+
+
+/// <summary>Takes the given amount of bytes from the bucket.</summary>
+/// <param name="bytes">Bytes that are about to be send</param>
+/// <returns>Time to wait before sending them</returns>
+std::chrono::nanoseconds TokenBucket::Reserve(const size_t bytes)
+{
+    const std::scoped_lock lock(bucketMutex);
+    if (rate == 0) {
+        return std::chrono::nanoseconds::zero();
+    }
+
+    refill(std::chrono::steady_clock::now());
+    tokens -= static_cast<double>(bytes);
+    if (tokens >= 0) {
+        return std::chrono::nanoseconds::zero();
+    }
+
+    return std::chrono::nanoseconds(static_cast<int64_t>(-tokens * 1e9 / static_cast<double>(rate)));
+}
+
+
+/// <summary>Adds the tokens that came in since the last refill.</summary>
+/// <param name="now">Current time</param>
+void TokenBucket::refill(const std::chrono::steady_clock::time_point now)
+{
+    const double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+    lastRefill = now;
+    tokens = std::min(tokens + elapsed * static_cast<double>(rate), static_cast<double>(burst));
+}
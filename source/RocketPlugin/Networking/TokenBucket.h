@@ -0,0 +1,24 @@
+#pragma once
+
+
+/// <summary>Token bucket that limits the rate of a byte stream.</summary>
+/// <remarks>Reservations may overdraw the bucket, the caller then waits until the debt is paid back.</remarks>
+class TokenBucket
+{
+public:
+    explicit TokenBucket(size_t rate = 0, size_t burst = 0);
+
+    void SetRate(size_t rate, size_t burst = 0);
+    size_t GetRate();
+    std::chrono::nanoseconds Reserve(size_t bytes);
+
+private:
+    void refill(std::chrono::steady_clock::time_point now);
+
+    // Bytes per second, 0 for no limit.
+    size_t rate = 0;
+    size_t burst = 0;
+    double tokens = 0;
+    std::chrono::steady_clock::time_point lastRefill = std::chrono::steady_clock::now();
+    std::mutex bucketMutex;
+};
@@ -844,7 +844,11 @@ void RocketPlugin::onGameEventInit([[maybe_unused]] const ServerWrapper& server)
 {
     // Clear car physics cache.
     carPhysicsMods.carPhysics.clear();
+    netCode.InvalidatePlayerIndex();
     isJoiningHost = false;
+    peerFileServerJoined = peerFileServer != nullptr;
+    updateUploadLimits(true);
+    updateLanBeacon();
 
     if (!hostingGame) {
         return;
@@ -874,6 +878,49 @@ void RocketPlugin::onGameEventInit([[maybe_unused]] const ServerWrapper& server)
 }
 
 
+/// <summary>Sets the upload limits of the match file servers from the cvars, the global rate is lowered while a match is active.</summary>
+/// <remarks>Gets called when the cvars change, when a match file server starts and when a match starts or ends.</remarks>
+/// <param name="matchActive">Bool with if a match is active</param>
+void RocketPlugin::updateUploadLimits(const bool matchActive)
+{
+    const MatchFileServer::UploadLimits uploadLimits = {
+        static_cast<size_t>(std::max(*mapUploadLimit, 0)) * 1024,
+        static_cast<size_t>(std::max(*mapUploadMatchLimit, 0)) * 1024,
+        static_cast<size_t>(std::max(*mapUploadConnectionLimit, 0)) * 1024,
+        static_cast<size_t>(std::max(*mapMaxTransfers, 0))
+    };
+    if (matchFileServer != nullptr) {
+        matchFileServer->SetUploadLimits(uploadLimits, matchActive);
+    }
+    if (peerFileServer != nullptr) {
+        peerFileServer->SetUploadLimits(uploadLimits, matchActive);
+    }
+}
+
+
+/// <summary>Sets the beacon local network discovery queries are answered with, from the hosted game.</summary>
+/// <remarks>Gets called when a match file server starts, when a match starts and when players join or leave.</remarks>
+void RocketPlugin::updateLanBeacon()
+{
+    if (matchFileServer == nullptr) {
+        return;
+    }
+
+    std::optional<LanBeacon> lanBeacon;
+    if (IsHostingLocalGame()) {
+        lanBeacon = LanBeacon{
+            PLUGIN_VERSION,
+            gameWrapper->GetCurrentMap(),
+            static_cast<uint8_t>(std::min<size_t>(playerMods.GetPlayers(false).size(), UINT8_MAX)),
+            static_cast<uint8_t>(std::clamp(matchSettings.GetMaxPlayers(), 0, static_cast<int>(UINT8_MAX))),
+            !hostPswd.empty(),
+            hostPortInternal
+        };
+    }
+    matchFileServer->SetLanBeacon(lanBeacon);
+}
+
+
 /*
  *  BakkesMod plugin overrides
  */
@@ -988,6 +1035,50 @@ void RocketPlugin::registerCVars()
     cvarManager->registerCvar("mp_port", std::to_string(DEFAULT_PORT), "Default port for joining local matches").bindTo(
         joinPort);
 
+    mapCacheBudget = std::make_shared<int>(static_cast<int>(MAP_CACHE_DEFAULT_BUDGET_MB));
+    cvarManager->registerCvar("rp_map_cache_size", std::to_string(MAP_CACHE_DEFAULT_BUDGET_MB),
+                              "Disk budget in MB for downloaded maps that are kept to join again", true, true, 0)
+               .bindTo(mapCacheBudget);
+    cvarManager->getCvar("rp_map_cache_size").addOnValueChanged([this](const std::string&, const CVarWrapper& cvar) {
+        mapCache.SetBudget(static_cast<size_t>(std::max(cvar.getIntValue(), 0)) * 1024 * 1024);
+    });
+
+    mapUploadLimit = std::make_shared<int>(0);
+    cvarManager->registerCvar("rp_map_upload_limit", "0",
+                              "Upload rate in KB/s for sending maps to other players, 0 for no limit", true, true, 0)
+               .bindTo(mapUploadLimit);
+    mapUploadMatchLimit = std::make_shared<int>(0);
+    cvarManager->registerCvar("rp_map_upload_limit_in_match", "0",
+                              "Upload rate in KB/s for sending maps to other players while in a match, 0 for no limit",
+                              true, true, 0)
+               .bindTo(mapUploadMatchLimit);
+    mapUploadConnectionLimit = std::make_shared<int>(0);
+    cvarManager->registerCvar("rp_map_upload_connection_limit", "0",
+                              "Upload rate in KB/s per connection for sending maps to other players, 0 for no limit",
+                              true, true, 0)
+               .bindTo(mapUploadConnectionLimit);
+    mapMaxTransfers = std::make_shared<int>(static_cast<int>(MAP_MAX_TRANSFERS));
+    cvarManager->registerCvar("rp_map_max_transfers", std::to_string(MAP_MAX_TRANSFERS),
+                              "Players that can download a map at the same time, others wait in a queue, 0 for no limit",
+                              true, true, 0)
+               .bindTo(mapMaxTransfers);
+    for (const char* uploadLimitCvar : { "rp_map_upload_limit", "rp_map_upload_limit_in_match",
+                                         "rp_map_upload_connection_limit", "rp_map_max_transfers" }) {
+        cvarManager->getCvar(uploadLimitCvar).addOnValueChanged([this](const std::string&, const CVarWrapper&) {
+            updateUploadLimits(IsInGame(true));
+        });
+    }
+    mapServeToPeers = std::make_shared<bool>(false);
+    cvarManager->registerCvar("rp_map_serve_to_peers", "0",
+                              "Serves downloaded maps to the other players joining the same match, on the match file server port",
+                              true, true, 0, true, 1)
+               .bindTo(mapServeToPeers);
+    cvarManager->getCvar("rp_map_serve_to_peers").addOnValueChanged([this](const std::string&, const CVarWrapper& cvar) {
+        if (!cvar.getBoolValue()) {
+            peerFileServer = nullptr;
+        }
+    });
+
     presetDirPath = std::make_shared<std::string>();
     cvarManager->registerCvar("rp_preset_path", PRESETS_PATH.string(), "Default path for the mutator presets directory")
                .bindTo(presetDirPath);
@@ -1070,6 +1161,8 @@ void RocketPlugin::registerNotifiers()
 
     RegisterNotifier("rp_start_match_file_server", [this](const std::vector<std::string>& arguments) {
         if (matchFileServer != nullptr) return;
+        // The peer server holds the port.
+        peerFileServer = nullptr;
         std::string host = fileServerAddress;
         if (arguments.size() > 1) {
             host = arguments[1];
@@ -1079,11 +1172,38 @@ void RocketPlugin::registerNotifiers()
             port = static_cast<int>(std::strtol(arguments[2].c_str(), nullptr, 10));
         }
         matchFileServer = std::make_unique<MatchFileServer>(host, port);
+        updateUploadLimits(IsInGame(true));
+        updateLanBeacon();
     }, "Starts a local server to allow map downloading.", PERMISSION_ALL);
 
     RegisterNotifier("rp_stop_match_file_server", [this](const std::vector<std::string>&) {
         matchFileServer = nullptr;
     }, "Stops the local server to allow map downloading.", PERMISSION_ALL);
+
+    RegisterNotifier("rp_net_metrics", [this](const std::vector<std::string>& arguments) {
+        if (arguments.size() > 1 && arguments[1] == "reset") {
+            netCode.ResetMetrics();
+            return;
+        }
+        const std::string report = netCode.GetMetricsReport();
+        if (arguments.size() > 1 && arguments[1] == "dump") {
+            const std::filesystem::path metricsPath = arguments.size() > 2 ? std::filesystem::path(arguments[2]) : NET_METRICS_FILE_PATH;
+            std::ofstream metricsFile(metricsPath, std::ios::app);
+            if (!metricsFile.is_open()) {
+                BM_ERROR_LOG("could not open {:s}", quote(metricsPath.string()));
+                return;
+            }
+            metricsFile << fmt::format("{:%Y-%m-%d %H:%M:%S}\n", std::chrono::system_clock::now()) << report << std::endl;
+            BM_INFO_LOG("dumped the network metrics to {:s}", quote(metricsPath.string()));
+            return;
+        }
+        std::string_view lines = report;
+        while (!lines.empty()) {
+            const size_t lineEnd = lines.find('\n');
+            BM_INFO_LOG("{:s}", lines.substr(0, lineEnd));
+            lines.remove_prefix(lineEnd == std::string_view::npos ? lines.size() : lineEnd + 1);
+        }
+    }, "Prints the networked message metrics, usage: rp_net_metrics [reset|dump [file]]", PERMISSION_ALL);
 }
 
 
@@ -1099,6 +1219,40 @@ void RocketPlugin::registerHooks()
         [this](const ServerWrapper& caller, void*, const std::string&) {
             onGameEventInit(caller);
         });
+
+    // Keep the networking player index and the local network beacon up to date when players join or leave.
+    HookEventPost("Function TAGame.PRI_TA.PostBeginPlay",
+        [this](const std::string&) {
+            netCode.InvalidatePlayerIndex();
+            updateLanBeacon();
+        });
+    // After the player is removed from the game, so the beacon counts the players that are left.
+    HookEventPost("Function Engine.PlayerReplicationInfo.Destroyed",
+        [this](const std::string&) {
+            netCode.InvalidatePlayerIndex();
+            updateLanBeacon();
+        });
+
+    // Stop serving the downloaded map to other players when leaving the match it was downloaded for, which includes
+    // the host changing maps, give the map uploads their full rate again and stop answering discovery queries until
+    // the next match.
+    HookEvent("Function TAGame.GameEvent_Soccar_TA.Destroyed",
+        [this](const std::string&) {
+            if (peerFileServerJoined) {
+                peerFileServerJoined = false;
+                peerFileServer = nullptr;
+            }
+            updateUploadLimits(false);
+            if (matchFileServer != nullptr) {
+                matchFileServer->SetLanBeacon(std::nullopt);
+            }
+        });
+
+    // Send the networked messages that were queued this tick.
+    HookEventPost("Function Engine.GameViewportClient.Tick",
+        [this](const std::string&) {
+            netCode.Flush();
+        });
 }
 
 
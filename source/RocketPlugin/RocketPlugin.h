@@ -3,6 +3,8 @@
 #include "Networking/Networking.h"
 #include "Networking/RPNetCode.h"
 #include "Networking/MatchFileServer.h"
+#include "Networking/HostQuality.h"
+#include "Networking/MapCache.h"
 
 #include "Modules/RocketPluginModule.h"
 #include "Modules/GameControls.h"
@@ -29,6 +31,8 @@ extern std::filesystem::path RocketLeagueExecutableFolder;
 #define CONFIG_FILE_PATH       (BakkesModConfigFolder / "config.cfg")
 #define PRESETS_PATH           (RocketPluginDataFolder / "presets")
 #define PRO_TIPS_FILE_PATH     (RocketPluginDataFolder / "Pro-tips.txt")
+#define NET_METRICS_FILE_PATH  (RocketPluginDataFolder / "Net-metrics.txt")
+#define MAP_CACHE_PATH         (RocketPluginDataFolder / "map-cache")
 #define COOKED_PC_CONSOLE_PATH (RocketLeagueExecutableFolder / "../../TAGame/CookedPCConsole")
 #define CUSTOM_MAPS_PATH       (COOKED_PC_CONSOLE_PATH / "mods")
 #define COPIED_MAPS_PATH       (COOKED_PC_CONSOLE_PATH / "rocketplugin")
@@ -111,6 +115,8 @@ private:
     bool preLoadMap(const std::filesystem::path&, bool = false, bool = false);
     void copyMap(const std::filesystem::path& map = "");
     void onGameEventInit(const ServerWrapper& server);
+    void updateUploadLimits(bool matchActive);
+    void updateLanBeacon();
 
     bool isJoiningParty = false;
     std::string joiningPartyIp;
@@ -242,12 +248,15 @@ private:
 
     /* Join Settings */
 public:
+    MapCache mapCache;
+
 private:
     void renderMultiplayerTabJoin();
 
     int joiningPartyPort = DEFAULT_PORT;
     std::shared_ptr<std::string> joinIP;
     std::shared_ptr<int> joinPort;
+    std::shared_ptr<int> mapCacheBudget;
     Networking::HostStatus hostStatus = Networking::HostStatus::HOST_UNKNOWN;
     Networking::DestAddrType addressType = Networking::DestAddrType::UNKNOWN_ADDR;
     bool joinCustomMap = false;
@@ -260,9 +269,18 @@ private:
     bool loadingScreenHooked = false;
     std::wstring loadingScreenMapName;
     std::wstring loadingScreenMapAuthor;
+    // Hosts on the local network, created when the join tab is first shown.
+    std::unique_ptr<LanDiscovery> lanDiscovery;
+    // Connection quality to the local network hosts and the host that is joined.
+    HostQualitySampler hostQuality;
+    // Reachability of the game port of the local network hosts, probed again when the list of hosts changes.
+    std::future<std::vector<Networking::HostProbeResult>> lanHostProbeRequest;
+    std::vector<Networking::HostProbeResult> lanHostProbes;
+    bool lanHostsProbed = false;
     std::future<MatchFileServer::ServerStatus> serverStatusRequest;
     std::future<bool> mapDownloadRequest;
     float mapDownloadRequestProgress = 0.f;
+    std::filesystem::path mapDownloadRequestPath;
     std::filesystem::path mapDownloadPath;
     std::wstring mapDownloadExtension;
 
@@ -314,6 +332,15 @@ private:
     std::string fileServerAddress = "0.0.0.0";
     unsigned short fileServerPort = DEFAULT_PORT;
     std::unique_ptr<MatchFileServer> matchFileServer;
+    // Serves a map downloaded from the host to the other joining players, until the player leaves the match.
+    std::unique_ptr<MatchFileServer> peerFileServer;
+    bool peerFileServerJoined = false;
+    std::shared_ptr<bool> mapServeToPeers;
+    // Upload limits of the match file server, in KB per second or players, 0 for no limit.
+    std::shared_ptr<int> mapUploadLimit;
+    std::shared_ptr<int> mapUploadMatchLimit;
+    std::shared_ptr<int> mapUploadConnectionLimit;
+    std::shared_ptr<int> mapMaxTransfers;
 
     /* In Game Mods */
 public:
@@ -846,7 +846,11 @@ void RocketPlugin::renderMultiplayerTabHostAdvancedSettingsMatchFileHostSettings
         ImGui::PopStyleVar();  // ImGuiStyleVar_ItemSpacing
         if (matchFileServer == nullptr) {
             if (ImGui::Button("Start Server")) {
+                // The peer server holds the port.
+                peerFileServer = nullptr;
                 matchFileServer = std::make_unique<MatchFileServer>(fileServerAddress, fileServerPort);
+                updateUploadLimits(IsInGame(true));
+                updateLanBeacon();
             }
         }
         else {
@@ -975,6 +979,77 @@ void RocketPlugin::renderMultiplayerTabJoin()
         else if (ImGui::IsItemActive() || !validPort) {
             updateServerStatus = false;
         }
+        ImGui::TextUnformatted(" Local network games:");
+        ImGui::SameLine();
+        if (lanDiscovery == nullptr) {
+            lanDiscovery = std::make_unique<LanDiscovery>();
+        }
+        if (ImGui::SmallButton("Refresh")) {
+            lanDiscovery->Refresh();
+        }
+        if (lanDiscovery->Update()) {
+            lanHostsProbed = false;
+        }
+        // The beacon only says the host is there, probe the game ports to see if the games can be joined.
+        if (lanHostProbeRequest.valid() && lanHostProbeRequest._Is_ready()) {
+            lanHostProbes = lanHostProbeRequest.get();
+        }
+        if (!lanHostsProbed && !lanHostProbeRequest.valid()) {
+            std::vector<std::pair<std::string, unsigned short>> probedHosts;
+            for (const LanDiscovery::LanHost& lanHost : lanDiscovery->GetHosts()) {
+                probedHosts.emplace_back(lanHost.Address, lanHost.Beacon.Port);
+            }
+            if (!probedHosts.empty()) {
+                lanHostProbeRequest = Networking::ProbeHosts(probedHosts, HOST_PROBE_COUNT, true);
+            }
+            lanHostsProbed = true;
+        }
+        std::vector<HostQualitySampler::HostKey> sampledHosts;
+        for (const LanDiscovery::LanHost& lanHost : lanDiscovery->GetHosts()) {
+            sampledHosts.emplace_back(lanHost.Address, LAN_DISCOVERY_PORT);
+        }
+        // Only the local network can reach the responder, it is not forwarded and ignores anything else.
+        if (hostStatus == Networking::HostStatus::HOST_ONLINE && Networking::IsPrivateIPv4(*joinIP)) {
+            sampledHosts.emplace_back(*joinIP, LAN_DISCOVERY_PORT);
+        }
+        hostQuality.SetHosts(sampledHosts);
+        hostQuality.Update();
+        if (lanDiscovery->GetHosts().empty()) {
+            ImGui::TextDisabled("  No games found");
+        }
+        for (const LanDiscovery::LanHost& lanHost : lanDiscovery->GetHosts()) {
+            const LanBeacon& beacon = lanHost.Beacon;
+            const std::optional<HostQuality> quality = hostQuality.GetQuality(lanHost.Address);
+            const std::string label = fmt::format("{:s} ({:d}/{:d}){:s} {:s}:{:d}{:s}", quote(beacon.MapName), beacon.Players,
+                beacon.MaxPlayers, beacon.Password ? " password" : "", lanHost.Address, beacon.Port,
+                quality && quality->Loss < 1 ? fmt::format(" {:d}ms", std::chrono::round<std::chrono::milliseconds>(quality->RTT).count()) : "");
+            const bool selected = *joinIP == lanHost.Address && *joinPort == beacon.Port;
+            const auto probe = std::ranges::find_if(lanHostProbes, [&](const Networking::HostProbeResult& lanHostProbe) {
+                return lanHostProbe.Host == lanHost.Address && lanHostProbe.Port == beacon.Port;
+            });
+            const bool unreachable = probe != lanHostProbes.end() && (probe->Status == Networking::HostStatus::HOST_TIMEOUT ||
+                probe->Status == Networking::HostStatus::HOST_ERROR);
+            if (unreachable) {
+                ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled));
+            }
+            const bool clicked = ImGui::Selectable(label.c_str(), selected);
+            if (unreachable) {
+                ImGui::PopStyleColor();
+            }
+            if (clicked && !selected && flags == ImGuiInputTextFlags_None) {
+                *joinIP = lanHost.Address;
+                *joinPort = beacon.Port;
+                cvarManager->getCvar("mp_ip").setValue(*joinIP);
+                cvarManager->getCvar("mp_port").setValue(*joinPort);
+                addressType = Networking::GetDestAddrType(*joinIP);
+                hostStatus = Networking::HostStatus::HOST_UNKNOWN;
+                updateServerStatus = addressType != Networking::DestAddrType::UNKNOWN_ADDR;
+            }
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip(fmt::format("Rocket Plugin {:s}{:s}", beacon.Version,
+                    unreachable ? "\nThe game port did not answer, the game might not be joinable." : ""));
+            }
+        }
         if (updateServerStatus) {
             if (mapDownloadRequest.valid()) {
                 mapDownloadRequest.wait();
@@ -988,8 +1063,17 @@ void RocketPlugin::renderMultiplayerTabJoin()
 
         if (serverStatusRequest._Is_ready()) {
             const MatchFileServer::ServerStatus serverStatus = serverStatusRequest._Ptr()->_Get_value(false);
+            // Hosts without a responder never answer, that says nothing about the connection.
+            if (const std::optional<HostQuality> quality = hostQuality.GetQuality(*joinIP); quality && quality->Loss < 1) {
+                ImGui::TextWrapped(fmt::format("Connection: {:.0f}ms, jitter {:.0f}ms, {:.0f}% loss",
+                    std::chrono::duration<float, std::milli>(quality->RTT).count(),
+                    std::chrono::duration<float, std::milli>(quality->Jitter).count(), quality->Loss * 100));
+            }
             if (serverStatus.CurrentMap.FileSize > 0) {
                 ImGui::TextWrapped(fmt::format("Version: {:s}", serverStatus.Version));
+                if (serverStatus.QueuePosition > 0) {
+                    ImGui::TextWrapped(fmt::format("Download queue position: {:d}", serverStatus.QueuePosition));
+                }
                 ImGui::TextWrapped("Maps:");
                 if (serverStatus.CurrentMap.Override) {
                     ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32_WARNING.Value);
@@ -1005,9 +1089,9 @@ void RocketPlugin::renderMultiplayerTabJoin()
                     }
                 }
             }
-            if (serverStatus.ShouldDownloadMap()) {
+            if (serverStatus.ShouldDownloadMap() || serverStatus.ShouldRestoreMap()) {
                 if (mapDownloadRequest._Ptr() == nullptr) {
-                    if (ImGui::Button("Download map")) {
+                    if (ImGui::Button(serverStatus.IsCached() ? "Load cached map" : "Download map")) {
                         ImGui::OpenPopup("Download map");
                     }
                     bool open = true;
@@ -1024,7 +1108,9 @@ void RocketPlugin::renderMultiplayerTabJoin()
                             quote(serverStatus.CurrentMap.MapName), format_file_size(serverStatus.CurrentMap.FileSize), *joinIP, *joinPort, quote(downloadPath.string())));
                         if (ImGui::Button("Yes")) {
                             mapDownloadRequestProgress = 0.f;
-                            mapDownloadRequest = MatchFileServer::DownloadMap(*joinIP, *joinPort, downloadPath, &mapDownloadRequestProgress);
+                            mapDownloadRequest = MatchFileServer::DownloadMap(*joinIP, *joinPort, downloadPath, serverStatus.CurrentMap,
+                                serverStatus.Dependencies, &mapDownloadRequestProgress);
+                            mapDownloadRequestPath = downloadPath;
                             ImGui::CloseCurrentPopup();
                         }
                         ImGui::SameLine();
@@ -1038,6 +1124,19 @@ void RocketPlugin::renderMultiplayerTabJoin()
                     }
                 }
                 else if (mapDownloadRequest._Is_ready()) {
+                    // Serve the downloaded map to the other players joining, to take load off the host.
+                    if (!mapDownloadRequestPath.empty()) {
+                        if (*mapServeToPeers && matchFileServer == nullptr &&
+                            mapCache.Contains(serverStatus.CurrentMap.Guid, serverStatus.CurrentMap.Hash)) {
+                            // Stop serving the previous map first, which holds the port.
+                            peerFileServer = nullptr;
+                            peerFileServer = std::make_unique<MatchFileServer>(fileServerAddress, fileServerPort,
+                                serverStatus.CurrentMap, mapDownloadRequestPath, *joinIP, *joinPort);
+                            peerFileServerJoined = false;
+                            updateUploadLimits(IsInGame(true));
+                        }
+                        mapDownloadRequestPath.clear();
+                    }
                     if (mapDownloadRequest._Ptr()->_Get_value(false)) {
                         ImGui::PushStyleColor(ImGuiCol_PlotHistogram, IM_COL32_SUCCESS.Value);
                         ImGui::ProgressBar(1.f, ImVec2(-1, 0), "Map Download Finished");
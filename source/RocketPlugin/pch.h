@@ -21,6 +21,7 @@
 #include <filesystem>
 #include <functional>
 #include <algorithm>
+#include <optional>
 #include <fstream>
 #include <utility>
 #include <chrono>
@@ -33,6 +34,7 @@
 #include <queue>
 #include <regex>
 #include <map>
+#include <bit>
 
 // SIMDJson
 #pragma warning(push, 0)